@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "subpattern.h"
+
+/*
+ * Benchmark the stages of an offline analysis: reading a trace,
+ * parsing and matching every trace line, and identifying and printing
+ * the significant sub-patterns (the analysis). The analysis output is
+ * discarded.
+ */
+
+void subpattern_init(const char *tracingpath, const pid_t *tasks, int ntasks,
+		     int flags);
+int subpattern_handle_traceline(const char *traceline);
+void subpattern_cleanup(void);
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long peak_rss_kb(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+
+	return ru.ru_maxrss;
+}
+
+static char *read_trace(const char *path, size_t *size)
+{
+	struct stat st;
+	size_t len = 0;
+	ssize_t n;
+	char *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "open failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "fstat failed: %s\n", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	buf = malloc(st.st_size + 1);
+	if (!buf) {
+		fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	while (len < (size_t)st.st_size) {
+		n = read(fd, buf + len, st.st_size - len);
+		if (n <= 0)
+			break;
+		len += n;
+	}
+	buf[len] = 0;
+
+	close(fd);
+
+	*size = len;
+	return buf;
+}
+
+static unsigned long match_lines(char *buf)
+{
+	unsigned long lines = 0;
+	char *p = buf;
+	char *nl;
+	char c;
+
+	while ((nl = strchr(p, '\n'))) {
+		c = nl[1];
+		nl[1] = 0;
+		if (p[0] != '#') {
+			subpattern_handle_traceline(p);
+			lines++;
+		}
+		nl[1] = c;
+		p = nl + 1;
+	}
+
+	return lines;
+}
+
+static void print_stage(const char *stage, unsigned long long ns,
+			unsigned long lines)
+{
+	printf("  %-9s %10.3f ms", stage, ns / 1000000.0);
+	if (lines && ns) {
+		printf(" %10.0f lines/s %8.1f ns/line",
+		       lines * 1000000000.0 / ns, (double)ns / lines);
+	} else {
+		printf(" %35s", "");
+	}
+	printf("  peak RSS %8ld kB\n", peak_rss_kb());
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-l <label>] -i <trace> -p <pid>"
+		" [-p <pid>]...\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long t_match;
+	unsigned long long t_read;
+	unsigned long long t_done;
+	unsigned long long t0;
+	pid_t tasks[MAX_FOCUS_TASKS];
+	const char *label = NULL;
+	const char *input = NULL;
+	unsigned long lines;
+	int ntasks = 0;
+	size_t size;
+	int stdout_fd;
+	char *buf;
+	int null;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:l:p:")) != -1) {
+		switch (opt) {
+		case 'i':
+			input = optarg;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'p':
+			if (ntasks >= MAX_FOCUS_TASKS) {
+				fprintf(stderr, "too many tasks (max %d)\n",
+					MAX_FOCUS_TASKS);
+				return 1;
+			}
+			tasks[ntasks++] = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!input || !ntasks || optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	t0 = now_ns();
+	buf = read_trace(input, &size);
+	if (!buf)
+		return 1;
+	t_read = now_ns();
+
+	/* discard the analysis output */
+	fflush(stdout);
+	stdout_fd = dup(STDOUT_FILENO);
+	null = open("/dev/null", O_WRONLY);
+	if (stdout_fd < 0 || null < 0) {
+		fprintf(stderr, "open failed: %s\n", strerror(errno));
+		return 1;
+	}
+	dup2(null, STDOUT_FILENO);
+	close(null);
+
+	subpattern_init(NULL, tasks, ntasks, 0);
+	lines = match_lines(buf);
+	t_match = now_ns();
+
+	subpattern_cleanup();
+	fflush(stdout);
+	t_done = now_ns();
+
+	dup2(stdout_fd, STDOUT_FILENO);
+	close(stdout_fd);
+
+	printf("%s: %lu lines, %lu kB, %d focus task%s\n",
+	       label ? label : input, lines, (unsigned long)(size / 1024),
+	       ntasks, ntasks > 1 ? "s" : "");
+	print_stage("read", t_read - t0, 0);
+	print_stage("match", t_match - t_read, lines);
+	print_stage("analysis", t_done - t_match, lines);
+	print_stage("total", t_done - t0, lines);
+
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Generate synthetic traces of increasing complexity and benchmark the
+# offline analysis of each. BENCH_LINES sets the trace length.
+#
+
+dir=$(dirname "$0")
+lines=${BENCH_LINES:-200000}
+trace=$(mktemp)
+trap 'rm -f "$trace"' EXIT
+
+run() {
+	label=$1
+	gen=$2
+	focus=$3
+
+	"$dir/tracegen" -n "$lines" $gen > "$trace" || exit 1
+	"$dir/bench" -l "$label" -i "$trace" $focus || exit 1
+	echo
+}
+
+run "2 tasks, 1 cpu, depth 1" "-t 2 -c 1 -d 1" "-p 1000"
+run "8 tasks, 2 cpus, depth 2" "-t 8 -c 2 -d 2" "-p 1000 -p 1001"
+run "8 tasks, 1 cpu, sleep heavy" "-t 8 -c 1 -m 8:0:1 -s 100" \
+    "-p 1000 -p 1001"
+run "32 tasks, 4 cpus, depth 4, futex heavy" "-t 32 -c 4 -d 4 -m 1:4:1" \
+    "-p 1000 -p 1001 -p 1002 -p 1003"
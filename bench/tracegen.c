@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+/*
+ * Generate a synthetic ftrace text trace of a set of tasks for
+ * benchmarking. Tasks are assigned to CPUs and scheduled by priority.
+ * A woken task may be migrated to another CPU (-g percent of wakeups).
+ * They loop over a mix of syscalls: nanosleep (sleep), read/write
+ * (run briefly) and nested PI futex locking (block on owned locks,
+ * boost the owners along the chain and hand over the lock on unlock).
+ * The nesting depth is the number of locks taken in a row.
+ */
+
+#define NR_READ      3
+#define NR_WRITE     4
+#define NR_NANOSLEEP 162
+#define NR_FUTEX     240
+
+#define FUTEX_LOCK_PI   6
+#define FUTEX_UNLOCK_PI 7
+
+#define MAX_TASKS 1024
+#define MAX_CPUS  64
+#define MAX_DEPTH 16
+
+#define LOCK_BASE 0x8049a40UL
+
+enum action {
+	A_NONE = 0,
+	A_SLEEP,
+	A_RW,
+	A_LOCK,
+	A_HOLD,
+	A_UNLOCK,
+};
+
+enum state {
+	RUNNING = 0,
+	RUNNABLE,
+	SLEEPING,
+};
+
+struct task {
+	pid_t pid;
+	char comm[16];
+	int prio;
+	int cur_prio;
+	int cpu;
+
+	enum state state;
+	/* time of the next step, dispatch or wakeup (0: none) */
+	unsigned long long next;
+
+	enum action action;
+	int nr;
+	int phase;
+	int nr_held;
+	int wait_lock;
+};
+
+struct lock {
+	struct task *owner;
+};
+
+static struct task tasks[MAX_TASKS];
+static int nr_tasks = 4;
+static struct task *cur[MAX_CPUS];
+static int nr_cpus = 1;
+static struct lock locks[MAX_DEPTH];
+static int depth = 1;
+
+static unsigned long mix[3] = { 4, 2, 4 };
+static unsigned long long sleep_ns = 1000000ULL;
+static unsigned long long run_ns = 50000ULL;
+static unsigned long long now = 1000000000ULL;
+static unsigned long nr_lines;
+static unsigned long seed = 1;
+static unsigned long migrate_pct;
+
+/* a small LCG, so traces are reproducible on every libc */
+static unsigned long rnd(void)
+{
+	seed = seed * 1103515245UL + 12345UL;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* roughly exponentially distributed around the mean, at least 1 us */
+static unsigned long long rnd_ns(unsigned long long mean)
+{
+	unsigned long long ns = 1000;
+	unsigned long r = rnd();
+
+	while (r & 1) {
+		ns += mean;
+		r >>= 1;
+	}
+
+	return ns + (mean * (rnd() % 1024)) / 1024;
+}
+
+static void emit(struct task *t, int cpu, const char *flags,
+		 const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("%16s-%-5d [%03d] %s %5llu.%06llu: ",
+	       t ? t->comm : "<idle>", t ? t->pid : 0, cpu, flags,
+	       now / 1000000000ULL, (now % 1000000000ULL) / 1000);
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	printf("\n");
+	nr_lines++;
+}
+
+static void emit_switch(int cpu, struct task *prev, char prev_state,
+			struct task *next)
+{
+	char idle[16];
+
+	snprintf(idle, sizeof(idle), "swapper/%d", cpu);
+
+	emit(prev, cpu, "d..3", "sched_switch: prev_comm=%s prev_pid=%d"
+	     " prev_prio=%d prev_state=%c ==> next_comm=%s next_pid=%d"
+	     " next_prio=%d",
+	     prev ? prev->comm : idle, prev ? prev->pid : 0,
+	     prev ? prev->cur_prio : 120, prev_state,
+	     next ? next->comm : idle, next ? next->pid : 0,
+	     next ? next->cur_prio : 120);
+}
+
+/* switch to the best runnable task of the CPU, if any */
+static void schedule(int cpu, char prev_state)
+{
+	struct task *prev = cur[cpu];
+	struct task *next = NULL;
+	int i;
+
+	for (i = 0; i < nr_tasks; i++) {
+		if (tasks[i].cpu != cpu || tasks[i].state != RUNNABLE)
+			continue;
+		if (!next || tasks[i].cur_prio < next->cur_prio)
+			next = &tasks[i];
+	}
+
+	if (!next && !prev)
+		return;
+
+	emit_switch(cpu, prev, prev ? prev_state : 'R', next);
+
+	if (prev && prev_state == 'R') {
+		prev->state = RUNNABLE;
+		prev->next = 0;
+	}
+
+	cur[cpu] = next;
+	if (next) {
+		next->state = RUNNING;
+		next->next = now + 1000 + rnd() % 4000;
+	}
+}
+
+static void wake(struct task *t, struct task *waker)
+{
+	int cpu = waker ? waker->cpu : t->cpu;
+	int dest;
+
+	if (nr_cpus > 1 && migrate_pct && rnd() % 100 < migrate_pct) {
+		dest = (t->cpu + 1 + rnd() % (nr_cpus - 1)) % nr_cpus;
+		emit(waker, cpu, "d..2", "sched_migrate_task: comm=%s pid=%d"
+		     " prio=%d orig_cpu=%d dest_cpu=%d", t->comm, t->pid,
+		     t->cur_prio, t->cpu, dest);
+		t->cpu = dest;
+	}
+
+	emit(waker, cpu, "d..3", "sched_wakeup: comm=%s pid=%d prio=%d"
+	     " target_cpu=%03d", t->comm, t->pid, t->cur_prio, t->cpu);
+
+	t->state = RUNNABLE;
+	t->next = now + 1000 + rnd() % 20000;
+}
+
+/* a runnable task gets the CPU if it is idle or runs a lower prio task */
+static void dispatch(struct task *t)
+{
+	struct task *c = cur[t->cpu];
+
+	t->next = 0;
+
+	if (!c || t->cur_prio < c->cur_prio)
+		schedule(t->cpu, 'R');
+}
+
+static void block(struct task *t, unsigned long long wakeup)
+{
+	t->state = SLEEPING;
+	t->next = wakeup;
+	schedule(t->cpu, 'S');
+}
+
+static void set_prio(struct task *ctx, struct task *t, int prio)
+{
+	emit(ctx, ctx->cpu, "d..2", "sched_pi_setprio: comm=%s pid=%d"
+	     " oldprio=%d newprio=%d", t->comm, t->pid, t->cur_prio, prio);
+	t->cur_prio = prio;
+}
+
+static void sys_enter(struct task *t, int nr, unsigned long arg0,
+		      unsigned long arg1)
+{
+	emit(t, t->cpu, "....", "sys_enter: NR %d (%lx, %lx, 0, 0, 0, 0)",
+	     nr, arg0, arg1);
+}
+
+static void sys_exit(struct task *t, int nr, long ret)
+{
+	emit(t, t->cpu, "....", "sys_exit: NR %d = %ld", nr, ret);
+}
+
+static void start_lock(struct task *t)
+{
+	sys_enter(t, NR_FUTEX, LOCK_BASE + t->nr_held * 4, FUTEX_LOCK_PI);
+	t->action = A_LOCK;
+	t->phase = 0;
+	t->next = now + 1000 + rnd() % 2000;
+}
+
+static void start_unlock(struct task *t)
+{
+	sys_enter(t, NR_FUTEX, LOCK_BASE + (t->nr_held - 1) * 4,
+		  FUTEX_UNLOCK_PI);
+	t->action = A_UNLOCK;
+	t->next = now + 1000 + rnd() % 2000;
+}
+
+static void try_lock(struct task *t)
+{
+	struct lock *l = &locks[t->nr_held];
+	struct task *o;
+	int hops = 0;
+
+	if (!l->owner) {
+		l->owner = t;
+		t->nr_held++;
+		sys_exit(t, NR_FUTEX, 0);
+		if (t->nr_held < depth)
+			start_lock(t);
+		else {
+			t->action = A_HOLD;
+			t->next = now + rnd_ns(run_ns);
+		}
+		return;
+	}
+
+	/* walk the PI chain, boosting every owner with a lower prio */
+	for (o = l->owner; o && hops < MAX_DEPTH; hops++) {
+		if (o->cur_prio > t->cur_prio)
+			set_prio(t, o, t->cur_prio);
+		o = (o->wait_lock >= 0) ? locks[o->wait_lock].owner : NULL;
+	}
+
+	t->wait_lock = t->nr_held;
+	t->phase = 1;
+	block(t, 0);
+}
+
+static void unlock(struct task *t)
+{
+	struct lock *l = &locks[t->nr_held - 1];
+	struct task *w = NULL;
+	int i;
+
+	for (i = 0; i < nr_tasks; i++) {
+		if (tasks[i].wait_lock != t->nr_held - 1)
+			continue;
+		if (!w || tasks[i].cur_prio < w->cur_prio)
+			w = &tasks[i];
+	}
+
+	t->nr_held--;
+	l->owner = w;
+
+	if (w) {
+		/* hand over the lock */
+		w->wait_lock = -1;
+		w->nr_held++;
+		wake(w, t);
+	}
+
+	if (!t->nr_held && t->cur_prio != t->prio)
+		set_prio(t, t, t->prio);
+
+	sys_exit(t, NR_FUTEX, 0);
+
+	if (t->nr_held)
+		start_unlock(t);
+	else {
+		t->action = A_NONE;
+		t->next = now + rnd_ns(run_ns);
+	}
+}
+
+static void start_action(struct task *t)
+{
+	unsigned long r = rnd() % (mix[0] + mix[1] + mix[2]);
+
+	t->phase = 0;
+
+	if (r < mix[0]) {
+		sys_enter(t, NR_NANOSLEEP, 0xbfa1c2e0, 0);
+		t->action = A_SLEEP;
+		t->next = now + 1000 + rnd() % 4000;
+	} else if (r < mix[0] + mix[1]) {
+		start_lock(t);
+	} else {
+		t->nr = (r & 1) ? NR_READ : NR_WRITE;
+		sys_enter(t, t->nr, 3, 0xbfa1c000);
+		t->action = A_RW;
+		t->next = now + 1000 + rnd() % 20000;
+	}
+}
+
+static void step(struct task *t)
+{
+	switch (t->action) {
+	case A_NONE:
+		start_action(t);
+		break;
+	case A_SLEEP:
+		if (t->phase == 0) {
+			t->phase = 1;
+			block(t, now + rnd_ns(sleep_ns));
+			break;
+		}
+		sys_exit(t, NR_NANOSLEEP, 0);
+		t->action = A_NONE;
+		t->next = now + rnd_ns(run_ns);
+		break;
+	case A_RW:
+		sys_exit(t, t->nr, 64);
+		t->action = A_NONE;
+		t->next = now + rnd_ns(run_ns);
+		break;
+	case A_LOCK:
+		if (t->phase == 0) {
+			try_lock(t);
+			break;
+		}
+		/* the lock was handed over */
+		sys_exit(t, NR_FUTEX, 0);
+		if (t->nr_held < depth)
+			start_lock(t);
+		else {
+			t->action = A_HOLD;
+			t->next = now + rnd_ns(run_ns);
+		}
+		break;
+	case A_HOLD:
+		start_unlock(t);
+		break;
+	case A_UNLOCK:
+		unlock(t);
+		break;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t <tasks>] [-c <cpus>] [-n <lines>]"
+		" [-d <depth>] [-m <sleep>:<futex>:<rw>]\n"
+		"       [-s <sleep us>] [-r <run us>] [-g <migrate %%>]"
+		" [-S <seed>]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long max_lines = 100000;
+	struct task *t;
+	struct task *n;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "c:d:g:m:n:r:S:s:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cpus = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			depth = strtoul(optarg, NULL, 10);
+			break;
+		case 'g':
+			migrate_pct = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			if (sscanf(optarg, "%lu:%lu:%lu", &mix[0], &mix[1],
+				   &mix[2]) != 3) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			max_lines = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			run_ns = strtoul(optarg, NULL, 10) * 1000ULL;
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			sleep_ns = strtoul(optarg, NULL, 10) * 1000ULL;
+			break;
+		case 't':
+			nr_tasks = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_tasks < 1 || nr_tasks > MAX_TASKS || nr_cpus < 1 ||
+	    nr_cpus > MAX_CPUS || depth < 1 || depth > MAX_DEPTH ||
+	    !(mix[0] + mix[1] + mix[2])) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* every other task is an RT task */
+	for (i = 0; i < nr_tasks; i++) {
+		t = &tasks[i];
+		t->pid = 1000 + i;
+		snprintf(t->comm, sizeof(t->comm), "task%d", i);
+		t->prio = (i % 2) ? 120 : 44 + (i / 2) % 50;
+		t->cur_prio = t->prio;
+		t->cpu = i % nr_cpus;
+		t->state = RUNNABLE;
+		t->next = now + rnd_ns(run_ns);
+		t->wait_lock = -1;
+	}
+
+	printf("# tracer: nop\n#\n");
+
+	while (nr_lines < max_lines) {
+		/* the earliest pending step, dispatch or wakeup */
+		n = NULL;
+		for (i = 0; i < nr_tasks; i++) {
+			t = &tasks[i];
+			if (!t->next)
+				continue;
+			if (!n || t->next < n->next)
+				n = t;
+		}
+		if (!n)
+			break;
+
+		if (n->next > now)
+			now = n->next;
+
+		switch (n->state) {
+		case RUNNING:
+			n->next = 0;
+			step(n);
+			break;
+		case RUNNABLE:
+			dispatch(n);
+			break;
+		case SLEEPING:
+			wake(n, cur[n->cpu]);
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include "subpattern.h"
+#include "tracefs.h"
+#include "util.h"
+#include "calibrate.h"
+
+/*
+ * Measure the overhead the configured trace events add to a task on
+ * this machine. Two micro-workloads run in latcheck itself, pinned to
+ * CPU0 like a traced command: a loop of cheap syscalls (a sys_enter and
+ * a sys_exit event per iteration) and a loop of short sleeps (which
+ * also schedule out, wake up and schedule in the task). They run first
+ * untraced and then with the events of all sub-patterns enabled for
+ * latcheck. The best of several runs is taken.
+ */
+
+#define CAL_SYSCALLS 20000
+#define CAL_SLEEPS 1000
+#define CAL_RUNS 5
+
+/* events traced per iteration of the syscall loop */
+#define CAL_SYSCALL_EVENTS 2
+
+void subpattern_init(const char *tracingpath, const pid_t *tasks, int ntasks,
+		     int flags);
+void subpattern_cleanup(void);
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts_to_ns(&ts);
+}
+
+/* ns per iteration */
+static unsigned long long run_syscalls(void)
+{
+	unsigned long long t0 = now_ns();
+	int i;
+
+	for (i = 0; i < CAL_SYSCALLS; i++)
+		getppid();
+
+	return (now_ns() - t0) / CAL_SYSCALLS;
+}
+
+static unsigned long long run_sleeps(void)
+{
+	struct timespec ts = { 0, 1000 };
+	unsigned long long t0 = now_ns();
+	int i;
+
+	for (i = 0; i < CAL_SLEEPS; i++)
+		nanosleep(&ts, NULL);
+
+	return (now_ns() - t0) / CAL_SLEEPS;
+}
+
+static unsigned long long best_of(unsigned long long (*run)(void))
+{
+	unsigned long long best = 0;
+	unsigned long long ns;
+	int i;
+
+	for (i = 0; i < CAL_RUNS; i++) {
+		ns = run();
+		if (!best || ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+static void print_workload(const char *name, int iterations,
+			   unsigned long long untraced,
+			   unsigned long long traced)
+{
+	printf("%-10s %10d %12llu %12llu %12lld\n", name, iterations,
+	       untraced, traced, (long long)(traced - untraced));
+}
+
+int calibrate(int flags)
+{
+	unsigned long long untraced_sleep;
+	unsigned long long untraced_sys;
+	unsigned long long traced_sleep;
+	unsigned long long traced_sys;
+	unsigned long long per_event;
+	char tracingpath[256];
+	pid_t self = getpid();
+	char name[32];
+	cpu_set_t cset;
+
+	CPU_ZERO(&cset);
+	CPU_SET(0, &cset);
+	if (sched_setaffinity(0, sizeof(cset), &cset) != 0) {
+		fprintf(stderr, "sched_setaffinity failed: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	untraced_sys = best_of(run_syscalls);
+	untraced_sleep = best_of(run_sleeps);
+
+	snprintf(name, sizeof(name), "latency_calibrate.%u", self);
+	if (tracefs_create_instance(tracingpath, sizeof(tracingpath),
+				    name) != 0) {
+		return 1;
+	}
+
+	/* windowed: nothing is printed without violations */
+	subpattern_init(tracingpath, &self, 1, flags | SP_WINDOWED);
+
+	traced_sys = best_of(run_syscalls);
+	traced_sleep = best_of(run_sleeps);
+
+	set_tracing(tracingpath, "tracing_on", "0");
+
+	subpattern_cleanup();
+
+	tracefs_remove_instance(tracingpath);
+
+	per_event = 0;
+	if (traced_sys > untraced_sys)
+		per_event = (traced_sys - untraced_sys) / CAL_SYSCALL_EVENTS;
+
+	printf("tracing overhead calibration (CPU0):\n\n");
+	printf("%-10s %10s %12s %12s %12s\n", "workload", "iterations",
+	       "untraced ns", "traced ns", "overhead ns");
+	print_workload("syscall", CAL_SYSCALLS, untraced_sys, traced_sys);
+	print_workload("nanosleep", CAL_SLEEPS, untraced_sleep,
+		       traced_sleep);
+	printf("\noverhead per event: %llu ns\n", per_event);
+	printf("use -O %llu to annotate durations with the expected"
+	       " tracing overhead\n", per_event);
+
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "latcheck.h"
+#include "util.h"
+#include "capture.h"
+
+/*
+ * Run an analysis in a child process with its output discarded. The
+ * summary pattern of the child passes the focus tasks, the durations
+ * of all relevant sub-patterns and the significant counts back through
+ * a pipe. This keeps the (global) analysis state of several captures
+ * apart.
+ */
+
+struct latcheck_config *subpattern_defaults(void);
+
+static struct capture_kind *get_kind(struct capture *c, const char *key)
+{
+	struct capture_kind *k = capture_find(c, key);
+
+	if (k)
+		return k;
+
+	k = array_grow(c->kinds, c->nr_kinds, sizeof(*k));
+	if (!k)
+		return NULL;
+	c->kinds = k;
+
+	k = &c->kinds[c->nr_kinds++];
+	memset(k, 0, sizeof(*k));
+	snprintf(k->key, sizeof(k->key), "%s", key);
+
+	return k;
+}
+
+static int parse_summary(struct capture *c, FILE *f)
+{
+	char key[SUMMARY_KEY_MAX];
+	struct capture_kind *k;
+	unsigned long long *ns;
+	unsigned long long val;
+	char line[128];
+	char type;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "t %llu", &val) == 1) {
+			if (c->ntasks < MAX_FOCUS_TASKS)
+				c->tasks[c->ntasks++] = val;
+			continue;
+		}
+
+		if (sscanf(line, "%c %47s %llu", &type, key, &val) < 2)
+			continue;
+
+		k = get_kind(c, key);
+		if (!k)
+			return -1;
+
+		if (type == 's') {
+			k->significant++;
+			continue;
+		}
+
+		ns = array_grow(k->ns, k->nr, sizeof(*ns));
+		if (!ns)
+			return -1;
+		k->ns = ns;
+		k->ns[k->nr++] = val;
+	}
+
+	return 0;
+}
+
+static int cmp_ull(const void *lhs, const void *rhs)
+{
+	const unsigned long long *l = lhs;
+	const unsigned long long *r = rhs;
+
+	if (*l != *r)
+		return (*l < *r) ? -1 : 1;
+
+	return 0;
+}
+
+int capture_run(capture_fn fn, void *arg, struct capture *c)
+{
+	int pipefd[2];
+	int status;
+	pid_t pid;
+	int ret;
+	int fd;
+	int i;
+	FILE *f;
+
+	memset(c, 0, sizeof(*c));
+
+	if (pipe(pipefd) != 0) {
+		fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "fork failed: %s\n", strerror(errno));
+		close(pipefd[0]);
+		close(pipefd[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(pipefd[0]);
+
+		/* only the summary is of interest */
+		fd = open("/dev/null", O_WRONLY);
+		if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+			exit(1);
+		close(fd);
+
+		subpattern_defaults()->summary_fd = pipefd[1];
+		exit(fn(arg) != 0);
+	}
+
+	close(pipefd[1]);
+
+	f = fdopen(pipefd[0], "r");
+	if (!f) {
+		fprintf(stderr, "fdopen failed: %s\n", strerror(errno));
+		close(pipefd[0]);
+		waitpid(pid, &status, 0);
+		return -1;
+	}
+	ret = parse_summary(c, f);
+	fclose(f);
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		ret = -1;
+	}
+
+	for (i = 0; i < c->nr_kinds; i++) {
+		qsort(c->kinds[i].ns, c->kinds[i].nr, sizeof(*c->kinds[i].ns),
+		      cmp_ull);
+	}
+
+	if (ret != 0)
+		capture_free(c);
+
+	return ret;
+}
+
+struct capture_kind *capture_find(struct capture *c, const char *key)
+{
+	int i;
+
+	for (i = 0; i < c->nr_kinds; i++) {
+		if (strcmp(c->kinds[i].key, key) == 0)
+			return &c->kinds[i];
+	}
+
+	return NULL;
+}
+
+void capture_free(struct capture *c)
+{
+	int i;
+
+	for (i = 0; i < c->nr_kinds; i++)
+		free(c->kinds[i].ns);
+	free(c->kinds);
+	memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <sys/types.h>
+#include "subpattern.h"
+#include "patterns/patterns.h"
+
+/* the durations (sorted) and significant count of one sub-pattern */
+struct capture_kind {
+	char key[SUMMARY_KEY_MAX];
+	unsigned long long *ns;
+	int nr;
+	unsigned long significant;
+};
+
+/* the summary of an analysis (see patterns/summary.c) */
+struct capture {
+	pid_t tasks[MAX_FOCUS_TASKS];
+	int ntasks;
+	struct capture_kind *kinds;
+	int nr_kinds;
+};
+
+/* an analysis run in a child process, returns 0 on success */
+typedef int (*capture_fn)(void *arg);
+
+extern int capture_run(capture_fn fn, void *arg, struct capture *c);
+extern struct capture_kind *capture_find(struct capture *c,
+					 const char *key);
+extern void capture_free(struct capture *c);
+
+#endif /* CAPTURE_H */
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include "util.h"
+#include "capture.h"
+#include "diff.h"
+
+/*
+ * Compare two captures, each analyzed offline in a child process (see
+ * capture.c).
+ *
+ * A shift of the p99 duration is significant if the distribution-free
+ * 95% confidence intervals of the p99 of both captures do not overlap.
+ * A shift of the maximum is significant if it is unlikely that as many
+ * durations of one capture exceed the maximum of the other by chance,
+ * i.e. if the same distribution would have put that many of the
+ * longest durations of both captures into one of them with a
+ * probability below 5%.
+ */
+
+#define DIFF_Z 1.96
+#define DIFF_P 0.05
+
+/* durations needed for a confidence interval of the p99 */
+#define DIFF_MIN_SAMPLES 20
+
+#define MAX_LOG2 32
+
+#define SHIFT_P99_UP 0x1
+#define SHIFT_P99_DOWN 0x2
+#define SHIFT_MAX_UP 0x4
+#define SHIFT_MAX_DOWN 0x8
+
+struct diff_kind {
+	char key[SUMMARY_KEY_MAX];
+	struct capture_kind *k[2];
+	int shift;
+};
+
+struct diff {
+	const char *path[2];
+	struct capture cap[2];
+	struct diff_kind *kinds;
+	int nr_kinds;
+};
+
+struct diff_capture {
+	diff_analyze analyze;
+	const char *path;
+	const pid_t *tasks;
+	int ntasks;
+};
+
+static int add_kind(struct diff *d, const char *key)
+{
+	struct diff_kind *k;
+	int i;
+
+	for (i = 0; i < d->nr_kinds; i++) {
+		if (strcmp(d->kinds[i].key, key) == 0)
+			return 0;
+	}
+
+	k = array_grow(d->kinds, d->nr_kinds, sizeof(*k));
+	if (!k)
+		return -1;
+	d->kinds = k;
+
+	k = &d->kinds[d->nr_kinds++];
+	memset(k, 0, sizeof(*k));
+	snprintf(k->key, sizeof(k->key), "%s", key);
+	k->k[0] = capture_find(&d->cap[0], key);
+	k->k[1] = capture_find(&d->cap[1], key);
+
+	return 0;
+}
+
+static int analyze_capture(void *arg)
+{
+	struct diff_capture *dc = arg;
+
+	return dc->analyze(dc->path, dc->tasks, dc->ntasks);
+}
+
+/* "<path>[:<pid>[,<pid>]...]", the pids replace the -p tasks */
+static int parse_capture(char *spec, pid_t *tasks, int *ntasks)
+{
+	char *p = strrchr(spec, ':');
+	char *end;
+	int n = 0;
+
+	if (!p || !p[1] || strspn(p + 1, "0123456789,") != strlen(p + 1))
+		return 0;
+	*p++ = 0;
+
+	while (*p && n < MAX_FOCUS_TASKS) {
+		tasks[n++] = strtoul(p, &end, 10);
+		if (end == p)
+			return -1;
+		p = (*end == ',') ? end + 1 : end;
+	}
+	*ntasks = n;
+
+	return 0;
+}
+
+static int clamp_rank(double rank, int n)
+{
+	if (rank < 0)
+		return 0;
+	if (rank > n - 1)
+		return n - 1;
+
+	return (int)rank;
+}
+
+/* the nearest-rank p99 and its 95% confidence interval */
+static unsigned long long p99(const unsigned long long *ns, int n,
+			      unsigned long long *lo, unsigned long long *hi)
+{
+	double dev = DIFF_Z * sqrt(n * 0.99 * 0.01);
+
+	*lo = ns[clamp_rank(floor(n * 0.99 - dev) - 1, n)];
+	*hi = ns[clamp_rank(ceil(n * 0.99 + dev) - 1, n)];
+
+	return ns[clamp_rank(ceil(n * 0.99) - 1, n)];
+}
+
+/*
+ * The probability that the "m" longest durations of both captures all
+ * belong to the capture with "n" of "total" durations by chance.
+ */
+static double exceed_probability(int m, int n, int total)
+{
+	double p = 1.0;
+	int i;
+
+	for (i = 0; i < m; i++)
+		p *= (double)(n - i) / (total - i);
+
+	return p;
+}
+
+static int count_above(const unsigned long long *ns, int n,
+		       unsigned long long limit)
+{
+	int m = 0;
+
+	while (m < n && ns[n - 1 - m] > limit)
+		m++;
+
+	return m;
+}
+
+/* the sorted durations of a sub-pattern in one capture */
+static int kind_ns(struct diff_kind *k, int side, unsigned long long **ns)
+{
+	if (!k->k[side]) {
+		*ns = NULL;
+		return 0;
+	}
+
+	*ns = k->k[side]->ns;
+
+	return k->k[side]->nr;
+}
+
+static unsigned long kind_significant(struct diff_kind *k, int side)
+{
+	return k->k[side] ? k->k[side]->significant : 0;
+}
+
+static void judge_kind(struct diff_kind *k)
+{
+	unsigned long long *ns[2];
+	unsigned long long lo[2];
+	unsigned long long hi[2];
+	int nr[2];
+	int m;
+
+	nr[0] = kind_ns(k, 0, &ns[0]);
+	nr[1] = kind_ns(k, 1, &ns[1]);
+	if (!nr[0] || !nr[1])
+		return;
+
+	if (nr[0] >= DIFF_MIN_SAMPLES && nr[1] >= DIFF_MIN_SAMPLES) {
+		p99(ns[0], nr[0], &lo[0], &hi[0]);
+		p99(ns[1], nr[1], &lo[1], &hi[1]);
+		if (lo[1] > hi[0])
+			k->shift |= SHIFT_P99_UP;
+		else if (hi[1] < lo[0])
+			k->shift |= SHIFT_P99_DOWN;
+	}
+
+	m = count_above(ns[1], nr[1], ns[0][nr[0] - 1]);
+	if (m && exceed_probability(m, nr[1], nr[0] + nr[1]) < DIFF_P)
+		k->shift |= SHIFT_MAX_UP;
+
+	m = count_above(ns[0], nr[0], ns[1][nr[1] - 1]);
+	if (m && exceed_probability(m, nr[0], nr[0] + nr[1]) < DIFF_P)
+		k->shift |= SHIFT_MAX_DOWN;
+}
+
+static int cmp_kind(const void *lhs, const void *rhs)
+{
+	const struct diff_kind *l = lhs;
+	const struct diff_kind *r = rhs;
+
+	return strcmp(l->key, r->key);
+}
+
+static void print_us(const unsigned long long *ns, int n, int p99_col)
+{
+	unsigned long long lo;
+	unsigned long long hi;
+
+	if (!n)
+		printf(" %8s", "-");
+	else if (p99_col)
+		printf(" %8llu", p99(ns, n, &lo, &hi) / 1000);
+	else
+		printf(" %8llu", ns[n - 1] / 1000);
+}
+
+static void print_shift(int shift)
+{
+	if (shift)
+		printf(" ");
+	if (shift & SHIFT_P99_UP)
+		printf(" p99+");
+	if (shift & SHIFT_P99_DOWN)
+		printf(" p99-");
+	if (shift & SHIFT_MAX_UP)
+		printf(" max+");
+	if (shift & SHIFT_MAX_DOWN)
+		printf(" max-");
+}
+
+static void print_hist(struct diff_kind *k)
+{
+	unsigned long hist[2][MAX_LOG2];
+	unsigned long long us;
+	unsigned long long *ns;
+	int side;
+	int nr;
+	int i;
+	int j;
+
+	memset(hist, 0, sizeof(hist));
+	for (side = 0; side < 2; side++) {
+		nr = kind_ns(k, side, &ns);
+		for (i = 0; i < nr; i++) {
+			us = ns[i] / 1000;
+			for (j = 0; us > 1 && j < MAX_LOG2 - 1; j++)
+				us >>= 1;
+			hist[side][j]++;
+		}
+	}
+
+	printf("%s duration:\n\n", k->key);
+	printf("  %19s %10s %10s\n", "us", "A", "B");
+	for (i = 0; i < MAX_LOG2; i++) {
+		if (!hist[0][i] && !hist[1][i])
+			continue;
+
+		printf("  %8lu - %-8lu %10lu %10lu\n", i ? 1UL << i : 0UL,
+		       (2UL << i) - 1, hist[0][i], hist[1][i]);
+	}
+	printf("\n");
+}
+
+static void print_only(struct diff *d, int side)
+{
+	struct diff_kind *k;
+	int n = 0;
+	int i;
+
+	for (i = 0; i < d->nr_kinds; i++) {
+		k = &d->kinds[i];
+		if (k->k[!side])
+			continue;
+
+		if (!n++)
+			printf("only in %s:", side ? "B" : "A");
+		printf("%s %s", n > 1 ? "," : "", k->key);
+	}
+	if (n)
+		printf("\n");
+}
+
+static int print_diff(struct diff *d)
+{
+	unsigned long long *ns[2];
+	struct diff_kind *k;
+	int regressions = 0;
+	int nr[2];
+	int side;
+	int i;
+
+	for (side = 0; side < 2; side++) {
+		for (i = 0; i < d->cap[side].nr_kinds; i++) {
+			if (add_kind(d, d->cap[side].kinds[i].key) != 0)
+				return -1;
+		}
+	}
+
+	for (i = 0; i < d->nr_kinds; i++)
+		judge_kind(&d->kinds[i]);
+	qsort(d->kinds, d->nr_kinds, sizeof(*d->kinds), cmp_kind);
+
+	printf("A: %s\nB: %s\n\n", d->path[0], d->path[1]);
+
+	printf("%-28s %8s %8s %8s %8s %8s %8s %6s %6s  %s\n", "sub-pattern",
+	       "n A", "n B", "p99 A", "p99 B", "max A", "max B", "sig A",
+	       "sig B", "shift");
+	for (i = 0; i < d->nr_kinds; i++) {
+		k = &d->kinds[i];
+		nr[0] = kind_ns(k, 0, &ns[0]);
+		nr[1] = kind_ns(k, 1, &ns[1]);
+
+		printf("%-28s %8d %8d", k->key, nr[0], nr[1]);
+		print_us(ns[0], nr[0], 1);
+		print_us(ns[1], nr[1], 1);
+		print_us(ns[0], nr[0], 0);
+		print_us(ns[1], nr[1], 0);
+		printf(" %6lu %6lu", kind_significant(k, 0),
+		       kind_significant(k, 1));
+		print_shift(k->shift);
+		printf("\n");
+
+		if (k->shift & (SHIFT_P99_UP | SHIFT_MAX_UP))
+			regressions++;
+	}
+	printf("\n");
+
+	print_only(d, 0);
+	print_only(d, 1);
+	printf("\n");
+
+	for (i = 0; i < d->nr_kinds; i++) {
+		if (d->kinds[i].shift)
+			print_hist(&d->kinds[i]);
+	}
+
+	printf("%d sub-pattern%s with a significant regression\n",
+	       regressions, regressions == 1 ? "" : "s");
+
+	return regressions;
+}
+
+static void diff_usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s diff [-p <pid>]... <A>[:<pid>,...]"
+		" <B>[:<pid>,...]\n"
+		"\n"
+		"  compare the sub-pattern durations of two traces or"
+		" event stores,\n"
+		"  analyzed with the -p tasks or the tasks listed after"
+		" the path\n", prog);
+}
+
+int diff_main(int argc, char *argv[], diff_analyze analyze)
+{
+	struct diff_capture dc[2];
+	pid_t capture_tasks[2][MAX_FOCUS_TASKS];
+	pid_t tasks[MAX_FOCUS_TASKS];
+	int capture_ntasks[2];
+	struct diff d;
+	int ntasks = 0;
+	int ret = 1;
+	int side;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+p:")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (ntasks >= MAX_FOCUS_TASKS) {
+				fprintf(stderr, "too many tasks (max %d)\n",
+					MAX_FOCUS_TASKS);
+				return 1;
+			}
+			tasks[ntasks++] = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			diff_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - optind != 2) {
+		diff_usage(argv[0]);
+		return 1;
+	}
+
+	memset(&d, 0, sizeof(d));
+	for (side = 0; side < 2; side++) {
+		memcpy(capture_tasks[side], tasks, sizeof(tasks));
+		capture_ntasks[side] = ntasks;
+		if (parse_capture(argv[optind + side], capture_tasks[side],
+				  &capture_ntasks[side]) != 0 ||
+		    !capture_ntasks[side]) {
+			diff_usage(argv[0]);
+			return 1;
+		}
+		d.path[side] = argv[optind + side];
+
+		dc[side].analyze = analyze;
+		dc[side].path = d.path[side];
+		dc[side].tasks = capture_tasks[side];
+		dc[side].ntasks = capture_ntasks[side];
+	}
+
+	for (side = 0; side < 2; side++) {
+		if (capture_run(analyze_capture, &dc[side],
+				&d.cap[side]) != 0) {
+			fprintf(stderr, "analysis of %s failed\n",
+				d.path[side]);
+			goto out;
+		}
+	}
+
+	ret = print_diff(&d);
+	ret = (ret < 0) ? 1 : (ret ? 2 : 0);
+out:
+	capture_free(&d.cap[0]);
+	capture_free(&d.cap[1]);
+	free(d.kinds);
+
+	return ret;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <sys/types.h>
+
+/* analyze a capture offline, the summary pattern collects the results */
+typedef int (*diff_analyze)(const char *path, const pid_t *tasks,
+			    int ntasks);
+
+extern int diff_main(int argc, char *argv[], diff_analyze analyze);
+
+#endif /* DIFF_H */
@@ -0,0 +1,646 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "event_store.h"
+#include "trace_event.h"
+#include "util.h"
+
+/*
+ * A compact columnar store of a parsed trace, so that repeated analysis
+ * runs on the same capture skip the text parsing. Every trace line is
+ * one event with an event name, a timestamp delta (in ns, zigzag
+ * varint encoded), the CPU, the pid, the comm and the fields. Event
+ * names and comms are interned in a string table. The fields are kept
+ * as text for the patterns, and the common events (sched_switch,
+ * sched_wakeup, sched_migrate_task, sys_enter, sys_exit) additionally
+ * have their typed fields (struct trace_event) in COL_VALUES, so that
+ * replaying skips parsing them. A <stack trace> frame is an event of
+ * its own (STORE_FRAME) holding the frame as its fields.
+ *
+ * The columns are written one after the other behind the header, each
+ * aligned to 8 bytes, and are mmapped for replaying.
+ */
+
+#define STORE_MAGIC "LCSTOR2"
+#define STORE_FRAME 0xffffffffU
+#define STORE_NO_FIELDS 0xffffffffU
+#define STACK_FRAME_STR " => "
+#define INTERN_INITIAL 1024
+
+enum store_column {
+	COL_EVENT = 0,
+	COL_TS,
+	COL_CPU,
+	COL_PID,
+	COL_COMM,
+	COL_FIELDS,
+	COL_TYPE,
+	COL_VALUES,
+	COL_STRINGS,
+	COL_TEXT,
+	NR_COLUMNS,
+};
+
+struct store_header {
+	char magic[8];
+	unsigned long long nr_events;
+	unsigned long long nr_strings;
+	unsigned long long offset[NR_COLUMNS];
+	unsigned long long size[NR_COLUMNS];
+};
+
+struct column {
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct event_store {
+	char *path;
+	struct column col[NR_COLUMNS];
+	unsigned long long nr_events;
+	unsigned long long last_ts;
+	int failed;
+
+	/* interned strings: offsets into COL_STRINGS, hashed by ids + 1 */
+	unsigned int *strings;
+	unsigned int nr_strings;
+	unsigned int *hash;
+	unsigned int hash_size;
+};
+
+static int column_append(struct event_store *es, enum store_column c,
+			 const void *data, size_t len)
+{
+	struct column *col = &es->col[c];
+	size_t size = col->size ? col->size : 4096;
+	unsigned char *buf;
+
+	while (col->len + len > size)
+		size *= 2;
+
+	if (size != col->size) {
+		buf = realloc(col->buf, size);
+		if (!buf) {
+			fprintf(stderr, "realloc failed: %s\n",
+				strerror(errno));
+			es->failed = 1;
+			return -1;
+		}
+		col->buf = buf;
+		col->size = size;
+	}
+
+	memcpy(col->buf + col->len, data, len);
+	col->len += len;
+
+	return 0;
+}
+
+static unsigned int hash_str(const char *str, size_t len)
+{
+	unsigned int h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static int intern_rehash(struct event_store *es)
+{
+	unsigned int size = es->hash_size ? es->hash_size * 2 :
+					    INTERN_INITIAL;
+	unsigned int *hash;
+	const char *str;
+	unsigned int h;
+	unsigned int i;
+
+	hash = calloc(size, sizeof(*hash));
+	if (!hash) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		es->failed = 1;
+		return -1;
+	}
+
+	for (i = 0; i < es->nr_strings; i++) {
+		str = (char *)es->col[COL_STRINGS].buf + es->strings[i];
+		for (h = hash_str(str, strlen(str)) & (size - 1); hash[h];
+		     h = (h + 1) & (size - 1)) {
+			;
+		}
+		hash[h] = i + 1;
+	}
+
+	free(es->hash);
+	es->hash = hash;
+	es->hash_size = size;
+
+	return 0;
+}
+
+/* get the id of a string of "len" characters, adding it if needed */
+static int intern(struct event_store *es, const char *str, size_t len,
+		  unsigned int *id)
+{
+	unsigned int *strings;
+	const char *s;
+	char nul = 0;
+	unsigned int h;
+
+	if (2 * (es->nr_strings + 1) > es->hash_size &&
+	    intern_rehash(es) != 0) {
+		return -1;
+	}
+
+	for (h = hash_str(str, len) & (es->hash_size - 1); es->hash[h];
+	     h = (h + 1) & (es->hash_size - 1)) {
+		s = (char *)es->col[COL_STRINGS].buf +
+		    es->strings[es->hash[h] - 1];
+		if (strncmp(s, str, len) == 0 && s[len] == 0) {
+			*id = es->hash[h] - 1;
+			return 0;
+		}
+	}
+
+	strings = array_grow(es->strings, es->nr_strings, sizeof(*strings));
+	if (!strings) {
+		es->failed = 1;
+		return -1;
+	}
+	es->strings = strings;
+	es->strings[es->nr_strings] = es->col[COL_STRINGS].len;
+
+	if (column_append(es, COL_STRINGS, str, len) != 0 ||
+	    column_append(es, COL_STRINGS, &nul, 1) != 0) {
+		return -1;
+	}
+
+	es->hash[h] = es->nr_strings + 1;
+	*id = es->nr_strings++;
+
+	return 0;
+}
+
+static int append_ts(struct event_store *es, unsigned long long ts)
+{
+	long long delta = (long long)(ts - es->last_ts);
+	unsigned long long zz;
+	unsigned char buf[10];
+	int n = 0;
+
+	/* zigzag: small negative deltas stay short */
+	zz = ((unsigned long long)delta << 1) ^
+	     (unsigned long long)(delta >> 63);
+	do {
+		buf[n] = zz & 0x7f;
+		zz >>= 7;
+		if (zz)
+			buf[n] |= 0x80;
+		n++;
+	} while (zz);
+
+	es->last_ts = ts;
+
+	return column_append(es, COL_TS, buf, n);
+}
+
+static int append_event(struct event_store *es, unsigned int event,
+			unsigned long long ts, unsigned short cpu,
+			unsigned int pid, unsigned int comm,
+			const char *fields, const struct trace_event *ev)
+{
+	unsigned int off = STORE_NO_FIELDS;
+	unsigned char type = ev->type;
+	char nul = 0;
+
+	if (fields) {
+		off = es->col[COL_TEXT].len;
+		if (column_append(es, COL_TEXT, fields,
+				  strcspn(fields, "\n")) != 0 ||
+		    column_append(es, COL_TEXT, &nul, 1) != 0) {
+			return -1;
+		}
+	}
+
+	if (column_append(es, COL_EVENT, &event, sizeof(event)) != 0 ||
+	    append_ts(es, ts) != 0 ||
+	    column_append(es, COL_CPU, &cpu, sizeof(cpu)) != 0 ||
+	    column_append(es, COL_PID, &pid, sizeof(pid)) != 0 ||
+	    column_append(es, COL_COMM, &comm, sizeof(comm)) != 0 ||
+	    column_append(es, COL_FIELDS, &off, sizeof(off)) != 0 ||
+	    column_append(es, COL_TYPE, &type, sizeof(type)) != 0) {
+		return -1;
+	}
+
+	if (ev->type != TEV_OTHER &&
+	    column_append(es, COL_VALUES, ev, sizeof(*ev)) != 0) {
+		return -1;
+	}
+
+	es->nr_events++;
+
+	return 0;
+}
+
+struct event_store *event_store_create(const char *path)
+{
+	struct event_store *es;
+	unsigned int id;
+
+	es = calloc(1, sizeof(*es));
+	if (!es) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	es->path = strdup(path);
+	if (!es->path) {
+		fprintf(stderr, "strdup failed: %s\n", strerror(errno));
+		free(es);
+		return NULL;
+	}
+
+	/* string 0 is the empty comm of stack frames */
+	intern(es, "", 0, &id);
+
+	return es;
+}
+
+/*
+ * Add a trace line to the store. Lines that cannot be parsed are
+ * skipped, as they are in the analysis.
+ */
+int event_store_add(struct event_store *es, const char *traceline)
+{
+	struct trace_event ev;
+	unsigned long long ts;
+	const char *fields;
+	const char *event;
+	const char *name;
+	unsigned int comm;
+	unsigned int id;
+	char taskname[16];
+	unsigned long cpu;
+	pid_t task;
+	char *p;
+
+	if (es->failed || traceline[0] == '#')
+		return -1;
+
+	if (strncmp(traceline, STACK_FRAME_STR,
+		    strlen(STACK_FRAME_STR)) == 0) {
+		memset(&ev, 0, sizeof(ev));
+		return append_event(es, STORE_FRAME, es->last_ts, 0, 0, 0,
+				    traceline + strlen(STACK_FRAME_STR), &ev);
+	}
+
+	/* parse task and CPU */
+	p = strstr(traceline, " [");
+	if (!p)
+		return -1;
+	cpu = strtoul(p + 2, NULL, 10);
+	while (*p != '-') {
+		if (p == traceline)
+			return -1;
+		p--;
+	}
+	task = strtoul(p + 1, NULL, 10);
+
+	/* the comm as the analysis sees it */
+	for (name = traceline; *name == ' '; name++)
+		;
+	snprintf(taskname, sizeof(taskname), "%s", name);
+	p = strchr(taskname, '-');
+	if (p)
+		*p = 0;
+
+	if (trace_ts(traceline, &ts) != 0)
+		return -1;
+
+	/* the event name follows the timestamp */
+	event = strstr(traceline, ": ") + 2;
+	fields = strstr(event, ": ");
+	trace_event_parse(event, &ev);
+
+	if (intern(es, event, fields ? (size_t)(fields - event) :
+			      strcspn(event, "\n"), &id) != 0 ||
+	    intern(es, taskname, strlen(taskname), &comm) != 0) {
+		return -1;
+	}
+
+	return append_event(es, id, ts, cpu, task, comm,
+			    fields ? fields + 2 : NULL, &ev);
+}
+
+static int write_padded(FILE *f, const void *data, size_t len,
+			unsigned long long *offset)
+{
+	static const char pad[8];
+
+	if (len && fwrite(data, len, 1, f) != 1)
+		return -1;
+	*offset += len;
+
+	len = (8 - *offset % 8) % 8;
+	if (len && fwrite(pad, len, 1, f) != 1)
+		return -1;
+	*offset += len;
+
+	return 0;
+}
+
+/* write the store and free it */
+int event_store_close(struct event_store *es)
+{
+	unsigned long long offset = sizeof(struct store_header);
+	struct store_header hdr;
+	int ret = -1;
+	FILE *f = NULL;
+	int i;
+
+	if (es->failed)
+		goto out;
+
+	f = fopen(es->path, "w");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, STORE_MAGIC);
+	hdr.nr_events = es->nr_events;
+	hdr.nr_strings = es->nr_strings;
+	for (i = 0; i < NR_COLUMNS; i++) {
+		hdr.offset[i] = offset;
+		hdr.size[i] = es->col[i].len;
+		offset += (es->col[i].len + 7) / 8 * 8;
+	}
+
+	offset = 0;
+	if (write_padded(f, &hdr, sizeof(hdr), &offset) != 0)
+		goto out;
+	for (i = 0; i < NR_COLUMNS; i++) {
+		if (write_padded(f, es->col[i].buf, es->col[i].len,
+				 &offset) != 0) {
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	if (f && fclose(f) != 0)
+		ret = -1;
+	if (ret != 0) {
+		if (f) {
+			fprintf(stderr, "writing %s failed\n", es->path);
+			remove(es->path);
+		}
+	}
+
+	for (i = 0; i < NR_COLUMNS; i++)
+		free(es->col[i].buf);
+	free(es->strings);
+	free(es->hash);
+	free(es->path);
+	free(es);
+
+	return ret;
+}
+
+int event_store_is_store(const char *path)
+{
+	char magic[8];
+	int ret = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	if (fread(magic, sizeof(magic), 1, f) == 1 &&
+	    memcmp(magic, STORE_MAGIC, sizeof(magic)) == 0) {
+		ret = 1;
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+/* append "str" to the line buffer, truncating like fgets() would */
+static char *line_append(char *p, const char *end, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (len > (size_t)(end - p))
+		len = end - p;
+	memcpy(p, str, len);
+
+	return p + len;
+}
+
+static void replay_events(const struct store_header *hdr,
+			  const unsigned char *base, const char **strings,
+			  unsigned long long from, unsigned long long to,
+			  event_store_handler handler)
+{
+	const unsigned int *events = (void *)(base + hdr->offset[COL_EVENT]);
+	const unsigned int *fields = (void *)(base + hdr->offset[COL_FIELDS]);
+	const unsigned short *cpus = (void *)(base + hdr->offset[COL_CPU]);
+	const unsigned int *comms = (void *)(base + hdr->offset[COL_COMM]);
+	const unsigned int *pids = (void *)(base + hdr->offset[COL_PID]);
+	const unsigned char *types = base + hdr->offset[COL_TYPE];
+	const struct trace_event *values = (void *)(base +
+						    hdr->offset[COL_VALUES]);
+	unsigned long long nr_values = hdr->size[COL_VALUES] /
+				       sizeof(*values);
+	const struct trace_event *ev;
+	struct trace_event other;
+	unsigned long long v = 0;
+	const unsigned char *tsp = base + hdr->offset[COL_TS];
+	const unsigned char *ts_end = tsp + hdr->size[COL_TS];
+	const char *text = (char *)base + hdr->offset[COL_TEXT];
+	unsigned long long ts = 0;
+	unsigned long long zz;
+	struct timespec tspec;
+	const char *comm;
+	char line[512];
+	char *end = line + sizeof(line) - 1;
+	unsigned long long i;
+	char *p;
+	int shift;
+
+	memset(&other, 0, sizeof(other));
+
+	for (i = 0; i < hdr->nr_events; i++) {
+		zz = 0;
+		shift = 0;
+		do {
+			if (tsp == ts_end)
+				return;
+			zz |= (unsigned long long)(*tsp & 0x7f) << shift;
+			shift += 7;
+		} while (*tsp++ & 0x80);
+		ts += (zz >> 1) ^ -(zz & 1);
+
+		/* without its typed fields, the event is parsed from text */
+		ev = &other;
+		if (types[i] != TEV_OTHER)
+			ev = v < nr_values ? &values[v++] : NULL;
+
+		if (from && ts < from)
+			continue;
+		if (to && ts > to)
+			break;
+
+		if (events[i] != STORE_FRAME && events[i] >= hdr->nr_strings)
+			continue;
+		if (fields[i] != STORE_NO_FIELDS &&
+		    fields[i] >= hdr->size[COL_TEXT]) {
+			continue;
+		}
+
+		/* the line as the sub-patterns see it */
+		p = line;
+		if (events[i] == STORE_FRAME) {
+			p = line_append(p, end, STACK_FRAME_STR);
+			comm = "";
+		} else {
+			p = line_append(p, end, ": ");
+			p = line_append(p, end, strings[events[i]]);
+			if (fields[i] != STORE_NO_FIELDS)
+				p = line_append(p, end, ": ");
+			comm = comms[i] < hdr->nr_strings ?
+			       strings[comms[i]] : "";
+		}
+		if (fields[i] != STORE_NO_FIELDS)
+			p = line_append(p, end, text + fields[i]);
+		p = line_append(p, end, "\n");
+		*p = 0;
+
+		tspec.tv_sec = ts / 1000000000ULL;
+		tspec.tv_nsec = ts % 1000000000ULL;
+
+		handler(line, ev, &tspec, cpus[i], pids[i], comm);
+	}
+}
+
+/*
+ * Feed the events of a store within [from, to] (in ns, 0 if unbounded)
+ * to "handler".
+ */
+int event_store_replay(const char *path, unsigned long long from,
+		       unsigned long long to, event_store_handler handler)
+{
+	const struct store_header *hdr;
+	const char **strings = NULL;
+	const unsigned char *base;
+	unsigned long long i;
+	struct stat st;
+	const char *s;
+	int ret = -1;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "open failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "fstat failed: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		fprintf(stderr, "%s: truncated event store\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+		return -1;
+	}
+	base = map;
+	hdr = map;
+
+	for (i = 0; i < NR_COLUMNS; i++) {
+		if (hdr->offset[i] % 8 || hdr->offset[i] + hdr->size[i] >
+					  (unsigned long long)st.st_size) {
+			break;
+		}
+	}
+	if (i < NR_COLUMNS ||
+	    memcmp(hdr->magic, STORE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->size[COL_EVENT] < hdr->nr_events * sizeof(unsigned int) ||
+	    hdr->size[COL_CPU] < hdr->nr_events * sizeof(unsigned short) ||
+	    hdr->size[COL_PID] < hdr->nr_events * sizeof(unsigned int) ||
+	    hdr->size[COL_COMM] < hdr->nr_events * sizeof(unsigned int) ||
+	    hdr->size[COL_FIELDS] < hdr->nr_events * sizeof(unsigned int) ||
+	    hdr->size[COL_TYPE] < hdr->nr_events ||
+	    (hdr->size[COL_TEXT] &&
+	     base[hdr->offset[COL_TEXT] + hdr->size[COL_TEXT] - 1] != 0)) {
+		fprintf(stderr, "%s: corrupt event store\n", path);
+		goto out;
+	}
+
+	strings = malloc((hdr->nr_strings + 1) * sizeof(*strings));
+	if (!strings) {
+		fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+		goto out;
+	}
+
+	s = (char *)base + hdr->offset[COL_STRINGS];
+	for (i = 0; i < hdr->nr_strings; i++) {
+		strings[i] = s;
+		s = memchr(s, 0, (char *)base + hdr->offset[COL_STRINGS] +
+				 hdr->size[COL_STRINGS] - s);
+		if (!s) {
+			fprintf(stderr, "%s: corrupt event store\n", path);
+			goto out;
+		}
+		s++;
+	}
+
+	replay_events(hdr, base, strings, from, to, handler);
+
+	ret = 0;
+out:
+	free(strings);
+	munmap(map, st.st_size);
+
+	return ret;
+}
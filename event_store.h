@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENT_STORE_H
+#define EVENT_STORE_H
+
+#include <time.h>
+#include <sys/types.h>
+
+struct event_store;
+struct trace_event;
+
+/*
+ * Called for every stored trace line, with its typed fields (NULL if
+ * they are to be parsed from the line). task and comm are 0/"" for
+ * frames.
+ */
+typedef int (*event_store_handler)(const char *traceline,
+				   const struct trace_event *ev,
+				   const struct timespec *ts, int cpu,
+				   pid_t task, const char *comm);
+
+extern struct event_store *event_store_create(const char *path);
+extern int event_store_add(struct event_store *es, const char *traceline);
+extern int event_store_close(struct event_store *es);
+extern int event_store_is_store(const char *path);
+extern int event_store_replay(const char *path, unsigned long long from,
+			      unsigned long long to,
+			      event_store_handler handler);
+
+#endif /* EVENT_STORE_H */
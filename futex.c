@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <linux/futex.h>
+#include "futex.h"
+
+static const char *futex_cmd[] = {
+	"FUTEX_WAIT",
+	"FUTEX_WAKE",
+	"FUTEX_FD",
+	"FUTEX_REQUEUE",
+	"FUTEX_CMP_REQUEUE",
+	"FUTEX_WAKE_OP",
+	"FUTEX_LOCK_PI",
+	"FUTEX_UNLOCK_PI",
+	"FUTEX_TRYLOCK_PI",
+	"FUTEX_WAIT_BITSET",
+	"FUTEX_WAKE_BITSET",
+	"FUTEX_WAIT_REQUEUE_PI",
+	"FUTEX_CMP_REQUEUE_PI"
+};
+
+const char *futex_cmd_name(unsigned int cmd)
+{
+	if (cmd >= sizeof(futex_cmd) / sizeof(futex_cmd[0]))
+		return NULL;
+
+	return futex_cmd[cmd];
+}
+
+/*
+ * Parse the futex address and command from the (hex) arguments of a
+ * raw_syscalls sys_enter trace line, e.g.:
+ *
+ *   sys_enter: NR 240 (8049a40, 86, 0, 0, 0, 0)
+ *
+ * The private and clock flags are masked out of the command.
+ */
+int futex_parse_args(const char *traceline, unsigned long *uaddr,
+		     unsigned int *cmd)
+{
+	char *p;
+
+	p = strstr(traceline, " (");
+	if (!p)
+		return -1;
+	*uaddr = strtoul(p + 2, &p, 16);
+
+	if (strncmp(p, ", ", 2) != 0)
+		return -1;
+	*cmd = strtoul(p + 2, NULL, 16) & FUTEX_CMD_MASK;
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+/* the futex syscall number (see syscalls.txt) */
+#define NR_FUTEX 240
+
+extern const char *futex_cmd_name(unsigned int cmd);
+extern int futex_parse_args(const char *traceline, unsigned long *uaddr,
+			    unsigned int *cmd);
+
+#endif /* FUTEX_H */
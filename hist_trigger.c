@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "util.h"
+#include "tracefs.h"
+#include "hist_trigger.h"
+
+/*
+ * Let the kernel compute the sched_latency (wakeup to sched_switch)
+ * durations of the focus tasks using hist triggers and a synthetic
+ * event. The kernel aggregates the latencies in a histogram, so no
+ * events need to be shipped to user space. When a latency exceeds the
+ * threshold, a snapshot of the trace buffer is taken, which can then
+ * be analyzed in full.
+ *
+ * Synthetic events are global, so the event is named after the pid of
+ * latcheck. Events of latcheck runs that are gone (e.g. crashed) are
+ * removed before the event is created.
+ */
+
+#define SYNTH_PREFIX "latcheck_wakeup_latency_"
+
+#define MAX_LOG2 32
+
+static unsigned long hist_threshold;
+static char synth_name[64];
+
+/* the path of a file of the synthetic event */
+static void synth_path(char *path, size_t size, const char *file)
+{
+	snprintf(path, size, "events/synthetic/%s/%s", synth_name, file);
+}
+
+/* remove the synthetic events of latcheck runs that are gone */
+static void remove_stale(const char *rootpath)
+{
+	char path[MAXPATHLEN];
+	char name[64];
+	char line[256];
+	unsigned long pid;
+	FILE *f;
+
+	tracefs_file(path, sizeof(path), rootpath, "synthetic_events");
+	f = fopen(path, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) != 0)
+			continue;
+
+		pid = strtoul(line + strlen(SYNTH_PREFIX), NULL, 10);
+		if (kill(pid, 0) == 0 || errno != ESRCH)
+			continue;
+
+		snprintf(name, sizeof(name), "!%.*s\n",
+			 (int)strcspn(line, " \n"), line);
+		if (set_tracing(rootpath, "synthetic_events", name) != 0)
+			fprintf(stderr, "failed to remove the stale synthetic"
+				" event %s", name + 1);
+	}
+
+	fclose(f);
+}
+
+static int append_task_filter(char *buf, size_t size, const char *field,
+			      const pid_t *tasks, int ntasks)
+{
+	size_t len = strlen(buf);
+
+	if (len + 4 >= size)
+		return -1;
+	strcpy(buf + len, " if ");
+	len += 4;
+
+	return filter_add_pids(buf + len, size - len, field, tasks, ntasks);
+}
+
+int hist_trigger_enable(const char *rootpath, const char *tracingpath,
+			const pid_t *tasks, int ntasks,
+			unsigned long threshold)
+{
+	char trigger[FILTER_MAX + 256];
+	char path[MAXPATHLEN];
+	int ret = 0;
+
+	hist_threshold = threshold;
+
+	remove_stale(rootpath);
+
+	snprintf(synth_name, sizeof(synth_name), SYNTH_PREFIX "%u", getpid());
+	snprintf(trigger, sizeof(trigger), "%s pid_t pid; u64 lat\n",
+		 synth_name);
+	ret |= set_tracing(rootpath, "synthetic_events", trigger);
+	if (ret) {
+		synth_name[0] = 0;
+		return ret;
+	}
+
+	/* remember when the focus tasks are woken */
+	strcpy(trigger, "hist:keys=pid:ts0=common_timestamp.usecs");
+	ret |= append_task_filter(trigger, sizeof(trigger), "pid",
+				  tasks, ntasks);
+	ret |= set_tracing(tracingpath, "events/sched/sched_wakeup/trigger",
+			   trigger);
+
+	/* generate the latency event when they are switched in */
+	snprintf(trigger, sizeof(trigger), "hist:keys=next_pid:"
+		 "lat=common_timestamp.usecs-$ts0:"
+		 "onmatch(sched.sched_wakeup).%s(next_pid,$lat)", synth_name);
+	ret |= append_task_filter(trigger, sizeof(trigger), "next_pid",
+				  tasks, ntasks);
+	ret |= set_tracing(tracingpath, "events/sched/sched_switch/trigger",
+			   trigger);
+
+	/* aggregate the latencies ... */
+	synth_path(path, sizeof(path), "trigger");
+	ret |= set_tracing(tracingpath, path,
+			   "hist:keys=pid,lat:sort=pid,lat:size=8192\n");
+
+	/* ... and capture the full trace on the first violation */
+	snprintf(trigger, sizeof(trigger), "snapshot:1 if lat > %lu\n",
+		 threshold);
+	ret |= set_tracing(tracingpath, path, trigger);
+
+	return ret;
+}
+
+struct task_hist {
+	pid_t pid;
+	unsigned long long samples;
+	unsigned long long over;
+	unsigned long min;
+	unsigned long max;
+	unsigned long long log2[MAX_LOG2];
+};
+
+static int log2_bucket(unsigned long val)
+{
+	int i = 0;
+
+	while (val > 1 && i < MAX_LOG2 - 1) {
+		val >>= 1;
+		i++;
+	}
+
+	return i;
+}
+
+static int parse_key(const char *line, const char *key, unsigned long *val)
+{
+	char *p;
+
+	p = strstr(line, key);
+	if (!p)
+		return -1;
+	p += strlen(key);
+
+	*val = strtoul(p, NULL, 10);
+
+	return 0;
+}
+
+static void print_task_hist(struct task_hist *th)
+{
+	unsigned long long width;
+	int i;
+	int j;
+
+	printf("task %u: %llu samples, min %lu us, max %lu us,"
+	       " %llu over %lu us\n", th->pid, th->samples, th->min,
+	       th->max, th->over, hist_threshold);
+
+	for (i = 0; i < MAX_LOG2; i++) {
+		if (!th->log2[i])
+			continue;
+
+		printf("  %8lu - %-8lu us %10llu ", i ? 1UL << i : 0UL,
+		       (2UL << i) - 1, th->log2[i]);
+
+		width = th->log2[i] * 40 / th->samples;
+		for (j = 0; j < (int)width; j++)
+			printf("#");
+		printf("\n");
+	}
+}
+
+/*
+ * Read back the in-kernel histogram and print it per focus task.
+ * Returns the number of latencies over the threshold.
+ */
+unsigned long hist_trigger_report(const char *tracingpath)
+{
+	struct task_hist *ths = NULL;
+	struct task_hist *th = NULL;
+	unsigned long over = 0;
+	unsigned long hitcount;
+	unsigned long pid;
+	char path[MAXPATHLEN];
+	unsigned long lat;
+	char line[256];
+	int nr_ths = 0;
+	FILE *f;
+	int i;
+
+	synth_path(path, sizeof(path), "hist");
+	tracefs_file(line, sizeof(line), tracingpath, path);
+	f = fopen(line, "r");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] != '{')
+			continue;
+
+		if (parse_key(line, "pid:", &pid) != 0 ||
+		    parse_key(line, "lat:", &lat) != 0 ||
+		    parse_key(line, "hitcount:", &hitcount) != 0) {
+			continue;
+		}
+
+		if (!th || th->pid != (pid_t)pid) {
+			th = array_grow(ths, nr_ths, sizeof(*th));
+			if (!th)
+				break;
+			ths = th;
+			th = &ths[nr_ths++];
+			memset(th, 0, sizeof(*th));
+			th->pid = pid;
+			th->min = lat;
+		}
+
+		/* sorted by latency */
+		th->max = lat;
+		th->samples += hitcount;
+		th->log2[log2_bucket(lat)] += hitcount;
+		if (lat > hist_threshold) {
+			th->over += hitcount;
+			over += hitcount;
+		}
+	}
+
+	fclose(f);
+
+	printf("wakeup latency histogram (in-kernel):\n\n");
+	for (i = 0; i < nr_ths; i++)
+		print_task_hist(&ths[i]);
+	if (!nr_ths)
+		printf("no wakeups of the focus tasks\n");
+	printf("\n");
+
+	free(ths);
+
+	return over;
+}
+
+/*
+ * The triggers are removed together with the tracing instance. The
+ * synthetic event is global and can only be removed afterwards.
+ */
+void hist_trigger_disable(const char *rootpath)
+{
+	char name[80];
+
+	if (!synth_name[0])
+		return;
+
+	snprintf(name, sizeof(name), "!%s\n", synth_name);
+	set_tracing(rootpath, "synthetic_events", name);
+	synth_name[0] = 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HIST_TRIGGER_H
+#define HIST_TRIGGER_H
+
+#include <sys/types.h>
+
+extern int hist_trigger_enable(const char *rootpath, const char *tracingpath,
+			       const pid_t *tasks, int ntasks,
+			       unsigned long threshold);
+extern unsigned long hist_trigger_report(const char *tracingpath);
+extern void hist_trigger_disable(const char *rootpath);
+
+#endif /* HIST_TRIGGER_H */
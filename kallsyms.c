@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "kallsyms.h"
+#include "util.h"
+
+/*
+ * Kernel text symbols, loaded once on first use and sorted by address
+ * so that addresses can be resolved with a binary search. If the
+ * addresses are hidden (kptr_restrict), nothing can be resolved.
+ * Several analysis contexts may resolve at once, the lock makes sure
+ * that the table is complete before anyone searches it.
+ */
+
+struct ksym {
+	unsigned long long addr;
+	char *name;
+};
+
+static const char *ksyms_path = KALLSYMS_PATH;
+static struct ksym *ksyms;
+static int nr_ksyms;
+static int loaded;
+static pthread_mutex_t ksyms_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void kallsyms_set_path(const char *path)
+{
+	kallsyms_free();
+	ksyms_path = path;
+}
+
+static int cmp_ksym(const void *a, const void *b)
+{
+	const struct ksym *ka = a;
+	const struct ksym *kb = b;
+
+	if (ka->addr < kb->addr)
+		return -1;
+	return (ka->addr > kb->addr);
+}
+
+static void load_kallsyms(void)
+{
+	unsigned long long addr;
+	struct ksym *p;
+	char name[128];
+	char line[256];
+	char type;
+	FILE *f;
+
+	loaded = 1;
+
+	f = fopen(ksyms_path, "r");
+	if (!f) {
+		fprintf(stderr, "failed to open %s: %s\n", ksyms_path,
+			strerror(errno));
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%llx %c %127s", &addr, &type, name) != 3)
+			continue;
+
+		/* only text symbols can be callers */
+		if (type != 't' && type != 'T')
+			continue;
+		if (addr == 0)
+			continue;
+
+		p = array_grow(ksyms, nr_ksyms, sizeof(*ksyms));
+		if (!p)
+			break;
+		ksyms = p;
+
+		ksyms[nr_ksyms].name = strdup(name);
+		if (!ksyms[nr_ksyms].name)
+			break;
+		ksyms[nr_ksyms].addr = addr;
+		nr_ksyms++;
+	}
+
+	fclose(f);
+
+	qsort(ksyms, nr_ksyms, sizeof(*ksyms), cmp_ksym);
+}
+
+/* write "symbol+0xoffset" of a kernel address, -1 if unknown */
+int kallsyms_resolve(unsigned long long addr, char *buf, size_t size)
+{
+	int lo = 0;
+	int hi;
+	int mid;
+
+	pthread_mutex_lock(&ksyms_lock);
+	if (!loaded)
+		load_kallsyms();
+	pthread_mutex_unlock(&ksyms_lock);
+
+	/* find the last symbol at or below the address */
+	hi = nr_ksyms - 1;
+	if (hi < 0 || addr < ksyms[0].addr)
+		return -1;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (ksyms[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	snprintf(buf, size, "%s+0x%llx", ksyms[lo].name,
+		 addr - ksyms[lo].addr);
+
+	return 0;
+}
+
+void kallsyms_free(void)
+{
+	int i;
+
+	pthread_mutex_lock(&ksyms_lock);
+	for (i = 0; i < nr_ksyms; i++)
+		free(ksyms[i].name);
+	free(ksyms);
+	ksyms = NULL;
+	nr_ksyms = 0;
+	loaded = 0;
+	pthread_mutex_unlock(&ksyms_lock);
+}
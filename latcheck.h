@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATCHECK_H
+#define LATCHECK_H
+
+/*
+ * The analysis engine of latcheck as a library (liblatcheck.a/.so) for
+ * programs that read the trace events themselves, e.g. a monitoring
+ * agent. Each context is an independent analysis of a set of focus
+ * tasks; a context may only be used by one thread at a time, but
+ * several contexts may be used by several threads concurrently.
+ *
+ *   struct latcheck_config cfg = { tasks, 1 };
+ *   struct latcheck *lc;
+ *
+ *   cfg.flags = LATCHECK_QUIET;
+ *   cfg.significant = on_significant;
+ *   lc = latcheck_new(&cfg);
+ *   latcheck_enable(lc, "/sys/kernel/tracing/instances/agent");
+ *   while (...)
+ *           latcheck_push_event(lc, &ev);
+ *   latcheck_finish(lc);
+ *   latcheck_free(lc);
+ *
+ * Events are pushed either as trace lines (as read from trace or
+ * trace_pipe) or parsed; both must be pushed in timestamp order.
+ * All settings, e.g. the budgets (-b), are per context. The config is
+ * only read by latcheck_new() and need not outlive it.
+ */
+
+#include <sys/types.h>
+
+/* liblatcheck.so only exports the functions of this interface */
+#ifdef __GNUC__
+#define LATCHECK_API __attribute__((visibility("default")))
+#else
+#define LATCHECK_API
+#endif
+
+/* latcheck_config flags */
+#define LATCHECK_STACKTRACE    0x1
+#define LATCHECK_WINDOWED      0x2
+#define LATCHECK_QUIET         0x4
+/* the opt-in patterns of --runqueue and --critical-path */
+#define LATCHECK_RUNQUEUE      0x8
+#define LATCHECK_CRITICAL_PATH 0x10
+
+/* at most this many budgets are checked */
+#define LATCHECK_MAX_BUDGETS 16
+
+/* a closed sub-pattern, valid during the callback */
+struct latcheck_instance {
+	const char *name;
+	const char *taskname;
+	pid_t task;
+	int cpu;
+	unsigned long long begin_ns;
+	unsigned long long end_ns;
+};
+
+/* called for every closed sub-pattern while events are pushed */
+typedef void (*latcheck_closed_fn)(const struct latcheck_instance *inst,
+				   void *arg);
+
+/* called by latcheck_finish() for every significant sub-pattern */
+typedef void (*latcheck_significant_fn)(const struct latcheck_instance *inst,
+					pid_t focus_task, void *arg);
+
+/*
+ * The latency budget of a sub-pattern (-b), or of all sub-patterns
+ * starting with its name if it ends with '*' (e.g. "sched_out_*").
+ */
+struct latcheck_budget {
+	const char *name;
+	unsigned long us;
+};
+
+struct latcheck_config {
+	const pid_t *tasks;
+	int ntasks;
+	int flags;
+
+	/* 0 for the defaults of the latcheck command */
+	unsigned long window_us;
+	unsigned long max_instances;
+	unsigned long overhead_ns;
+
+	const struct latcheck_budget *budgets;
+	int nr_budgets;
+
+	/* of cyclic tasks (--period, --jitter), 0 to detect and derive */
+	unsigned long period_us;
+	unsigned long jitter_us;
+
+	/* e.g. "0,2-3", the CPUs to trace the preemptirq events of (-C) */
+	const char *preemptirq_cpus;
+
+	/* write a summary instead of the reports (see capture.c), 0 if not */
+	int summary_fd;
+
+	latcheck_closed_fn closed;
+	latcheck_significant_fn significant;
+	void *arg;
+};
+
+/*
+ * A parsed trace event, e.g. name "sched_switch" and its fields.
+ * latcheck_push_event() refuses (-1) a comm of more than 15 characters
+ * and a name and fields that do not fit a trace line of 512 characters.
+ */
+struct latcheck_event {
+	unsigned long long ts_ns;
+	int cpu;
+	pid_t pid;
+	const char *comm;
+	const char *name;
+	const char *fields;
+};
+
+struct latcheck;
+
+extern LATCHECK_API struct latcheck *
+latcheck_new(const struct latcheck_config *cfg);
+extern LATCHECK_API void latcheck_enable(struct latcheck *lc,
+					 const char *tracingpath);
+extern LATCHECK_API int latcheck_push_line(struct latcheck *lc,
+					   const char *traceline);
+extern LATCHECK_API int latcheck_push_event(struct latcheck *lc,
+					    const struct latcheck_event *ev);
+extern LATCHECK_API void latcheck_finish(struct latcheck *lc);
+extern LATCHECK_API void latcheck_free(struct latcheck *lc);
+
+#endif /* LATCHECK_H */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATCHECK_MARKER_H
+#define LATCHECK_MARKER_H
+
+/*
+ * Annotations of a traced application for latcheck. latcheck passes
+ * the trace_marker of its tracing instance in the environment variable
+ * LATCHECK_TRACE_MARKER. latcheck_marker_open() opens it once, before
+ * the time critical part of the application; every marker then costs
+ * a single write() of a constant string. Without latcheck the markers
+ * do nothing.
+ *
+ * All translation units of the application share one file descriptor,
+ * defined in exactly one of them with LATCHECK_MARKER_DEFINE:
+ *
+ *   LATCHECK_MARKER_DEFINE;
+ *   ...
+ *   latcheck_marker_open();
+ *   ...
+ *   LATCHECK_IN("transaction");
+ *   ...
+ *   LATCHECK_OUT("transaction");
+ *
+ * Section names must be string literals without spaces.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LATCHECK_TRACE_MARKER_ENV "LATCHECK_TRACE_MARKER"
+
+extern int latcheck_marker_fd;
+
+#define LATCHECK_MARKER_DEFINE int latcheck_marker_fd = -1
+
+static __inline__ void latcheck_marker_open(void)
+{
+	const char *path = getenv(LATCHECK_TRACE_MARKER_ENV);
+
+	if (path && latcheck_marker_fd < 0)
+		latcheck_marker_fd = open(path, O_WRONLY);
+}
+
+static __inline__ void latcheck_marker_close(void)
+{
+	if (latcheck_marker_fd >= 0)
+		close(latcheck_marker_fd);
+	latcheck_marker_fd = -1;
+}
+
+static __inline__ void latcheck_marker(const char *str, size_t len)
+{
+	ssize_t ret;
+
+	if (latcheck_marker_fd < 0)
+		return;
+
+	ret = write(latcheck_marker_fd, str, len);
+	(void)ret;
+}
+
+#define LATCHECK_MARKER(str) latcheck_marker(str, sizeof(str) - 1)
+
+/* an application defined sub-pattern */
+#define LATCHECK_IN(name) LATCHECK_MARKER("latcheck:in " name)
+#define LATCHECK_OUT(name) LATCHECK_MARKER("latcheck:out " name)
+
+/* the beginning of a cycle of a periodic task */
+#define LATCHECK_CYCLE() LATCHECK_MARKER("latcheck:cycle")
+
+/* entering and leaving the real-time phase */
+#define LATCHECK_RT() LATCHECK_MARKER("latcheck:rt")
+#define LATCHECK_NRT() LATCHECK_MARKER("latcheck:nrt")
+
+#endif /* LATCHECK_MARKER_H */
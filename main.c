@@ -22,114 +22,1254 @@
 #include <unistd.h>
 #include <sched.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
 #include <mcheck.h>
 #include <sys/param.h>
-#include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include "latcheck.h"
+#include "subpattern.h"
+#include "calibrate.h"
+#include "capture.h"
+#include "diff.h"
+#include "event_store.h"
+#include "hist_trigger.h"
+#include "kallsyms.h"
+#include "manifest.h"
+#include "runs.h"
+#include "stats.h"
+#include "trace_event.h"
+#include "trace_index.h"
+#include "tracefs.h"
+#include "util.h"
+#include "patterns/patterns.h"
+#include "subpatterns/subpatterns.h"
 
-void subpattern_init(const char *tracingpath, pid_t task);
+#define OPT_STATS 0x100
+#define OPT_CALIBRATE 0x101
+#define OPT_FROM 0x102
+#define OPT_TO 0x103
+#define OPT_LEAD_IN 0x104
+#define OPT_STORE 0x105
+#define OPT_KALLSYMS 0x106
+#define OPT_PERIOD 0x107
+#define OPT_JITTER 0x108
+#define OPT_RUNS 0x109
+#define OPT_MANIFEST 0x10a
+#define OPT_SPLIT 0x10b
+#define OPT_INDEX 0x10c
+#define OPT_RUNQUEUE 0x10d
+#define OPT_CRITICAL_PATH 0x10e
+
+/* daemon defaults */
+#define DAEMON_BUFFER_KB 1024
+#define DAEMON_POLL_NS 100000000L
+
+/* the trace_marker of the tracing instance, passed to the command */
+#define TRACE_MARKER_ENV "LATCHECK_TRACE_MARKER"
+
+/* default lead-in/lead-out around --from/--to */
+#define LEAD_IN_US 1000000UL
+
+/* traces analyzed as runs of one command (-i given repeatedly) */
+#define MAX_INPUTS 64
+
+void subpattern_init(const char *tracingpath, const pid_t *tasks, int ntasks,
+		     int flags);
+void subpattern_enable(const char *tracingpath, const pid_t *tasks,
+		       int ntasks, int flags);
 int subpattern_handle_traceline(const char *traceline);
+int subpattern_handle_event(const char *traceline,
+			    const struct trace_event *ev,
+			    const struct timespec *ts, int cpu, pid_t task,
+			    const char *taskname);
+void subpattern_set_window(unsigned long window_us, unsigned long max_inst);
+void subpattern_set_overhead(unsigned long ns);
+struct latcheck_config *subpattern_defaults(void);
+void subpattern_set_range(unsigned long long begin, unsigned long long end);
 void subpattern_cleanup(void);
 
-int main(int argc, char *argv[])
+static volatile sig_atomic_t stop;
+static int stats_json;
+
+/* --from/--to of an offline trace in ns, 0 if unbounded */
+static unsigned long long from_ns;
+static unsigned long long to_ns;
+static unsigned long long lead_ns = LEAD_IN_US * 1000ULL;
+/* --index: keep the index of the trace in <trace>.idx */
+static int save_index;
+
+/* --store: event store written from the text trace */
+static const char *store_path;
+
+static struct option long_options[] = {
+	{ "stats", optional_argument, NULL, OPT_STATS },
+	{ "calibrate", no_argument, NULL, OPT_CALIBRATE },
+	{ "from", required_argument, NULL, OPT_FROM },
+	{ "to", required_argument, NULL, OPT_TO },
+	{ "lead-in", required_argument, NULL, OPT_LEAD_IN },
+	{ "index", no_argument, NULL, OPT_INDEX },
+	{ "store", required_argument, NULL, OPT_STORE },
+	{ "kallsyms", required_argument, NULL, OPT_KALLSYMS },
+	{ "period", required_argument, NULL, OPT_PERIOD },
+	{ "jitter", required_argument, NULL, OPT_JITTER },
+	{ "runs", required_argument, NULL, OPT_RUNS },
+	{ "manifest", required_argument, NULL, OPT_MANIFEST },
+	{ "split-instances", no_argument, NULL, OPT_SPLIT },
+	{ "runqueue", no_argument, NULL, OPT_RUNQUEUE },
+	{ "critical-path", no_argument, NULL, OPT_CRITICAL_PATH },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void usage(const char *prog)
 {
-	char tracingpath[256];
+	fprintf(stderr, "usage: %s [-s] [-u] [-H <us>] [-p <pid>]... <command> <arg>...\n"
+		"       %s --runs <n> [-s] [-u] [-p <pid>]... <command>"
+		" <arg>...\n"
+		"       %s --manifest <file> [--split-instances] [--runs <n>]"
+		" [-p <pid>]...\n"
+		"       %s -i <trace> [--from <s>] [--to <s>] -p <pid>"
+		" [-p <pid>]...\n"
+		"       %s -i <trace> -i <trace> [-i <trace>]... -p <pid>"
+		" [-p <pid>]...\n"
+		"       %s -D -b <budget> [-B <kb>] -p <pid> [-p <pid>]...\n"
+		"       %s --calibrate [-s]\n"
+		"       %s diff [-p <pid>]... <A>[:<pid>,...]"
+		" <B>[:<pid>,...]\n"
+		"       %s merge <trace> <trace>...\n"
+		"\n"
+		"  -T <path>   tracefs root (default: " TRACEFS_PATH " if\n"
+		"              mounted, else " DEBUGFS_TRACING_PATH ")\n"
+		"  -p <pid>    also trace and analyze task <pid>\n"
+		"  -i <trace>  analyze a previously recorded trace (text or"
+		" event store),\n"
+		"              given repeatedly: the traces of several runs"
+		" (as --runs)\n"
+		"  --store <file>\n"
+		"              also save the trace as event store <file>"
+		" for faster\n"
+		"              repeated analysis with -i (with --runs:"
+		" of the worst\n"
+		"              run)\n"
+		"  --runs <n>  run the command <n> times, print the worst"
+		" run and how\n"
+		"              often sub-patterns were significant\n"
+		"  --manifest <file>\n"
+		"              run and analyze the commands of <file>"
+		" together, one\n"
+		"              per line: [cpus=<list>] [prio=<n>]"
+		" [nice=<n>] [nofocus]\n"
+		"              <command> <arg>...\n"
+		"  --split-instances\n"
+		"              trace each focus task in its own tracing"
+		" instance\n"
+		"  --from <s>, --to <s>\n"
+		"              only analyze the trace from/to a timestamp"
+		" (in s)\n"
+		"  --lead-in <us>\n"
+		"              trace read before --from and after --to"
+		" (default %lu)\n"
+		"  --index     keep the index of the trace for --from in"
+		" <trace>.idx\n"
+		"  -u          do not pin the command to CPU0\n"
+		"  --runqueue  attribute the waits of focus tasks to the"
+		" CPUs and the\n"
+		"              tasks they waited behind (traces all"
+		" sched_switch events)\n"
+		"  --critical-path\n"
+		"              blame the off-CPU time of focus tasks on"
+		" their wakers\n"
+		"              (traces all wakeups, switches and"
+		" interrupts)\n"
+		"  -C <cpus>   trace preemption- and IRQ-disabled sections"
+		" on <cpus>\n"
+		"              (e.g. 0,2-3)\n"
+		"  --kallsyms <file>\n"
+		"              resolve caller addresses with <file>"
+		" (default\n"
+		"              " KALLSYMS_PATH ")\n"
+		"  -s          record kernel stacks when focus tasks are"
+		" scheduled out\n"
+		"  -H <us>     aggregate wakeup latencies in the kernel and"
+		" only analyze\n"
+		"              the trace if a latency exceeds <us>\n"
+		"  -D          run as flight recorder until SIGTERM/SIGINT\n"
+		"  -b <name>=<us>\n"
+		"              latency budget of sub-pattern <name> ('*'"
+		" suffix matches\n"
+		"              a prefix)\n"
+		"  --period <us>\n"
+		"              period of cyclic focus tasks (default:"
+		" detected)\n"
+		"  --jitter <us>\n"
+		"              wakeup jitter of outlier cycles (default:"
+		" 10%% of the\n"
+		"              period)\n"
+		"  -w          only print the windows around budget"
+		" violations\n"
+		"              and outlier cycles\n"
+		"  -W <us>     history kept around violations (default"
+		" 10000)\n"
+		"  -M <n>      keep at most <n> sub-pattern instances"
+		" (default 100000)\n"
+		"  -B <kb>     per-CPU ring buffer size in daemon mode"
+		" (default %d)\n"
+		"  -O <ns>     tracing overhead per event (see --calibrate),"
+		" shown with\n"
+		"              durations and budget violations\n"
+		"  --calibrate measure the tracing overhead per event\n"
+		"  --stats[=text|json]\n"
+		"              print statistics of latcheck itself to"
+		" stderr\n",
+		prog, prog, prog, prog, prog, prog, prog, prog, prog,
+		LEAD_IN_US,
+		DAEMON_BUFFER_KB);
+}
+
+static unsigned long long parse_seconds(const char *str)
+{
+	return strtod(str, NULL) * 1000000000.0;
+}
+
+static struct latcheck_budget budgets[LATCHECK_MAX_BUDGETS];
+static char budget_names[LATCHECK_MAX_BUDGETS][32];
+static int nr_budgets;
+
+/* parse and add a "<sub-pattern>=<us>" budget */
+static int add_budget(const char *spec)
+{
+	struct latcheck_config *cfg = subpattern_defaults();
+	const char *p;
+	char *name;
+	char *end;
+
+	if (nr_budgets >= LATCHECK_MAX_BUDGETS) {
+		fprintf(stderr, "too many budgets (max %d)\n",
+			LATCHECK_MAX_BUDGETS);
+		return -1;
+	}
+
+	p = strchr(spec, '=');
+	if (!p || p == spec ||
+	    (size_t)(p - spec) >= sizeof(budget_names[0])) {
+		fprintf(stderr, "invalid budget: %s\n", spec);
+		return -1;
+	}
+
+	name = budget_names[nr_budgets];
+	snprintf(name, sizeof(budget_names[0]), "%.*s", (int)(p - spec), spec);
+	budgets[nr_budgets].name = name;
+	budgets[nr_budgets].us = strtoul(p + 1, &end, 10);
+	if (*end || end == p + 1) {
+		fprintf(stderr, "invalid budget: %s\n", spec);
+		return -1;
+	}
+
+	nr_budgets++;
+	cfg->budgets = budgets;
+	cfg->nr_budgets = nr_budgets;
+
+	return 0;
+}
+
+static int process_trace(const char *path)
+{
+	unsigned long long start_ns = 0;
+	struct event_store *es = NULL;
+	unsigned long long stop_ns = 0;
+	unsigned long long ts;
 	char line[512];
-	int pipefd[2];
-	pid_t task;
+	long offset;
+	int ret = 0;
 	FILE *f;
 
-	mtrace();
+	if (from_ns > lead_ns)
+		start_ns = from_ns - lead_ns;
+	if (to_ns)
+		stop_ns = to_ns + lead_ns;
 
-	if (argc < 2) {
-		fprintf(stderr, "usage: %s <command> <arg>...\n", argv[0]);
+	if (event_store_is_store(path)) {
+		if (store_path) {
+			fprintf(stderr, "%s is already an event store\n",
+				path);
+			return 1;
+		}
+		if (event_store_replay(path, start_ns, stop_ns,
+				       subpattern_handle_event) != 0) {
+			return 1;
+		}
+		return 0;
+	}
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
 		return 1;
 	}
 
-	if (pipe(pipefd) != 0) {
-		fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+	/* seek to the lead-in before --from */
+	if (from_ns) {
+		if (trace_index_seek(path, start_ns, save_index,
+				     &offset) != 0 ||
+		    fseek(f, offset, SEEK_SET) != 0) {
+			fclose(f);
+			return 1;
+		}
+	}
+
+	if (store_path) {
+		es = event_store_create(store_path);
+		if (!es) {
+			fclose(f);
+			return 1;
+		}
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if ((start_ns || stop_ns) && trace_ts(line, &ts) == 0) {
+			if (ts < start_ns)
+				continue;
+			if (stop_ns && ts > stop_ns)
+				break;
+		}
+		if (es)
+			event_store_add(es, line);
+		if (subpattern_handle_traceline(line) != 0)
+			fprintf(stderr, "parse failed: %s", line);
+	}
+
+	fclose(f);
+
+	if (es && event_store_close(es) != 0)
+		ret = 1;
+
+	return ret;
+}
+
+/* analyze a capture for the diff mode (see diff.c) */
+static int analyze_capture(const char *path, const pid_t *tasks, int ntasks)
+{
+	int ret;
+
+	subpattern_init(NULL, tasks, ntasks, 0);
+	ret = process_trace(path);
+	subpattern_cleanup();
+
+	return ret;
+}
+
+static void print_tasks(const pid_t *tasks, int ntasks)
+{
+	int i;
+
+	printf("processing task%s:", ntasks > 1 ? "s" : "");
+	for (i = 0; i < ntasks; i++)
+		printf(" %u", tasks[i]);
+	printf("\n");
+}
+
+static void handle_stop(int sig)
+{
+	(void)sig;
+
+	stop = 1;
+}
+
+/*
+ * Feed the complete lines in the buffer to the matcher. Returns the
+ * number of bytes of a trailing partial line, which are moved to the
+ * start of the buffer.
+ */
+static size_t process_lines(char *buf, size_t len)
+{
+	char *p = buf;
+	char *nl;
+	char c;
+
+	buf[len] = 0;
+
+	while ((nl = strchr(p, '\n'))) {
+		c = nl[1];
+		nl[1] = 0;
+		if (p[0] != '#' && subpattern_handle_traceline(p) != 0)
+			fprintf(stderr, "parse failed: %s", p);
+		nl[1] = c;
+		p = nl + 1;
+	}
+
+	len -= p - buf;
+	memmove(buf, p, len);
+
+	return len;
+}
+
+/*
+ * Run as a flight recorder: the ring buffer of the instance overwrites
+ * the oldest events and trace_pipe is consumed in batches at idle
+ * priority, so that latcheck never competes with the traced tasks for
+ * CPU. If it falls behind, events are lost rather than delayed.
+ */
+static int run_daemon(const char *tracingpath)
+{
+	static char buf[65536];
+	struct timespec poll = { 0, DAEMON_POLL_NS };
+	struct sched_param param;
+	struct sigaction sa;
+	char path[256];
+	size_t len = 0;
+	ssize_t n;
+	int fd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_stop;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	memset(&param, 0, sizeof(param));
+	if (sched_setscheduler(0, SCHED_IDLE, &param) != 0)
+		fprintf(stderr, "sched_setscheduler failed: %s\n",
+			strerror(errno));
+
+	tracefs_file(path, sizeof(path), tracingpath, "trace_pipe");
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "open failed: %s\n", strerror(errno));
+		return 1;
+	}
+
+	while (!stop) {
+		n = read(fd, buf + len, sizeof(buf) - 1 - len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "read failed: %s\n", strerror(errno));
+			break;
+		}
+
+		/* only the stream of a fake tracefs ends */
+		if (n == 0)
+			break;
+
+		len = process_lines(buf, len + n);
+
+		/* drop a line that does not fit */
+		if (len == sizeof(buf) - 1)
+			len = 0;
+
+		/* let events accumulate in the ring buffer */
+		nanosleep(&poll, NULL);
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+static int start_daemon(const pid_t *tasks, int ntasks, int flags,
+			unsigned long buffer_kb)
+{
+	char tracingpath[256];
+	char name[32];
+	char val[32];
+	int ret;
+
+	snprintf(name, sizeof(name), "latency_trace.%u", getpid());
+	if (tracefs_create_instance(tracingpath, sizeof(tracingpath),
+				    name) != 0) {
 		return 1;
 	}
 
-	task = fork();
-	if (task == -1) {
-		fprintf(stderr, "fork failed: %s\n", strerror(errno));
+	snprintf(val, sizeof(val), "%lu", buffer_kb);
+	if (set_tracing(tracingpath, "buffer_size_kb", val) != 0 ||
+	    set_tracing(tracingpath, "options/overwrite", "1") != 0) {
+		fprintf(stderr, "failed to set up ring buffer\n");
+		tracefs_remove_instance(tracingpath);
 		return 1;
 	}
 
-	if (task == 0) {
-		/* child */
-		cpu_set_t cset;
-		char c;
+	subpattern_init(tracingpath, tasks, ntasks, flags | SP_WINDOWED);
 
-		close(pipefd[1]);
-		while (1) {
-			if (read(pipefd[0], &c, 1) == 1) {
-				if (c == 'r')
-					break;
-				exit(1);
-			} else if (errno != EINTR) {
-				exit(1);
-			}
-		}
+	print_tasks(tasks, ntasks);
+	fflush(stdout);
 
-		close(pipefd[0]);
+	ret = set_tracing(tracingpath, "tracing_on", "1");
+	if (ret == 0)
+		ret = run_daemon(tracingpath);
 
-		CPU_ZERO(&cset);
-		CPU_SET(0, &cset);
+	set_tracing(tracingpath, "tracing_on", "0");
+
+	subpattern_cleanup();
+
+	if (stats_enabled)
+		stats_report(stderr, stats_json);
+
+	tracefs_remove_instance(tracingpath);
+
+	return ret;
+}
 
-		if (sched_setaffinity(0, sizeof(cset), &cset) != 0)
+/* a traced run of the commands */
+struct command_run {
+	const char *rootpath;
+	struct manifest *m;
+	const pid_t *pids;
+	int npids;
+	int flags;
+	int split;
+	int hist_mode;
+	unsigned long hist_threshold;
+};
+
+/*
+ * Wait for the start of all commands, then set up and exec one. Its
+ * markers go to the instance named after "instance_pid", or after the
+ * command itself if 0.
+ */
+static void exec_command(struct command_run *cr, struct manifest_cmd *cmd,
+			 pid_t instance_pid, int fd)
+{
+	char marker[MAXPATHLEN];
+	struct sched_param sp;
+	char c;
+
+	while (1) {
+		if (read(fd, &c, 1) == 1) {
+			if (c == 'r')
+				break;
 			exit(1);
+		} else if (errno != EINTR) {
+			exit(1);
+		}
+	}
 
-		execvp(argv[1], &argv[1]);
+	close(fd);
 
+	if (cmd->cpus_set &&
+	    sched_setaffinity(0, sizeof(cmd->cpus), &cmd->cpus) != 0) {
+		fprintf(stderr, "sched_setaffinity failed: %s\n",
+			strerror(errno));
 		exit(1);
 	}
 
-	close(pipefd[0]);
+	if (cmd->prio) {
+		sp.sched_priority = cmd->prio;
+		if (sched_setscheduler(0, SCHED_FIFO, &sp) != 0) {
+			fprintf(stderr, "sched_setscheduler failed: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	if (cmd->nice_set && setpriority(PRIO_PROCESS, 0, cmd->nice) != 0) {
+		fprintf(stderr, "setpriority failed: %s\n", strerror(errno));
+		exit(1);
+	}
 
-	snprintf(tracingpath, sizeof(tracingpath),
-		 "/sys/kernel/debug/tracing/instances/latency_trace.%u", task);
+	snprintf(marker, sizeof(marker),
+		 "%s/instances/latency_trace.%u/trace_marker",
+		 cr->rootpath, instance_pid ? instance_pid : getpid());
+	setenv(TRACE_MARKER_ENV, marker, 1);
 
-	mkdir(tracingpath, 0700);
+	execvp(cmd->argv[0], cmd->argv);
+
+	exit(1);
+}
+
+static void print_commands(struct manifest *m)
+{
+	struct manifest_cmd *cmd;
+	int i;
+	int j;
 
-	subpattern_init(tracingpath, task);
+	printf("commands:\n");
+	for (i = 0; i < m->nr_cmds; i++) {
+		cmd = &m->cmds[i];
 
-	snprintf(line, sizeof(line), "%s/tracing_on", tracingpath);
-	f = fopen(line, "w");
+		printf("  %u", cmd->pid);
+		if (cmd->prio)
+			printf(" prio=%d", cmd->prio);
+		if (cmd->nice_set)
+			printf(" nice=%d", cmd->nice);
+		if (!cmd->focus)
+			printf(" nofocus");
+		if (WIFEXITED(cmd->status))
+			printf(" exit=%d", WEXITSTATUS(cmd->status));
+		else if (WIFSIGNALED(cmd->status))
+			printf(" signal=%d", WTERMSIG(cmd->status));
+		printf(":");
+		for (j = 0; cmd->argv[j]; j++)
+			printf(" %s", cmd->argv[j]);
+		printf("\n");
+	}
+}
+
+/*
+ * Merge the traces of the per-task tracing instances into one file and
+ * return its path in "path".
+ */
+static int merge_instances(char (*instances)[256], int nr, char *path,
+			   size_t size)
+{
+	const char *paths[MAX_FOCUS_TASKS];
+	char trace[MAX_FOCUS_TASKS][MAXPATHLEN];
+	const char *tmpdir;
+	int ret;
+	int fd;
+	FILE *f;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		tracefs_file(trace[i], sizeof(trace[i]), instances[i],
+			     "trace");
+		paths[i] = trace[i];
+	}
+
+	tmpdir = getenv("TMPDIR");
+	if (!tmpdir)
+		tmpdir = "/tmp";
+	snprintf(path, size, "%s/latcheck-merged.XXXXXX", tmpdir);
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "mkstemp failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	f = fdopen(fd, "w");
 	if (!f) {
-		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		fprintf(stderr, "fdopen failed: %s\n", strerror(errno));
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	ret = manifest_merge(paths, nr, f);
+	if (fclose(f) != 0)
+		ret = -1;
+	if (ret != 0)
+		unlink(path);
+
+	return ret;
+}
+
+static int run_command(void *arg)
+{
+	char instances[MAX_FOCUS_TASKS][256];
+	struct command_run *cr = arg;
+	pid_t tasks[MAX_FOCUS_TASKS];
+	struct manifest_cmd *cmd;
+	char merged[MAXPATHLEN];
+	unsigned long over = 0;
+	int nr_instances = 0;
+	pid_t marker_pid = 0;
+	char line[512];
+	pid_t first = 0;
+	int ntasks = 0;
+	int pipefd[2];
+	int ret = 0;
+	int pass;
+	int i;
+
+	if (pipe(pipefd) != 0) {
+		fprintf(stderr, "pipe failed: %s\n", strerror(errno));
 		return 1;
 	}
 
-	write(pipefd[1], "r", 1);
+	/*
+	 * The focus commands are started first. A shared instance is named
+	 * after the first command, with split instances the commands that
+	 * are not focus tasks write their markers to the first instance.
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < cr->m->nr_cmds; i++) {
+			cmd = &cr->m->cmds[i];
+			if (cmd->focus != !pass)
+				continue;
+
+			if (cr->split && !cmd->focus)
+				marker_pid = ntasks ? tasks[0] : cr->pids[0];
+
+			cmd->pid = fork();
+			if (cmd->pid == -1) {
+				fprintf(stderr, "fork failed: %s\n",
+					strerror(errno));
+				return 1;
+			}
+
+			if (cmd->pid == 0) {
+				/* child */
+				close(pipefd[1]);
+				exec_command(cr, cmd, marker_pid, pipefd[0]);
+			}
+
+			if (!first)
+				first = cmd->pid;
+			if (!cr->split)
+				marker_pid = first;
+			if (cmd->focus)
+				tasks[ntasks++] = cmd->pid;
+		}
+	}
+
+	close(pipefd[0]);
+
+	memcpy(&tasks[ntasks], cr->pids, cr->npids * sizeof(*cr->pids));
+	ntasks += cr->npids;
+
+	subpattern_init(NULL, tasks, ntasks, cr->flags);
+
+	/*
+	 * Split: one instance per focus task, so that a busy task cannot
+	 * overwrite the events of the others in a shared ring buffer.
+	 */
+	for (i = 0; i < (cr->split ? ntasks : 1); i++) {
+		snprintf(line, sizeof(line), "latency_trace.%u",
+			 cr->split ? tasks[i] : first);
+		if (tracefs_create_instance(instances[i],
+					    sizeof(instances[i]), line) != 0) {
+			ret = 1;
+			break;
+		}
+		nr_instances++;
+
+		if (cr->split)
+			subpattern_enable(instances[i], &tasks[i], 1,
+					  cr->flags);
+		else
+			subpattern_enable(instances[i], tasks, ntasks,
+					  cr->flags);
+	}
+
+	if (ret == 0 && cr->hist_mode &&
+	    hist_trigger_enable(cr->rootpath, instances[0], tasks, ntasks,
+				cr->hist_threshold) != 0) {
+		fprintf(stderr, "failed to set up hist triggers\n");
+		hist_trigger_disable(cr->rootpath);
+		ret = 1;
+	}
+
+	/* a failed setup lets the commands exit without running */
+	for (i = 0; i < cr->m->nr_cmds; i++)
+		write(pipefd[1], ret == 0 ? "r" : "x", 1);
 	close(pipefd[1]);
-	wait(NULL);
-	fwrite("0\n", 2, 1, f);
-	fclose(f);
+	for (i = 0; i < cr->m->nr_cmds; i++)
+		waitpid(cr->m->cmds[i].pid, &cr->m->cmds[i].status, 0);
+	for (i = 0; i < nr_instances; i++)
+		set_tracing(instances[i], "tracing_on", "0");
 
-	printf("processing task: %u\n", task);
+	if (ret != 0)
+		goto out;
 
-	snprintf(line, sizeof(line), "%s/per_cpu/cpu0/trace", tracingpath);
-	f = fopen(line, "r");
-	if (!f) {
-		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
-		return 1;
+	if (cr->m->nr_cmds > 1)
+		print_commands(cr->m);
+	print_tasks(tasks, ntasks);
+
+	/*
+	 * Other focus tasks are not pinned and wakeups may be traced
+	 * on any CPU, so process the merged trace of all CPUs. With
+	 * hist triggers only the snapshot taken on the first latency
+	 * over the threshold is processed.
+	 */
+	if (cr->hist_mode) {
+		over = hist_trigger_report(instances[0]);
+		if (!over)
+			printf("no wakeup latency over %lu us\n",
+			       cr->hist_threshold);
+		tracefs_file(line, sizeof(line), instances[0], "snapshot");
+	} else if (cr->split) {
+		if (merge_instances(instances, nr_instances, merged,
+				    sizeof(merged)) != 0) {
+			ret = 1;
+			goto out;
+		}
+		snprintf(line, sizeof(line), "%s", merged);
+	} else {
+		tracefs_file(line, sizeof(line), instances[0], "trace");
 	}
 
-	while (fgets(line, sizeof(line), f)) {
-		if (line[0] == '#')
-			continue;
-		if (subpattern_handle_traceline(line) != 0)
-			fprintf(stderr, "parse failed: %s", line);
+	if ((!cr->hist_mode || over) && process_trace(line) != 0)
+		ret = 1;
+
+	if (cr->split)
+		unlink(merged);
+
+	subpattern_cleanup();
+
+	if (stats_enabled)
+		stats_report(stderr, stats_json);
+
+out:
+	for (i = 0; i < nr_instances; i++)
+		tracefs_remove_instance(instances[i]);
+
+	if (cr->hist_mode)
+		hist_trigger_disable(cr->rootpath);
+
+	return ret;
+}
+
+/*
+ * Run the command repeatedly, each run traced and analyzed in a child
+ * (see capture.c) and saved as event store. The store of the worst run
+ * is kept and analyzed in full detail, followed by the merged durations
+ * of all runs and how often each sub-pattern was significant.
+ */
+static int run_repeated(struct command_run *cr, int runs)
+{
+	unsigned long long worst_score = 0;
+	const char *save_path = store_path;
+	pid_t tasks[MAX_FOCUS_TASKS];
+	char path[2][MAXPATHLEN];
+	const char *tmpdir;
+	struct capture c;
+	int ntasks = 0;
+	struct runs r;
+	int worst = -1;
+	int ret = 0;
+	int i;
+
+	/*
+	 * path[0] holds the worst run so far, path[1] the current run,
+	 * both on the same file system so the worst run can be renamed
+	 */
+	if (save_path) {
+		snprintf(path[0], sizeof(path[0]), "%s", save_path);
+		snprintf(path[1], sizeof(path[1]), "%s.run", save_path);
+	} else {
+		tmpdir = getenv("TMPDIR");
+		if (!tmpdir)
+			tmpdir = "/tmp";
+		snprintf(path[0], sizeof(path[0]), "%s/latcheck-worst.%u",
+			 tmpdir, getpid());
+		snprintf(path[1], sizeof(path[1]), "%s/latcheck-run.%u",
+			 tmpdir, getpid());
 	}
 
-	fclose(f);
+	memset(&r, 0, sizeof(r));
+
+	store_path = path[1];
+	for (i = 0; i < runs; i++) {
+		if (capture_run(run_command, cr, &c) != 0) {
+			fprintf(stderr, "run %d failed\n", i + 1);
+			ret = 1;
+			break;
+		}
 
+		if (runs_add(&r, &c) != 0) {
+			capture_free(&c);
+			ret = 1;
+			break;
+		}
+
+		if (worst < 0 || runs_score(&c) > worst_score) {
+			if (rename(path[1], path[0]) != 0) {
+				fprintf(stderr, "rename failed: %s\n",
+					strerror(errno));
+				capture_free(&c);
+				ret = 1;
+				break;
+			}
+			worst_score = runs_score(&c);
+			worst = i;
+			memcpy(tasks, c.tasks, c.ntasks * sizeof(*c.tasks));
+			ntasks = c.ntasks;
+		}
+
+		capture_free(&c);
+	}
+	store_path = NULL;
+	unlink(path[1]);
+
+	if (ret == 0) {
+		printf("worst of %d runs: run %d\n", runs, worst + 1);
+
+		subpattern_init(NULL, tasks, ntasks, cr->flags);
+		print_tasks(tasks, ntasks);
+		if (process_trace(path[0]) != 0)
+			ret = 1;
+		subpattern_cleanup();
+		printf("\n");
+
+		runs_print(&r);
+	}
+
+	if (!save_path || ret != 0)
+		unlink(path[0]);
+
+	runs_free(&r);
+
+	return ret;
+}
+
+/* a recorded run, analyzed in a child (see capture.c) */
+struct input_run {
+	const char *path;
+	const pid_t *tasks;
+	int ntasks;
+	int flags;
+};
+
+static int analyze_input(void *arg)
+{
+	struct input_run *ir = arg;
+	int ret;
+
+	subpattern_init(NULL, ir->tasks, ir->ntasks, ir->flags);
+	subpattern_set_range(from_ns, to_ns);
+	ret = process_trace(ir->path);
 	subpattern_cleanup();
 
-	rmdir(tracingpath);
+	return ret;
+}
 
-	return 0;
+/*
+ * Analyze the recorded traces (or event stores) of several runs of a
+ * command like --runs does: the worst run in full detail, followed by
+ * the merged durations of all runs and how often each sub-pattern was
+ * significant.
+ */
+static int analyze_runs(const char **paths, int n, const pid_t *tasks,
+			int ntasks, int flags)
+{
+	unsigned long long worst_score = 0;
+	struct input_run ir;
+	struct capture c;
+	struct runs r;
+	int worst = -1;
+	int ret = 0;
+	int i;
+
+	memset(&r, 0, sizeof(r));
+
+	ir.tasks = tasks;
+	ir.ntasks = ntasks;
+	ir.flags = flags;
+
+	for (i = 0; i < n; i++) {
+		ir.path = paths[i];
+		if (capture_run(analyze_input, &ir, &c) != 0) {
+			fprintf(stderr, "analyzing %s failed\n", paths[i]);
+			ret = 1;
+			break;
+		}
+
+		if (runs_add(&r, &c) != 0) {
+			capture_free(&c);
+			ret = 1;
+			break;
+		}
+
+		if (worst < 0 || runs_score(&c) > worst_score) {
+			worst_score = runs_score(&c);
+			worst = i;
+		}
+
+		capture_free(&c);
+	}
+
+	if (ret == 0) {
+		printf("worst of %d runs: run %d\n", n, worst + 1);
+
+		subpattern_init(NULL, tasks, ntasks, flags);
+		subpattern_set_range(from_ns, to_ns);
+		print_tasks(tasks, ntasks);
+		if (process_trace(paths[worst]) != 0)
+			ret = 1;
+		subpattern_cleanup();
+		printf("\n");
+
+		runs_print(&r);
+	}
+
+	runs_free(&r);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long buffer_kb = DAEMON_BUFFER_KB;
+	pid_t tasks[MAX_FOCUS_TASKS];
+	unsigned long hist_threshold = 0;
+	unsigned long max_inst = 100000;
+	unsigned long window_us = 10000;
+	const char *manifest = NULL;
+	const char *root = NULL;
+	const char *inputs[MAX_INPUTS];
+	struct command_run cr;
+	const char *rootpath;
+	struct manifest m;
+	cpu_set_t cpus;
+	int daemon_mode = 0;
+	int calibration = 0;
+	int pin = 1;
+	int hist_mode = 0;
+	int ntasks = 1;
+	int flags = 0;
+	int ninputs = 0;
+	int nfocus = 0;
+	int split = 0;
+	int runs = 1;
+	int ret;
+	int opt;
+	int i;
+
+	mtrace();
+
+	if (argc > 1 && strcmp(argv[1], "diff") == 0)
+		return diff_main(argc - 1, &argv[1], analyze_capture);
+
+	/* merge the traces of tracing instances as --split-instances does */
+	if (argc > 1 && strcmp(argv[1], "merge") == 0) {
+		if (argc < 4) {
+			usage(argv[0]);
+			return 1;
+		}
+		return manifest_merge((const char **)&argv[2], argc - 2,
+				      stdout) != 0;
+	}
+
+	/* tasks[0] is reserved for the traced command */
+	while ((opt = getopt_long(argc, argv, "+B:b:C:DH:i:M:O:p:sT:uW:w",
+				  long_options, NULL)) != -1) {
+		switch (opt) {
+		case OPT_STATS:
+			if (optarg && strcmp(optarg, "json") == 0) {
+				stats_json = 1;
+			} else if (optarg && strcmp(optarg, "text") != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			stats_enable();
+			break;
+		case OPT_CALIBRATE:
+			calibration = 1;
+			break;
+		case OPT_FROM:
+			from_ns = parse_seconds(optarg);
+			break;
+		case OPT_TO:
+			to_ns = parse_seconds(optarg);
+			break;
+		case OPT_LEAD_IN:
+			lead_ns = strtoul(optarg, NULL, 10) * 1000ULL;
+			break;
+		case OPT_INDEX:
+			save_index = 1;
+			break;
+		case OPT_STORE:
+			store_path = optarg;
+			break;
+		case OPT_KALLSYMS:
+			kallsyms_set_path(optarg);
+			break;
+		case OPT_PERIOD:
+			subpattern_defaults()->period_us =
+				strtoul(optarg, NULL, 10);
+			break;
+		case OPT_JITTER:
+			subpattern_defaults()->jitter_us =
+				strtoul(optarg, NULL, 10);
+			break;
+		case OPT_RUNS:
+			runs = strtoul(optarg, NULL, 10);
+			break;
+		case OPT_MANIFEST:
+			manifest = optarg;
+			break;
+		case OPT_RUNQUEUE:
+			subpattern_defaults()->flags |= SP_RUNQUEUE;
+			break;
+		case OPT_CRITICAL_PATH:
+			subpattern_defaults()->flags |= SP_CRITICAL_PATH;
+			break;
+		case OPT_SPLIT:
+			split = 1;
+			break;
+		case 'B':
+			buffer_kb = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			if (add_budget(optarg) != 0)
+				return 1;
+			break;
+		case 'C':
+			if (parse_cpus(optarg, &cpus) != 0) {
+				fprintf(stderr, "invalid CPU list: %s\n",
+					optarg);
+				return 1;
+			}
+			subpattern_defaults()->preemptirq_cpus = optarg;
+			break;
+		case 'D':
+			daemon_mode = 1;
+			break;
+		case 'H':
+			hist_mode = 1;
+			hist_threshold = strtoul(optarg, NULL, 10);
+			break;
+		case 'i':
+			if (ninputs >= MAX_INPUTS) {
+				fprintf(stderr, "too many traces (max %d)\n",
+					MAX_INPUTS);
+				return 1;
+			}
+			inputs[ninputs++] = optarg;
+			break;
+		case 'M':
+			max_inst = strtoul(optarg, NULL, 10);
+			break;
+		case 'O':
+			subpattern_set_overhead(strtoul(optarg, NULL, 10));
+			break;
+		case 'p':
+			if (ntasks >= MAX_FOCUS_TASKS) {
+				fprintf(stderr, "too many tasks (max %d)\n",
+					MAX_FOCUS_TASKS);
+				return 1;
+			}
+			tasks[ntasks++] = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			flags |= SP_STACKTRACE;
+			break;
+		case 'T':
+			root = optarg;
+			break;
+		case 'u':
+			pin = 0;
+			break;
+		case 'W':
+			window_us = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			flags |= SP_WINDOWED;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	subpattern_set_window(window_us, max_inst);
+
+	if (calibration) {
+		if (ntasks > 1 || optind != argc || daemon_mode ||
+		    hist_mode || ninputs) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if (!tracefs_init(root))
+			return 1;
+
+		return calibrate(flags);
+	}
+
+	if (daemon_mode) {
+		if (ntasks < 2 || optind != argc || hist_mode || ninputs ||
+		    !nr_budgets || from_ns || to_ns || store_path) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if (!tracefs_init(root))
+			return 1;
+
+		return start_daemon(&tasks[1], ntasks - 1, flags, buffer_kb);
+	}
+
+	if (ninputs > 1) {
+		if (ntasks < 2 || optind != argc || hist_mode || store_path) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		return analyze_runs(inputs, ninputs, &tasks[1], ntasks - 1,
+				    flags);
+	}
+
+	if (ninputs) {
+		if (ntasks < 2 || optind != argc || hist_mode) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		subpattern_init(NULL, &tasks[1], ntasks - 1, flags);
+		subpattern_set_range(from_ns, to_ns);
+
+		print_tasks(&tasks[1], ntasks - 1);
+
+		if (process_trace(inputs[0]) != 0)
+			return 1;
+
+		subpattern_cleanup();
+
+		if (stats_enabled)
+			stats_report(stderr, stats_json);
+
+		return 0;
+	}
+
+	if ((!manifest && optind >= argc) || (manifest && optind != argc) ||
+	    from_ns || to_ns || runs < 1 || (hist_mode && (runs > 1 || split))) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (manifest) {
+		if (manifest_parse(manifest, &m) != 0)
+			return 1;
+	} else {
+		memset(&m, 0, sizeof(m));
+		if (manifest_add(&m, &argv[optind]) != 0) {
+			manifest_free(&m);
+			return 1;
+		}
+		if (pin) {
+			CPU_ZERO(&m.cmds[0].cpus);
+			CPU_SET(0, &m.cmds[0].cpus);
+			m.cmds[0].cpus_set = 1;
+		}
+	}
+
+	/* tasks[0] is not used, the focus commands come first */
+	for (i = 0; i < m.nr_cmds; i++)
+		nfocus += m.cmds[i].focus;
+	if (nfocus + ntasks - 1 < 1 ||
+	    nfocus + ntasks - 1 > MAX_FOCUS_TASKS) {
+		fprintf(stderr, "%d focus tasks (min 1, max %d)\n",
+			nfocus + ntasks - 1, MAX_FOCUS_TASKS);
+		manifest_free(&m);
+		return 1;
+	}
+
+	rootpath = tracefs_init(root);
+	if (!rootpath) {
+		manifest_free(&m);
+		return 1;
+	}
+
+	cr.rootpath = rootpath;
+	cr.m = &m;
+	cr.pids = &tasks[1];
+	cr.npids = ntasks - 1;
+	cr.flags = flags;
+	cr.split = split;
+	cr.hist_mode = hist_mode;
+	cr.hist_threshold = hist_threshold;
+
+	if (runs > 1)
+		ret = run_repeated(&cr, runs);
+	else
+		ret = run_command(&cr);
+
+	manifest_free(&m);
+
+	return ret;
 }
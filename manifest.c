@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "manifest.h"
+
+/*
+ * A manifest lists the commands of a test run, one per line:
+ *
+ *   [cpus=<list>] [prio=<n>] [nice=<n>] [nofocus] <command> <arg>...
+ *
+ * cpus sets the affinity, prio the SCHED_FIFO priority and nice the
+ * nice value of the command. All commands are focus tasks unless marked
+ * nofocus (e.g. load generators). Arguments are separated by blanks,
+ * there is no quoting. Lines starting with '#' are comments.
+ */
+
+#define MANIFEST_LINE_MAX 1024
+#define MANIFEST_ARGS_MAX 64
+
+/* trace lines of the same timestamp compared for duplicates */
+#define MERGE_RECENT 16
+
+static struct manifest_cmd *new_cmd(struct manifest *m)
+{
+	struct manifest_cmd *cmd;
+
+	cmd = array_grow(m->cmds, m->nr_cmds, sizeof(*cmd));
+	if (!cmd)
+		return NULL;
+	m->cmds = cmd;
+
+	cmd = &m->cmds[m->nr_cmds++];
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->focus = 1;
+
+	return cmd;
+}
+
+static int set_argv(struct manifest_cmd *cmd, char **argv, int argc)
+{
+	int i;
+
+	cmd->argv = calloc(argc + 1, sizeof(*cmd->argv));
+	if (!cmd->argv) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < argc; i++) {
+		cmd->argv[i] = strdup(argv[i]);
+		if (!cmd->argv[i]) {
+			fprintf(stderr, "strdup failed: %s\n",
+				strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int parse_option(struct manifest_cmd *cmd, const char *tok)
+{
+	if (strncmp(tok, "cpus=", 5) == 0) {
+		if (parse_cpus(tok + 5, &cmd->cpus) != 0)
+			return -1;
+		cmd->cpus_set = 1;
+	} else if (strncmp(tok, "prio=", 5) == 0) {
+		cmd->prio = strtol(tok + 5, NULL, 10);
+		if (cmd->prio < 1 || cmd->prio > 99) {
+			fprintf(stderr, "invalid priority %s\n", tok + 5);
+			return -1;
+		}
+	} else if (strncmp(tok, "nice=", 5) == 0) {
+		cmd->nice = strtol(tok + 5, NULL, 10);
+		cmd->nice_set = 1;
+	} else if (strcmp(tok, "nofocus") == 0) {
+		cmd->focus = 0;
+	} else {
+		/* the command */
+		return 1;
+	}
+
+	return 0;
+}
+
+int manifest_parse(const char *path, struct manifest *m)
+{
+	char *args[MANIFEST_ARGS_MAX];
+	char line[MANIFEST_LINE_MAX];
+	struct manifest_cmd *cmd;
+	int lineno = 0;
+	int ret = 0;
+	char *tok;
+	int argc;
+	FILE *f;
+
+	memset(m, 0, sizeof(*m));
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while (ret == 0 && fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		tok = strtok(line, " \t\n");
+		if (!tok || tok[0] == '#')
+			continue;
+
+		cmd = new_cmd(m);
+		if (!cmd) {
+			ret = -1;
+			break;
+		}
+
+		while (tok && (ret = parse_option(cmd, tok)) == 0)
+			tok = strtok(NULL, " \t\n");
+		if (ret < 0)
+			break;
+
+		for (argc = 0; tok && argc < MANIFEST_ARGS_MAX;
+		     tok = strtok(NULL, " \t\n")) {
+			args[argc++] = tok;
+		}
+		if (!argc || tok) {
+			ret = -1;
+			break;
+		}
+
+		ret = set_argv(cmd, args, argc);
+	}
+
+	fclose(f);
+
+	if (ret == 0 && !m->nr_cmds) {
+		fprintf(stderr, "%s: no commands\n", path);
+		ret = -1;
+	} else if (ret != 0) {
+		fprintf(stderr, "%s:%d: invalid command\n", path, lineno);
+	}
+
+	if (ret != 0)
+		manifest_free(m);
+
+	return ret;
+}
+
+/* add a command given on the command line */
+int manifest_add(struct manifest *m, char **argv)
+{
+	struct manifest_cmd *cmd;
+	int argc;
+
+	cmd = new_cmd(m);
+	if (!cmd)
+		return -1;
+
+	for (argc = 0; argv[argc]; argc++)
+		;
+
+	return set_argv(cmd, argv, argc);
+}
+
+void manifest_free(struct manifest *m)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < m->nr_cmds; i++) {
+		for (j = 0; m->cmds[i].argv && m->cmds[i].argv[j]; j++)
+			free(m->cmds[i].argv[j]);
+		free(m->cmds[i].argv);
+	}
+	free(m->cmds);
+	memset(m, 0, sizeof(*m));
+}
+
+struct merge_input {
+	FILE *f;
+	char line[512];
+	unsigned long long ts;
+	int eof;
+};
+
+/*
+ * Advance an input to its next trace line with a timestamp, writing the
+ * lines without one (e.g. stack traces) that belong to the current
+ * line to "out" unless it is NULL.
+ */
+static void merge_next(struct merge_input *in, FILE *out)
+{
+	while (fgets(in->line, sizeof(in->line), in->f)) {
+		if (in->line[0] != '#' && trace_ts(in->line, &in->ts) == 0)
+			return;
+		if (out && in->line[0] != '#')
+			fputs(in->line, out);
+	}
+
+	in->eof = 1;
+}
+
+/*
+ * Merge the traces of several tracing instances by timestamp. Events
+ * that are not filtered by task are traced in every instance, so a line
+ * already written from another instance with the same timestamp is
+ * dropped with the lines belonging to it.
+ */
+int manifest_merge(const char **paths, int nr, FILE *out)
+{
+	char recent[MERGE_RECENT][512];
+	unsigned long long recent_ts = 0;
+	int recent_in[MERGE_RECENT];
+	struct merge_input *in;
+	int nr_recent = 0;
+	int ret = 0;
+	int dup;
+	int min;
+	int i;
+
+	in = calloc(nr, sizeof(*in));
+	if (!in) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		in[i].f = fopen(paths[i], "r");
+		if (!in[i].f) {
+			fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+			ret = -1;
+			goto out;
+		}
+		merge_next(&in[i], NULL);
+	}
+
+	while (1) {
+		min = -1;
+		for (i = 0; i < nr; i++) {
+			if (!in[i].eof && (min < 0 || in[i].ts < in[min].ts))
+				min = i;
+		}
+		if (min < 0)
+			break;
+
+		if (in[min].ts != recent_ts) {
+			recent_ts = in[min].ts;
+			nr_recent = 0;
+		}
+
+		dup = 0;
+		for (i = 0; i < nr_recent && !dup; i++) {
+			dup = (recent_in[i] != min &&
+			       strcmp(recent[i], in[min].line) == 0);
+		}
+
+		if (!dup) {
+			fputs(in[min].line, out);
+			if (nr_recent < MERGE_RECENT) {
+				strcpy(recent[nr_recent], in[min].line);
+				recent_in[nr_recent++] = min;
+			}
+		}
+
+		merge_next(&in[min], dup ? NULL : out);
+	}
+
+out:
+	for (i = 0; i < nr; i++) {
+		if (in[i].f)
+			fclose(in[i].f);
+	}
+	free(in);
+
+	return ret;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <sched.h>
+#include <sys/types.h>
+
+/* a command to run, with its affinity and scheduling */
+struct manifest_cmd {
+	char **argv;
+	cpu_set_t cpus;
+	int cpus_set;
+	int prio;
+	int nice;
+	int nice_set;
+	int focus;
+
+	/* set when the command was run */
+	pid_t pid;
+	int status;
+};
+
+struct manifest {
+	struct manifest_cmd *cmds;
+	int nr_cmds;
+};
+
+extern int manifest_parse(const char *path, struct manifest *m);
+extern int manifest_add(struct manifest *m, char **argv);
+extern void manifest_free(struct manifest *m);
+extern int manifest_merge(const char **paths, int nr, FILE *out);
+
+#endif /* MANIFEST_H */
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "patterns/patterns.h"
+#include "pattern.h"
+
+/* a registered pattern with its state in one analysis context */
+struct pattern_entry {
+	const struct pattern_definition *def;
+	void *data;
+
+	LIST_ENTRY(pattern_entry) list;
+};
+
+struct pattern_set {
+	LIST_HEAD(listhead_patterns, pattern_entry) head;
+};
+
+int register_pattern(struct pattern_set *ps,
+		     const struct pattern_definition *def)
+{
+	struct pattern_entry *pe;
+
+	pe = calloc(1, sizeof(*pe));
+	if (!pe) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	pe->def = def;
+	LIST_INSERT_HEAD(&ps->head, pe, list);
+
+	return 0;
+}
+
+struct pattern_set *pattern_init(struct latcheck *lc, const char *tracingpath,
+				 const pid_t *tasks, int ntasks)
+{
+	struct pattern_entry *next;
+	struct pattern_entry *pe;
+	struct pattern_set *ps;
+
+	ps = calloc(1, sizeof(*ps));
+	if (!ps) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	LIST_INIT(&ps->head);
+
+	register_pi_chain(ps);
+	register_futex_contention(ps);
+	register_offcpu_stacks(ps);
+	register_budget(ps);
+	register_runqueue(ps);
+	register_page_faults(ps);
+	register_timer_latency(ps);
+	register_block_io(ps);
+	register_critical_path(ps);
+	register_cycles(ps);
+	register_summary(ps);
+
+	for (pe = LIST_FIRST(&ps->head); pe; pe = next) {
+		next = LIST_NEXT(pe, list);
+
+		if (pe->def->ops->init) {
+			pe->data = pe->def->ops->init(lc, tasks, ntasks);
+			if (!pe->data) {
+				LIST_REMOVE(pe, list);
+				free(pe);
+			}
+		}
+	}
+
+	/* offline traces have nothing to enable */
+	if (tracingpath)
+		pattern_enable(ps, tracingpath);
+
+	return ps;
+}
+
+void pattern_enable(struct pattern_set *ps, const char *tracingpath)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (pe->def->ops->enable)
+			pe->def->ops->enable(pe->data, tracingpath);
+	}
+}
+
+void pattern_traceline(struct pattern_set *ps, const char *traceline,
+		       const struct trace_event *ev,
+		       struct timespec *ts, int cpu, pid_t task)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (!pe->def->ops->traceline)
+			continue;
+		pe->def->ops->traceline(pe->data, traceline, ev, ts,
+					cpu, task);
+	}
+}
+
+void pattern_closed(struct pattern_set *ps,
+		    struct subpattern_instance *sp_inst)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (!pe->def->ops->closed)
+			continue;
+		pe->def->ops->closed(pe->data, sp_inst);
+	}
+}
+
+void pattern_significant(struct pattern_set *ps,
+			 struct subpattern_instance *sp_inst,
+			 pid_t focus_task)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (!pe->def->ops->significant)
+			continue;
+		pe->def->ops->significant(pe->data, sp_inst, focus_task);
+	}
+}
+
+void pattern_report(struct pattern_set *ps)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (!pe->def->ops->report)
+			continue;
+		pe->def->ops->report(pe->data);
+	}
+}
+
+void pattern_prune(struct pattern_set *ps, unsigned long long before)
+{
+	struct pattern_entry *pe;
+
+	LIST_FOREACH(pe, &ps->head, list) {
+		if (!pe->def->ops->prune)
+			continue;
+		pe->def->ops->prune(pe->data, before);
+	}
+}
+
+void pattern_cleanup(struct pattern_set *ps)
+{
+	struct pattern_entry *pe;
+
+	while ((pe = LIST_FIRST(&ps->head))) {
+		LIST_REMOVE(pe, list);
+		if (pe->def->ops->free_data)
+			pe->def->ops->free_data(pe->data);
+		free(pe);
+	}
+
+	free(ps);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#include "subpattern.h"
+
+struct latcheck;
+struct pattern_definition;
+struct pattern_set;
+
+/*
+ * A (complex) pattern combines sub-patterns and trace events of
+ * possibly several tasks. Patterns see every trace line and every
+ * sub-pattern as soon as it closes, are told about every significant
+ * sub-pattern and report their findings after the significant
+ * sub-patterns have been printed. When tracing continuously, patterns
+ * are asked to drop state older than the retained trace history.
+ */
+struct pattern_ops {
+	void *(*init)(struct latcheck *lc, const pid_t *tasks, int ntasks);
+	int (*enable)(void *data, const char *tracingpath);
+	void (*traceline)(void *data, const char *traceline,
+			  const struct trace_event *ev,
+			  struct timespec *ts, int cpu, pid_t task);
+	void (*closed)(void *data, struct subpattern_instance *sp_inst);
+	void (*significant)(void *data, struct subpattern_instance *sp_inst,
+			    pid_t focus_task);
+	void (*report)(void *data);
+	void (*prune)(void *data, unsigned long long before);
+	void (*free_data)(void *data);
+};
+
+struct pattern_definition {
+	const char *name;
+	const struct pattern_ops *ops;
+};
+
+extern int register_pattern(struct pattern_set *ps,
+			    const struct pattern_definition *def);
+
+/* the patterns of one analysis context (see subpattern.c) */
+extern struct pattern_set *pattern_init(struct latcheck *lc,
+					const char *tracingpath,
+					const pid_t *tasks, int ntasks);
+extern void pattern_enable(struct pattern_set *ps, const char *tracingpath);
+extern void pattern_traceline(struct pattern_set *ps, const char *traceline,
+			      const struct trace_event *ev,
+			      struct timespec *ts, int cpu, pid_t task);
+extern void pattern_closed(struct pattern_set *ps,
+			   struct subpattern_instance *sp_inst);
+extern void pattern_significant(struct pattern_set *ps,
+				struct subpattern_instance *sp_inst,
+				pid_t focus_task);
+extern void pattern_report(struct pattern_set *ps);
+extern void pattern_prune(struct pattern_set *ps, unsigned long long before);
+extern void pattern_cleanup(struct pattern_set *ps);
+
+#endif /* PATTERN_H */
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "pattern.h"
+#include "subpatterns/block_rq.h"
+
+/*
+ * Attribute the uninterruptible sleeps (sched_out_nonint_sleeping) of
+ * the focus tasks to block I/O. A sleep is attributed to the last
+ * request queued by the task that completed during the sleep or, if
+ * there is none, to the last request completed during the sleep on the
+ * CPU that woke the task (the completion interrupt is the wakeup
+ * source). The sleep is split into the time the request was queued
+ * before it was issued to the device, the device service time and the
+ * remainder (before the I/O was queued and from its completion to the
+ * wakeup).
+ */
+
+#define SLEEP_NAME "sched_out_nonint_sleeping"
+
+struct io_done {
+	struct block_rq rq;
+	unsigned long long issue;
+	unsigned long long complete;
+	int valid;
+};
+
+struct io_attr {
+	unsigned long tracelineno;
+	const struct subpattern_definition *def;
+	pid_t task;
+	unsigned long long begin;
+	unsigned long long end;
+	struct io_done io;
+	int wake_cpu;
+	int significant;
+};
+
+struct block_io {
+	const pid_t *tasks;
+	int ntasks;
+
+	/* the last completion per CPU and per focus task (owner) */
+	struct io_done *cpus;
+	int nr_cpus;
+	struct io_done *owners;
+
+	struct io_attr *attrs;
+	int nr_attrs;
+	int sorted;
+};
+
+static struct io_done *get_cpu(struct block_io *bio, int cpu)
+{
+	struct io_done *cpus;
+
+	if (cpu < 0)
+		return NULL;
+
+	if (cpu >= bio->nr_cpus) {
+		cpus = realloc(bio->cpus, (cpu + 1) * sizeof(*cpus));
+		if (!cpus) {
+			fprintf(stderr, "realloc failed: %s\n",
+				strerror(errno));
+			return NULL;
+		}
+		memset(&cpus[bio->nr_cpus], 0,
+		       (cpu + 1 - bio->nr_cpus) * sizeof(*cpus));
+		bio->cpus = cpus;
+		bio->nr_cpus = cpu + 1;
+	}
+
+	return &bio->cpus[cpu];
+}
+
+static int focus_index(struct block_io *bio, pid_t task)
+{
+	int i;
+
+	for (i = 0; i < bio->ntasks; i++) {
+		if (bio->tasks[i] == task)
+			return i;
+	}
+
+	return -1;
+}
+
+static void rq_closed(struct block_io *bio,
+		      struct subpattern_instance *sp_inst)
+{
+	struct io_done done;
+	struct io_done *cpu;
+	int fi;
+
+	done.rq = *block_rq_of(sp_inst->partner);
+	done.issue = ts_to_ns(&sp_inst->ts);
+	done.complete = ts_to_ns(&sp_inst->partner->ts);
+	done.valid = 1;
+
+	cpu = get_cpu(bio, sp_inst->partner->cpu);
+	if (cpu)
+		*cpu = done;
+
+	fi = focus_index(bio, done.rq.owner);
+	if (done.rq.owner && fi >= 0)
+		bio->owners[fi] = done;
+}
+
+static int during(struct io_done *io, unsigned long long begin,
+		  unsigned long long end)
+{
+	return (io && io->valid && io->complete >= begin &&
+		io->complete <= end);
+}
+
+static void sleep_closed(struct block_io *bio,
+			 struct subpattern_instance *sp_inst)
+{
+	struct subpattern_instance *out = sp_inst->partner;
+	unsigned long long begin;
+	unsigned long long end;
+	struct io_attr *attr;
+	struct io_done *io;
+	int wake_cpu = -1;
+	int fi;
+
+	/* the focus task scheduled out */
+	for (fi = 0; fi < bio->ntasks; fi++) {
+		if (sp_inst->def->ops->sched_out &&
+		    sp_inst->def->ops->sched_out(bio->tasks[fi],
+						 sp_inst->data) > 0) {
+			break;
+		}
+	}
+	if (fi == bio->ntasks)
+		return;
+
+	begin = ts_to_ns(&sp_inst->ts);
+	end = ts_to_ns(&out->ts);
+
+	io = &bio->owners[fi];
+	if (!during(io, begin, end)) {
+		wake_cpu = out->cpu;
+		io = get_cpu(bio, wake_cpu);
+		if (!during(io, begin, end))
+			return;
+	}
+
+	attr = array_grow(bio->attrs, bio->nr_attrs, sizeof(*attr));
+	if (!attr)
+		return;
+	bio->attrs = attr;
+
+	attr = &bio->attrs[bio->nr_attrs++];
+	memset(attr, 0, sizeof(*attr));
+	attr->tracelineno = sp_inst->tracelineno;
+	attr->def = sp_inst->def;
+	attr->task = bio->tasks[fi];
+	attr->begin = begin;
+	attr->end = end;
+	attr->io = *io;
+	attr->wake_cpu = wake_cpu;
+
+	if (bio->nr_attrs > 1 &&
+	    attr[-1].tracelineno > attr->tracelineno) {
+		bio->sorted = 0;
+	}
+}
+
+static void bio_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct block_io *bio = data;
+
+	if (block_rq_of(sp_inst))
+		rq_closed(bio, sp_inst);
+	else if (strcmp(sp_inst->def->name, SLEEP_NAME) == 0)
+		sleep_closed(bio, sp_inst);
+}
+
+static int cmp_attr(const void *lhs, const void *rhs)
+{
+	const struct io_attr *l = lhs;
+	const struct io_attr *r = rhs;
+
+	if (l->tracelineno != r->tracelineno)
+		return (l->tracelineno < r->tracelineno) ? -1 : 1;
+
+	if (l->def != r->def)
+		return (l->def < r->def) ? -1 : 1;
+
+	return 0;
+}
+
+static void bio_significant(void *data, struct subpattern_instance *sp_inst,
+			    pid_t focus_task)
+{
+	struct block_io *bio = data;
+	struct io_attr *attr;
+	struct io_attr key;
+
+	if (sp_inst->bound != in || !sp_inst->partner ||
+	    strcmp(sp_inst->def->name, SLEEP_NAME) != 0) {
+		return;
+	}
+
+	if (!bio->sorted) {
+		qsort(bio->attrs, bio->nr_attrs, sizeof(*bio->attrs),
+		      cmp_attr);
+		bio->sorted = 1;
+	}
+
+	key.tracelineno = sp_inst->tracelineno;
+	key.def = sp_inst->def;
+	attr = bsearch(&key, bio->attrs, bio->nr_attrs, sizeof(*bio->attrs),
+		       cmp_attr);
+	if (attr && attr->task == focus_task)
+		attr->significant = 1;
+}
+
+/* split the sleep into queueing, device service and the remainder */
+static void split_sleep(struct io_attr *attr, unsigned long long *queue,
+			unsigned long long *device, unsigned long long *other)
+{
+	unsigned long long queued = attr->io.rq.queued;
+	unsigned long long issue = attr->io.issue;
+
+	if (!queued || queued > issue)
+		queued = issue;
+	if (queued < attr->begin)
+		queued = attr->begin;
+	if (issue < attr->begin)
+		issue = attr->begin;
+
+	*queue = issue - queued;
+	*device = attr->io.complete - issue;
+	*other = (attr->end - attr->begin) - *queue - *device;
+}
+
+static void print_attr(struct io_attr *attr)
+{
+	unsigned long long device;
+	unsigned long long queue;
+	unsigned long long other;
+	struct block_rq *rq = &attr->io.rq;
+
+	split_sleep(attr, &queue, &device, &other);
+
+	printf("%llu.%06llu task %u slept %llu us: dev %u,%u %s %lu bytes"
+	       " at sector %llu",
+	       attr->begin / 1000000000ULL, attr->begin % 1000000000ULL / 1000,
+	       attr->task, (attr->end - attr->begin) / 1000, rq->major,
+	       rq->minor, rq->rwbs, rq->nr_sector * SECTOR_SIZE, rq->sector);
+	if (attr->wake_cpu >= 0)
+		printf(" (completed on waking cpu %d)", attr->wake_cpu);
+	printf(", queued %llu us, device %llu us, other %llu us\n",
+	       queue / 1000, device / 1000, other / 1000);
+}
+
+struct dev_stat {
+	unsigned int major;
+	unsigned int minor;
+	unsigned long sleeps;
+	unsigned long long sleep;
+	unsigned long long queue;
+	unsigned long long device;
+};
+
+static void print_devices(struct block_io *bio)
+{
+	struct dev_stat *devs = NULL;
+	unsigned long long device;
+	unsigned long long queue;
+	unsigned long long other;
+	struct io_attr *attr;
+	struct dev_stat *dev;
+	int nr_devs = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < bio->nr_attrs; i++) {
+		attr = &bio->attrs[i];
+
+		for (j = 0; j < nr_devs; j++) {
+			if (devs[j].major == attr->io.rq.major &&
+			    devs[j].minor == attr->io.rq.minor) {
+				break;
+			}
+		}
+		if (j == nr_devs) {
+			dev = array_grow(devs, nr_devs, sizeof(*dev));
+			if (!dev)
+				break;
+			devs = dev;
+			memset(&devs[nr_devs], 0, sizeof(*dev));
+			devs[nr_devs].major = attr->io.rq.major;
+			devs[nr_devs].minor = attr->io.rq.minor;
+			nr_devs++;
+		}
+		dev = &devs[j];
+
+		split_sleep(attr, &queue, &device, &other);
+		dev->sleeps++;
+		dev->sleep += attr->end - attr->begin;
+		dev->queue += queue;
+		dev->device += device;
+	}
+
+	printf("uninterruptible sleeps of focus tasks per device:\n\n");
+	printf("%-8s %7s %10s %10s %10s\n", "dev", "sleeps", "sleep us",
+	       "queued us", "device us");
+	for (j = 0; j < nr_devs; j++) {
+		dev = &devs[j];
+		printf("%3u,%-4u %7lu %10llu %10llu %10llu\n", dev->major,
+		       dev->minor, dev->sleeps, dev->sleep / 1000,
+		       dev->queue / 1000, dev->device / 1000);
+	}
+	printf("\n");
+
+	free(devs);
+}
+
+static void bio_report(void *data)
+{
+	struct block_io *bio = data;
+	int header = 0;
+	int i;
+
+	if (!bio->nr_attrs)
+		return;
+
+	for (i = 0; i < bio->nr_attrs; i++) {
+		if (!bio->attrs[i].significant)
+			continue;
+
+		if (!header) {
+			printf("block I/O of significant uninterruptible"
+			       " sleeps:\n\n");
+			header = 1;
+		}
+		print_attr(&bio->attrs[i]);
+	}
+	if (header)
+		printf("\n");
+
+	print_devices(bio);
+}
+
+static void bio_prune(void *data, unsigned long long before)
+{
+	struct block_io *bio = data;
+	int i;
+	int n;
+
+	for (i = 0, n = 0; i < bio->nr_attrs; i++) {
+		if (bio->attrs[i].end >= before)
+			bio->attrs[n++] = bio->attrs[i];
+	}
+	bio->nr_attrs = n;
+}
+
+static void *bio_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct block_io *bio;
+
+	(void)lc;
+
+	bio = calloc(1, sizeof(*bio));
+	if (!bio) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	bio->owners = calloc(ntasks, sizeof(*bio->owners));
+	if (!bio->owners) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		free(bio);
+		return NULL;
+	}
+
+	bio->tasks = tasks;
+	bio->ntasks = ntasks;
+	bio->sorted = 1;
+
+	return bio;
+}
+
+static void bio_free_data(void *data)
+{
+	struct block_io *bio = data;
+
+	if (!bio)
+		return;
+
+	free(bio->cpus);
+	free(bio->owners);
+	free(bio->attrs);
+	free(bio);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = bio_init,
+	.closed = bio_closed,
+	.significant = bio_significant,
+	.report = bio_report,
+	.prune = bio_prune,
+	.free_data = bio_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "block_io",
+	.ops = &pat_ops,
+};
+
+int register_block_io(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
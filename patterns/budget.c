@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "latcheck.h"
+#include "util.h"
+#include "pattern.h"
+
+/*
+ * Check every closed sub-pattern that is relevant to a focus task
+ * against the latency budgets of the context config. A budget applies
+ * to the sub-pattern of the same name, or to all sub-patterns starting
+ * with its name if it ends with '*' (e.g. "sched_out_*"). For every
+ * violation the trace window around it is requested to be reported.
+ */
+
+#define MAX_BUDGETS LATCHECK_MAX_BUDGETS
+
+struct budget {
+	char *name;
+	unsigned long long limit;
+};
+
+struct budget_stat {
+	unsigned long violations;
+	unsigned long long worst;
+	unsigned long long worst_ts;
+	pid_t worst_task;
+};
+
+struct budget_check {
+	struct latcheck *lc;
+	const pid_t *tasks;
+	int ntasks;
+
+	struct budget budgets[MAX_BUDGETS];
+	int nr_budgets;
+	struct budget_stat stats[MAX_BUDGETS];
+};
+
+static int budget_matches(struct budget *b, const char *name)
+{
+	size_t len = strlen(b->name);
+
+	if (len && b->name[len - 1] == '*')
+		return (strncmp(b->name, name, len - 1) == 0);
+
+	return (strcmp(b->name, name) == 0);
+}
+
+/* the first focus task the sub-pattern is relevant to, or 0 */
+static pid_t relevant_task(struct budget_check *bc,
+			   struct subpattern_instance *sp_inst)
+{
+	const struct subpattern_ops *ops = sp_inst->def->ops;
+	int i;
+
+	for (i = 0; i < bc->ntasks; i++) {
+		if (!ops->is_relevant ||
+		    ops->is_relevant(bc->tasks[i], sp_inst->data) ||
+		    ops->is_relevant(bc->tasks[i], sp_inst->partner->data)) {
+			return bc->tasks[i];
+		}
+	}
+
+	return 0;
+}
+
+static void bg_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct budget_check *bc = data;
+	const char *name = sp_inst->def->name;
+	unsigned long long overhead;
+	unsigned long long duration;
+	unsigned long long begin;
+	unsigned long long end;
+	struct budget_stat *st;
+	char reason[128];
+	struct budget *b;
+	pid_t task;
+	int i;
+
+	for (i = 0; i < bc->nr_budgets; i++) {
+		if (budget_matches(&bc->budgets[i], name))
+			break;
+	}
+	if (i == bc->nr_budgets)
+		return;
+
+	begin = ts_to_ns(&sp_inst->ts);
+	end = ts_to_ns(&sp_inst->partner->ts);
+
+	task = relevant_task(bc, sp_inst);
+	if (!task)
+		return;
+
+	/* the tracing overhead (-O) is an estimate, only annotate it */
+	duration = end - begin;
+	overhead = subpattern_overhead(bc->lc, sp_inst);
+	if (overhead > duration)
+		overhead = duration;
+
+	for (; i < bc->nr_budgets; i++) {
+		b = &bc->budgets[i];
+		if (!budget_matches(b, name) || duration <= b->limit)
+			continue;
+
+		st = &bc->stats[i];
+		st->violations++;
+		if (duration > st->worst) {
+			st->worst = duration;
+			st->worst_ts = begin;
+			st->worst_task = task;
+		}
+
+		if (overhead) {
+			snprintf(reason, sizeof(reason),
+				 "budget violation: %s %llu us > %llu us"
+				 " (task %u, ~%llu us of it tracing overhead)",
+				 name, duration / 1000, b->limit / 1000, task,
+				 overhead / 1000);
+		} else {
+			snprintf(reason, sizeof(reason),
+				 "budget violation: %s %llu us > %llu us"
+				 " (task %u)", name, duration / 1000,
+				 b->limit / 1000, task);
+		}
+		subpattern_request_window(bc->lc, &sp_inst->ts,
+					  &sp_inst->partner->ts, reason);
+	}
+}
+
+static void bg_report(void *data)
+{
+	struct budget_check *bc = data;
+	struct budget_stat *st;
+	int i;
+
+	printf("latency budgets:\n\n");
+	printf("%-24s %10s %10s %10s\n", "sub-pattern", "budget us",
+	       "violations", "worst us");
+
+	for (i = 0; i < bc->nr_budgets; i++) {
+		st = &bc->stats[i];
+
+		printf("%-24s %10llu %10lu %10llu", bc->budgets[i].name,
+		       bc->budgets[i].limit / 1000, st->violations,
+		       st->worst / 1000);
+		if (st->violations) {
+			printf("  task %u at %llu.%06llu", st->worst_task,
+			       st->worst_ts / 1000000000ULL,
+			       (st->worst_ts % 1000000000ULL) / 1000);
+		}
+		printf("\n");
+	}
+
+	printf("\n");
+}
+
+static void *bg_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	const struct latcheck_config *cfg = subpattern_config(lc);
+	struct budget_check *bc;
+	struct budget *b;
+	int i;
+
+	/* nothing to check */
+	if (!cfg->nr_budgets)
+		return NULL;
+
+	bc = calloc(1, sizeof(*bc));
+	if (!bc) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	for (i = 0; i < cfg->nr_budgets && i < MAX_BUDGETS; i++) {
+		b = &bc->budgets[i];
+		b->name = strdup(cfg->budgets[i].name);
+		if (!b->name) {
+			fprintf(stderr, "strdup failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		b->limit = cfg->budgets[i].us * 1000ULL;
+	}
+	bc->nr_budgets = i;
+
+	bc->lc = lc;
+	bc->tasks = tasks;
+	bc->ntasks = ntasks;
+
+	return bc;
+}
+
+static void bg_free_data(void *data)
+{
+	struct budget_check *bc = data;
+	int i;
+
+	if (!bc)
+		return;
+
+	for (i = 0; i < bc->nr_budgets; i++)
+		free(bc->budgets[i].name);
+	free(bc);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = bg_init,
+	.closed = bg_closed,
+	.report = bg_report,
+	.free_data = bg_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "budget",
+	.ops = &pat_ops,
+};
+
+int register_budget(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
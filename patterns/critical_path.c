@@ -0,0 +1,811 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "latcheck.h"
+#include "util.h"
+#include "pattern.h"
+
+/*
+ * Walk the wakeup edges backwards from every significant sched_out of
+ * a focus task and blame its off-CPU time:
+ *
+ * - The runnable part (from the wakeup to being scheduled in) is blamed
+ *   on the task the CPU was switched from ("runqueue"), or on "idle".
+ * - The sleep is blamed on the waker. If the wakeup came from an
+ *   interrupt, softirq or timer callback, on that context. If it came
+ *   from a task, the waker is followed backwards in time: while it ran
+ *   it is blamed ("running"), while it was off-CPU itself its own
+ *   wakeup is followed in the same way, until the beginning of the
+ *   sleep of the focus task is reached.
+ *
+ * This needs the sched_switch and sched_wakeup events of all tasks.
+ * Interrupt contexts are known from the irq_handler, softirq and
+ * hrtimer_expire entry/exit events; without them, a wakeup from an
+ * interrupt is blamed on the interrupted task (or on idle).
+ */
+
+#define SWITCH_STR " sched_switch: "
+#define WAKEUP_STR " sched_wakeup: "
+#define ENTRY_STR "_entry: "
+#define EXIT_STR "_exit: "
+#define IRQ_ENTRY_STR " irq_handler_entry: "
+#define IRQ_EXIT_STR " irq_handler_exit: "
+#define SOFTIRQ_ENTRY_STR " softirq_entry: "
+#define SOFTIRQ_EXIT_STR " softirq_exit: "
+#define TIMER_ENTRY_STR " hrtimer_expire_entry: "
+#define TIMER_EXIT_STR " hrtimer_expire_exit: "
+
+#define MAX_PATH_DEPTH 16
+#define MAX_CTX_DEPTH 4
+#define MAX_PATH_TOP 3
+#define TASK_HASH 1024
+
+enum blame_kind {
+	BLAME_RUNNING,
+	BLAME_RUNQUEUE,
+	BLAME_IDLE,
+	BLAME_IRQ,
+	BLAME_SOFTIRQ,
+	BLAME_TIMER,
+};
+
+static const char *kind_names[] = {
+	"running", "runqueue", "idle", "irq", "softirq", "timer",
+};
+
+/* an interrupt context (interned) */
+struct context {
+	int kind;
+	char name[32];
+};
+
+/* a task off-CPU: switched out, woken and switched in again */
+struct offcpu {
+	unsigned long long begin;
+	unsigned long long wake;
+	unsigned long long end;
+	pid_t waker;
+	pid_t prev;
+	int ctx;
+	int runnable;
+};
+
+struct task_hist {
+	pid_t pid;
+	char comm[16];
+	struct offcpu *off;
+	int nr_off;
+	struct task_hist *next;
+};
+
+struct cpu_ctx {
+	int ctx[MAX_CTX_DEPTH];
+	int depth;
+};
+
+struct blame {
+	int kind;
+	pid_t task;
+	char who[32];
+	unsigned long long ns;
+	unsigned long long max;
+	unsigned long sched_outs;
+};
+
+struct path {
+	pid_t task;
+	unsigned long long begin;
+	unsigned long long end;
+	struct blame top[MAX_PATH_TOP];
+	int nr_top;
+};
+
+struct critical_path {
+	const pid_t *tasks;
+	int ntasks;
+
+	struct task_hist *hash[TASK_HASH];
+	struct cpu_ctx *cpus;
+	int nr_cpus;
+	struct context *ctxs;
+	int nr_ctxs;
+
+	/* the walk in progress */
+	struct blame *walk;
+	int nr_walk;
+
+	struct blame *blames;
+	int nr_blames;
+	struct path *paths;
+	int nr_paths;
+	unsigned long long total;
+};
+
+static struct task_hist *find_task(struct critical_path *cp, pid_t pid,
+				   int create)
+{
+	struct task_hist **head = &cp->hash[pid % TASK_HASH];
+	struct task_hist *t;
+
+	for (t = *head; t; t = t->next) {
+		if (t->pid == pid)
+			return t;
+	}
+
+	if (!create)
+		return NULL;
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	t->pid = pid;
+	t->next = *head;
+	*head = t;
+
+	return t;
+}
+
+static struct cpu_ctx *get_cpu(struct critical_path *cp, int cpu)
+{
+	struct cpu_ctx *cpus;
+
+	if (cpu < 0)
+		return NULL;
+
+	if (cpu >= cp->nr_cpus) {
+		cpus = realloc(cp->cpus, (cpu + 1) * sizeof(*cpus));
+		if (!cpus) {
+			fprintf(stderr, "realloc failed: %s\n",
+				strerror(errno));
+			return NULL;
+		}
+		memset(&cpus[cp->nr_cpus], 0,
+		       (cpu + 1 - cp->nr_cpus) * sizeof(*cpus));
+		cp->cpus = cpus;
+		cp->nr_cpus = cpu + 1;
+	}
+
+	return &cp->cpus[cpu];
+}
+
+static int intern_ctx(struct critical_path *cp, int kind, const char *name)
+{
+	struct context *c;
+	int i;
+
+	for (i = 0; i < cp->nr_ctxs; i++) {
+		if (cp->ctxs[i].kind == kind &&
+		    strcmp(cp->ctxs[i].name, name) == 0) {
+			return i;
+		}
+	}
+
+	c = array_grow(cp->ctxs, cp->nr_ctxs, sizeof(*c));
+	if (!c)
+		return -1;
+	cp->ctxs = c;
+
+	c = &cp->ctxs[cp->nr_ctxs];
+	c->kind = kind;
+	snprintf(c->name, sizeof(c->name), "%s", name);
+
+	return cp->nr_ctxs++;
+}
+
+/* the current off-CPU period of a task, NULL if running */
+static struct offcpu *current_off(struct task_hist *t)
+{
+	struct offcpu *off;
+
+	if (!t || !t->nr_off)
+		return NULL;
+
+	off = &t->off[t->nr_off - 1];
+
+	return off->end ? NULL : off;
+}
+
+static void handle_switch(struct critical_path *cp, const char *traceline,
+			  unsigned long long ns)
+{
+	unsigned long prev_pid;
+	unsigned long next_pid;
+	struct task_hist *t;
+	struct offcpu *off;
+	char comm[16];
+	char state[8];
+
+	if (trace_field_ul(traceline, " prev_pid=", &prev_pid) != 0 ||
+	    trace_field_str(traceline, " prev_state=", state,
+			    sizeof(state)) != 0 ||
+	    trace_field_ul(traceline, " next_pid=", &next_pid) != 0) {
+		return;
+	}
+
+	/* the idle task is never waited for */
+	t = prev_pid ? find_task(cp, prev_pid, 1) : NULL;
+	if (t) {
+		if (trace_field_str(traceline, " prev_comm=", comm,
+				    sizeof(comm)) == 0) {
+			strcpy(t->comm, comm);
+		}
+
+		off = array_grow(t->off, t->nr_off, sizeof(*off));
+		if (off) {
+			t->off = off;
+			off = &t->off[t->nr_off++];
+			memset(off, 0, sizeof(*off));
+			off->begin = ns;
+			off->ctx = -1;
+			off->runnable = (state[0] == 'R');
+		}
+	}
+
+	t = next_pid ? find_task(cp, next_pid, 1) : NULL;
+	if (t) {
+		if (trace_field_str(traceline, " next_comm=", comm,
+				    sizeof(comm)) == 0) {
+			strcpy(t->comm, comm);
+		}
+
+		off = current_off(t);
+		if (off) {
+			off->end = ns;
+			off->prev = prev_pid;
+		}
+	}
+}
+
+static void handle_wakeup(struct critical_path *cp, const char *traceline,
+			  unsigned long long ns, int cpu, pid_t task)
+{
+	struct cpu_ctx *cc;
+	struct offcpu *off;
+	unsigned long pid;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0)
+		return;
+
+	off = current_off(find_task(cp, pid, 0));
+	if (!off || off->runnable || off->wake)
+		return;
+
+	off->wake = ns;
+	off->waker = task;
+
+	cc = get_cpu(cp, cpu);
+	if (cc && cc->depth)
+		off->ctx = cc->ctx[cc->depth - 1];
+}
+
+static void push_ctx(struct critical_path *cp, int cpu, int kind,
+		     const char *name)
+{
+	struct cpu_ctx *cc = get_cpu(cp, cpu);
+
+	if (!cc || cc->depth >= MAX_CTX_DEPTH)
+		return;
+
+	cc->ctx[cc->depth++] = intern_ctx(cp, kind, name);
+}
+
+/* leave the innermost context of a kind (entries may have been lost) */
+static void pop_ctx(struct critical_path *cp, int cpu, int kind)
+{
+	struct cpu_ctx *cc = get_cpu(cp, cpu);
+	int i;
+
+	if (!cc)
+		return;
+
+	for (i = cc->depth - 1; i >= 0; i--) {
+		if (cc->ctx[i] >= 0 && cp->ctxs[cc->ctx[i]].kind == kind) {
+			cc->depth = i;
+			return;
+		}
+	}
+}
+
+static void handle_entry(struct critical_path *cp, const char *traceline,
+			 int cpu)
+{
+	char name[32];
+	char *p;
+
+	if (strstr(traceline, IRQ_ENTRY_STR)) {
+		if (trace_field_str(traceline, " name=", name,
+				    sizeof(name)) != 0) {
+			strcpy(name, "?");
+		}
+		push_ctx(cp, cpu, BLAME_IRQ, name);
+	} else if (strstr(traceline, SOFTIRQ_ENTRY_STR)) {
+		/* "vec=1 [action=TIMER]" */
+		if (trace_field_str(traceline, " [action=", name,
+				    sizeof(name)) != 0) {
+			strcpy(name, "?");
+		}
+		p = strchr(name, ']');
+		if (p)
+			*p = 0;
+		push_ctx(cp, cpu, BLAME_SOFTIRQ, name);
+	} else if (strstr(traceline, TIMER_ENTRY_STR)) {
+		/* "function=hrtimer_wakeup/0x0" */
+		if (trace_field_str(traceline, " function=", name,
+				    sizeof(name)) != 0) {
+			strcpy(name, "?");
+		}
+		p = strchr(name, '/');
+		if (p)
+			*p = 0;
+		push_ctx(cp, cpu, BLAME_TIMER, name);
+	}
+}
+
+static void handle_exit(struct critical_path *cp, const char *traceline,
+			int cpu)
+{
+	if (strstr(traceline, IRQ_EXIT_STR))
+		pop_ctx(cp, cpu, BLAME_IRQ);
+	else if (strstr(traceline, SOFTIRQ_EXIT_STR))
+		pop_ctx(cp, cpu, BLAME_SOFTIRQ);
+	else if (strstr(traceline, TIMER_EXIT_STR))
+		pop_ctx(cp, cpu, BLAME_TIMER);
+}
+
+static void cp_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct critical_path *cp = data;
+
+	(void)ev;
+
+	if (strstr(traceline, SWITCH_STR))
+		handle_switch(cp, traceline, ts_to_ns(ts));
+	else if (strstr(traceline, WAKEUP_STR))
+		handle_wakeup(cp, traceline, ts_to_ns(ts), cpu, task);
+	else if (strstr(traceline, ENTRY_STR))
+		handle_entry(cp, traceline, cpu);
+	else if (strstr(traceline, EXIT_STR))
+		handle_exit(cp, traceline, cpu);
+}
+
+static void blame_add(struct critical_path *cp, int kind, pid_t task,
+		      const char *who, unsigned long long ns)
+{
+	struct blame *b;
+	int i;
+
+	if (!ns)
+		return;
+
+	for (i = 0; i < cp->nr_walk; i++) {
+		b = &cp->walk[i];
+		if (b->kind == kind && b->task == task &&
+		    strcmp(b->who, who) == 0) {
+			b->ns += ns;
+			return;
+		}
+	}
+
+	b = array_grow(cp->walk, cp->nr_walk, sizeof(*b));
+	if (!b)
+		return;
+	cp->walk = b;
+
+	b = &cp->walk[cp->nr_walk++];
+	memset(b, 0, sizeof(*b));
+	b->kind = kind;
+	b->task = task;
+	snprintf(b->who, sizeof(b->who), "%s", who);
+	b->ns = ns;
+}
+
+static void blame_task(struct critical_path *cp, int kind, pid_t pid,
+		       unsigned long long ns)
+{
+	struct task_hist *t = find_task(cp, pid, 0);
+	char who[32];
+
+	if (!pid) {
+		blame_add(cp, BLAME_IDLE, 0, "<idle>", ns);
+		return;
+	}
+
+	snprintf(who, sizeof(who), "%s-%u", t && t->comm[0] ? t->comm : "?",
+		 pid);
+	blame_add(cp, kind, pid, who, ns);
+}
+
+/* blame the runnable part [lo, hi] of an off-CPU period */
+static void blame_runnable(struct critical_path *cp, struct offcpu *off,
+			   unsigned long long lo, unsigned long long hi)
+{
+	if (hi > lo)
+		blame_task(cp, BLAME_RUNQUEUE, off->prev, hi - lo);
+}
+
+static void follow_task(struct critical_path *cp, pid_t pid,
+			unsigned long long lo, unsigned long long t,
+			int depth);
+
+/* blame [lo, hi] on the wakeup ending the sleep of an off-CPU period */
+static void blame_wakeup(struct critical_path *cp, struct offcpu *off,
+			 unsigned long long lo, unsigned long long hi,
+			 int depth)
+{
+	struct context *c;
+
+	if (hi <= lo)
+		return;
+
+	if (off->ctx >= 0) {
+		c = &cp->ctxs[off->ctx];
+		blame_add(cp, c->kind, 0, c->name, hi - lo);
+		return;
+	}
+
+	if (depth >= MAX_PATH_DEPTH) {
+		blame_task(cp, BLAME_RUNNING, off->waker, hi - lo);
+		return;
+	}
+
+	follow_task(cp, off->waker, lo, hi, depth + 1);
+}
+
+/* the last off-CPU period of a task that ended at or before "t" */
+static int last_off_before(struct task_hist *t, unsigned long long ts)
+{
+	int lo = 0;
+	int hi = t->nr_off - 1;
+	int mid;
+
+	/* the last period that began before "ts" */
+	if (hi < 0 || t->off[0].begin >= ts)
+		return -1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (t->off[mid].begin < ts)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	while (lo >= 0 && (!t->off[lo].end || t->off[lo].end > ts))
+		lo--;
+
+	return lo;
+}
+
+/* the task ran (or was off-CPU itself) from "lo" to "t", walk backwards */
+static void follow_task(struct critical_path *cp, pid_t pid,
+			unsigned long long lo, unsigned long long t,
+			int depth)
+{
+	struct task_hist *task = find_task(cp, pid, 0);
+	unsigned long long from;
+	struct offcpu *off;
+	int i;
+
+	if (!pid) {
+		blame_add(cp, BLAME_IDLE, 0, "<idle>", t - lo);
+		return;
+	}
+
+	i = task ? last_off_before(task, t) : -1;
+	for (; t > lo; i--) {
+		if (i < 0 || task->off[i].end <= lo) {
+			blame_task(cp, BLAME_RUNNING, pid, t - lo);
+			return;
+		}
+		off = &task->off[i];
+
+		blame_task(cp, BLAME_RUNNING, pid, t - off->end);
+
+		from = off->wake ? off->wake : off->begin;
+		blame_runnable(cp, off, from > lo ? from : lo, off->end);
+		if (off->wake && off->wake > lo) {
+			blame_wakeup(cp, off,
+				     off->begin > lo ? off->begin : lo,
+				     off->wake, depth);
+		}
+
+		t = off->begin;
+	}
+}
+
+static int cmp_off(const void *lhs, const void *rhs)
+{
+	const struct offcpu *l = lhs;
+	const struct offcpu *r = rhs;
+
+	if (l->begin != r->begin)
+		return (l->begin < r->begin) ? -1 : 1;
+
+	return 0;
+}
+
+/* the off-CPU period of a task beginning at "ts" */
+static struct offcpu *find_off(struct task_hist *t, unsigned long long ts)
+{
+	struct offcpu key;
+
+	key.begin = ts;
+
+	return bsearch(&key, t->off, t->nr_off, sizeof(*t->off), cmp_off);
+}
+
+static int cmp_blame(const void *lhs, const void *rhs)
+{
+	const struct blame *l = lhs;
+	const struct blame *r = rhs;
+
+	if (l->ns != r->ns)
+		return (l->ns < r->ns) ? 1 : -1;
+
+	return 0;
+}
+
+/* add the blames of a finished walk to the table */
+static void merge_walk(struct critical_path *cp)
+{
+	struct blame *walk;
+	struct blame *b;
+	int i;
+	int j;
+
+	for (i = 0; i < cp->nr_walk; i++) {
+		walk = &cp->walk[i];
+
+		for (j = 0; j < cp->nr_blames; j++) {
+			b = &cp->blames[j];
+			if (b->kind == walk->kind && b->task == walk->task &&
+			    strcmp(b->who, walk->who) == 0) {
+				break;
+			}
+		}
+		if (j == cp->nr_blames) {
+			b = array_grow(cp->blames, cp->nr_blames,
+				       sizeof(*b));
+			if (!b)
+				return;
+			cp->blames = b;
+			b = &cp->blames[cp->nr_blames++];
+			*b = *walk;
+			b->ns = 0;
+		}
+		b = &cp->blames[j];
+
+		b->ns += walk->ns;
+		b->sched_outs++;
+		if (walk->ns > b->max)
+			b->max = walk->ns;
+	}
+}
+
+static int is_sched_out(struct subpattern_instance *sp_inst)
+{
+	return (strncmp(sp_inst->def->name, "sched_out_", 10) == 0);
+}
+
+static void cp_significant(void *data, struct subpattern_instance *sp_inst,
+			   pid_t focus_task)
+{
+	struct critical_path *cp = data;
+	struct task_hist *t;
+	struct offcpu *off;
+	struct path *path;
+	int i;
+
+	if (sp_inst->bound != in || !sp_inst->partner ||
+	    !is_sched_out(sp_inst) || !sp_inst->def->ops->sched_out ||
+	    sp_inst->def->ops->sched_out(focus_task, sp_inst->data) <= 0) {
+		return;
+	}
+
+	/* the off-CPU period beginning with this sched_out */
+	t = find_task(cp, focus_task, 0);
+	off = t ? find_off(t, ts_to_ns(&sp_inst->ts)) : NULL;
+	if (!off || !off->end)
+		return;
+	cp->nr_walk = 0;
+	if (off->wake) {
+		blame_runnable(cp, off, off->wake, off->end);
+		blame_wakeup(cp, off, off->begin, off->wake, 0);
+	} else {
+		blame_runnable(cp, off, off->begin, off->end);
+	}
+	if (!cp->nr_walk)
+		return;
+
+	merge_walk(cp);
+	cp->total += off->end - off->begin;
+
+	path = array_grow(cp->paths, cp->nr_paths, sizeof(*path));
+	if (!path)
+		return;
+	cp->paths = path;
+
+	path = &cp->paths[cp->nr_paths++];
+	path->task = focus_task;
+	path->begin = off->begin;
+	path->end = off->end;
+
+	qsort(cp->walk, cp->nr_walk, sizeof(*cp->walk), cmp_blame);
+	for (i = 0; i < cp->nr_walk && i < MAX_PATH_TOP; i++)
+		path->top[i] = cp->walk[i];
+	path->nr_top = i;
+}
+
+static void cp_report(void *data)
+{
+	struct critical_path *cp = data;
+	struct path *path;
+	struct blame *b;
+	int i;
+	int j;
+
+	if (!cp->nr_paths)
+		return;
+
+	printf("critical path of significant sched_outs:\n\n");
+	for (i = 0; i < cp->nr_paths; i++) {
+		path = &cp->paths[i];
+
+		printf("%llu.%06llu task %u off-cpu %llu us:",
+		       path->begin / 1000000000ULL,
+		       path->begin % 1000000000ULL / 1000, path->task,
+		       (path->end - path->begin) / 1000);
+		for (j = 0; j < path->nr_top; j++) {
+			printf("%s %s %s %llu us", j ? "," : "",
+			       kind_names[path->top[j].kind],
+			       path->top[j].who, path->top[j].ns / 1000);
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	qsort(cp->blames, cp->nr_blames, sizeof(*cp->blames), cmp_blame);
+
+	printf("critical path blame (%d sched_outs, %llu us off-cpu):\n\n",
+	       cp->nr_paths, cp->total / 1000);
+	printf("%-9s %-24s %10s %6s %10s %10s\n", "kind", "who", "total us",
+	       "%", "sched_outs", "max us");
+	for (i = 0; i < cp->nr_blames; i++) {
+		b = &cp->blames[i];
+
+		printf("%-9s %-24s %10llu %6.1f %10lu %10llu\n",
+		       kind_names[b->kind], b->who, b->ns / 1000,
+		       cp->total ? 100.0 * b->ns / cp->total : 0.0,
+		       b->sched_outs, b->max / 1000);
+	}
+	printf("\n");
+}
+
+static void cp_prune(void *data, unsigned long long before)
+{
+	struct critical_path *cp = data;
+	struct task_hist *t;
+	int i;
+	int j;
+	int n;
+
+	for (i = 0; i < TASK_HASH; i++) {
+		for (t = cp->hash[i]; t; t = t->next) {
+			for (j = 0, n = 0; j < t->nr_off; j++) {
+				if (!t->off[j].end || t->off[j].end >= before)
+					t->off[n++] = t->off[j];
+			}
+			t->nr_off = n;
+		}
+	}
+}
+
+static void *cp_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct critical_path *cp;
+
+	/* it traces the wakeups and switches of all tasks, so it is opt-in */
+	if (!(subpattern_config(lc)->flags & SP_CRITICAL_PATH))
+		return NULL;
+
+	cp = calloc(1, sizeof(*cp));
+	if (!cp) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	cp->tasks = tasks;
+	cp->ntasks = ntasks;
+
+	return cp;
+}
+
+static int cp_enable(void *data, const char *tracingpath)
+{
+	int ret = 0;
+
+	(void)data;
+
+	/* the wakeups and switches of all tasks, the interrupt contexts */
+	ret |= set_tracing(tracingpath, "events/sched/sched_wakeup/filter",
+			   "0");
+	ret |= set_tracing(tracingpath, "events/sched/sched_switch/filter",
+			   "0");
+	ret |= set_tracing(tracingpath, "events/irq/irq_handler_entry/enable",
+			   "1\n");
+	ret |= set_tracing(tracingpath, "events/irq/irq_handler_exit/enable",
+			   "1\n");
+	ret |= set_tracing(tracingpath, "events/irq/softirq_entry/enable",
+			   "1\n");
+	ret |= set_tracing(tracingpath, "events/irq/softirq_exit/enable",
+			   "1\n");
+
+	return ret;
+}
+
+static void cp_free_data(void *data)
+{
+	struct critical_path *cp = data;
+	struct task_hist *t;
+	struct task_hist *next;
+	int i;
+
+	if (!cp)
+		return;
+
+	for (i = 0; i < TASK_HASH; i++) {
+		for (t = cp->hash[i]; t; t = next) {
+			next = t->next;
+			free(t->off);
+			free(t);
+		}
+	}
+	free(cp->cpus);
+	free(cp->ctxs);
+	free(cp->walk);
+	free(cp->blames);
+	free(cp->paths);
+	free(cp);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = cp_init,
+	.enable = cp_enable,
+	.traceline = cp_traceline,
+	.significant = cp_significant,
+	.report = cp_report,
+	.prune = cp_prune,
+	.free_data = cp_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "critical_path",
+	.ops = &pat_ops,
+};
+
+int register_critical_path(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "latcheck.h"
+#include "util.h"
+#include "pattern.h"
+#include "subpatterns/hrtimer.h"
+
+/*
+ * Split the trace of cyclic focus tasks into cycles. A cycle begins
+ * when the task returns from a sleep syscall (nanosleep or
+ * clock_nanosleep) or, if the task writes "latcheck:cycle" to the
+ * trace_marker, at every such marker. Its work time lasts until the
+ * task enters the next sleep.
+ *
+ * The wakeup jitter of a cycle is measured against the requested
+ * expiry of the timer of the sleep if it is known (see the
+ * hrtimer_expiry sub-pattern), else against the start of the previous
+ * cycle plus the period. The period is given with --period or detected
+ * as the median of the first intervals between cycles; a task is not
+ * considered cyclic if too many of them are off the median. Cycles with a
+ * jitter above --jitter (default: a tenth of the period) are outliers,
+ * and their trace windows are requested to be reported.
+ */
+
+#define SYS_ENTER_STR " sys_enter: NR "
+#define SYS_EXIT_STR " sys_exit: NR "
+#define MARKER_STR " tracing_mark_write: "
+#define CYCLE_STR "latcheck:cycle"
+
+/* the sleep syscall numbers (see syscalls.txt) */
+#define NR_NANOSLEEP 162
+#define NR_CLOCK_NANOSLEEP 267
+
+/* intervals between cycles needed to detect the period */
+#define DETECT_INTERVALS 8
+/* ... of which this many must be within a quarter of the period */
+#define DETECT_MATCHES 6
+
+/* outlier cycles listed in the report */
+#define MAX_OUTLIERS 16
+
+#define MAX_LOG2 32
+
+struct cycle {
+	unsigned long nr;
+	unsigned long long start;
+	unsigned long long interval;
+	unsigned long long work;
+	long long jitter;
+	int has_jitter;
+	int timer;
+};
+
+struct cycle_stat {
+	unsigned long samples;
+	long long total;
+	long long min;
+	long long max;
+	unsigned long log2[MAX_LOG2];
+};
+
+struct cycle_task {
+	/* cycles are delimited by trace markers */
+	int markers;
+
+	/* in a sleep syscall, with the requested expiry if known */
+	int sleeping;
+	int has_expiry;
+	unsigned long long expiry;
+
+	unsigned long long period;
+	int aperiodic;
+	unsigned long nr_cycles;
+	struct cycle last;
+
+	/* the cycles seen before the period is known */
+	struct cycle detect[DETECT_INTERVALS + 1];
+	int nr_detect;
+
+	struct cycle_stat jitter_st;
+	struct cycle_stat work_st;
+
+	/* the first outliers (of the retained history) are listed */
+	struct cycle outliers[MAX_OUTLIERS];
+	unsigned long nr_listed;
+	unsigned long nr_outliers;
+};
+
+struct cycles {
+	struct latcheck *lc;
+	const pid_t *tasks;
+	int ntasks;
+	struct cycle_task *focus;
+
+	/* the given period and outlier jitter (0: detected, a tenth) */
+	unsigned long long period_ns;
+	unsigned long long jitter_ns;
+};
+
+static int focus_index(struct cycles *cs, pid_t task)
+{
+	int i;
+
+	for (i = 0; i < cs->ntasks; i++) {
+		if (cs->tasks[i] == task)
+			return i;
+	}
+
+	return -1;
+}
+
+static int log2_bucket(unsigned long long val)
+{
+	int i = 0;
+
+	while (val > 1 && i < MAX_LOG2 - 1) {
+		val >>= 1;
+		i++;
+	}
+
+	return i;
+}
+
+static void stat_add(struct cycle_stat *st, long long ns)
+{
+	if (!st->samples || ns < st->min)
+		st->min = ns;
+	if (!st->samples || ns > st->max)
+		st->max = ns;
+	st->samples++;
+	st->total += ns;
+	st->log2[log2_bucket((ns < 0 ? -ns : ns) / 1000)]++;
+}
+
+static unsigned long long outlier_limit(struct cycles *cs,
+					struct cycle_task *ct)
+{
+	return cs->jitter_ns ? cs->jitter_ns : ct->period / 10;
+}
+
+static void ns_to_ts(unsigned long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/* account the jitter of a cycle once the period is known */
+static void judge_cycle(struct cycles *cs, struct cycle_task *ct, pid_t task,
+			struct cycle *c)
+{
+	struct timespec begin;
+	struct timespec end;
+	char reason[128];
+
+	if (!c->timer && c->interval) {
+		c->jitter = (long long)c->interval - (long long)ct->period;
+		c->has_jitter = 1;
+	}
+	if (!c->has_jitter)
+		return;
+
+	stat_add(&ct->jitter_st, c->jitter);
+
+	if (c->jitter <= (long long)outlier_limit(cs, ct))
+		return;
+
+	if (ct->nr_listed < MAX_OUTLIERS)
+		ct->outliers[ct->nr_listed++] = *c;
+	ct->nr_outliers++;
+
+	snprintf(reason, sizeof(reason),
+		 "cycle %lu of task %u: wakeup jitter %lld us > %llu us",
+		 c->nr, task, c->jitter / 1000, outlier_limit(cs, ct) / 1000);
+	ns_to_ts(c->start - c->jitter, &begin);
+	ns_to_ts(c->start, &end);
+	subpattern_request_window(cs->lc, &begin, &end, reason);
+}
+
+static int cmp_interval(const void *lhs, const void *rhs)
+{
+	const struct cycle *l = lhs;
+	const struct cycle *r = rhs;
+
+	if (l->interval != r->interval)
+		return (l->interval < r->interval) ? -1 : 1;
+
+	return 0;
+}
+
+/* the median of the intervals between the first cycles */
+static void detect_period(struct cycles *cs, struct cycle_task *ct, pid_t task)
+{
+	struct cycle sorted[DETECT_INTERVALS + 1];
+	unsigned long long median;
+	unsigned long long diff;
+	int matches = 0;
+	int i;
+
+	memcpy(sorted, ct->detect, sizeof(sorted));
+	qsort(&sorted[1], DETECT_INTERVALS, sizeof(sorted[0]), cmp_interval);
+	median = sorted[1 + DETECT_INTERVALS / 2].interval;
+
+	for (i = 1; i <= DETECT_INTERVALS; i++) {
+		diff = (sorted[i].interval > median) ?
+		       sorted[i].interval - median :
+		       median - sorted[i].interval;
+		if (diff <= median / 4)
+			matches++;
+	}
+	ct->nr_detect = 0;
+	if (matches < DETECT_MATCHES) {
+		ct->aperiodic = 1;
+		return;
+	}
+	ct->period = median;
+
+	for (i = 0; i <= DETECT_INTERVALS; i++)
+		judge_cycle(cs, ct, task, &ct->detect[i]);
+}
+
+static void begin_cycle(struct cycles *cs, struct cycle_task *ct, pid_t task,
+			unsigned long long ns)
+{
+	struct cycle *c = &ct->last;
+
+	if (ct->aperiodic)
+		return;
+
+	if (ct->nr_cycles)
+		c->interval = ns - c->start;
+	else
+		c->interval = 0;
+	c->nr = ct->nr_cycles++;
+	c->start = ns;
+	c->work = 0;
+	c->has_jitter = 0;
+	c->timer = 0;
+
+	if (ct->has_expiry && ns >= ct->expiry) {
+		c->jitter = ns - ct->expiry;
+		c->has_jitter = 1;
+		c->timer = 1;
+	}
+	ct->has_expiry = 0;
+
+	if (ct->period) {
+		judge_cycle(cs, ct, task, c);
+		return;
+	}
+
+	/* the first cycle has no interval */
+	ct->detect[ct->nr_detect++] = *c;
+	if (ct->nr_detect == DETECT_INTERVALS + 1)
+		detect_period(cs, ct, task);
+}
+
+/* the work of the current cycle ends with the next sleep */
+static void end_work(struct cycle_task *ct, unsigned long long ns)
+{
+	struct cycle *c = &ct->last;
+	unsigned long i;
+
+	if (!ct->nr_cycles || c->work)
+		return;
+
+	c->work = ns - c->start;
+	stat_add(&ct->work_st, c->work);
+
+	if (ct->nr_detect)
+		ct->detect[ct->nr_detect - 1].work = c->work;
+
+	/* the cycle may already be listed as outlier */
+	i = ct->nr_listed;
+	if (i && ct->outliers[i - 1].nr == c->nr)
+		ct->outliers[i - 1].work = c->work;
+}
+
+static int is_sleep_nr(const char *p)
+{
+	unsigned long nr = strtoul(p, NULL, 10);
+
+	return (nr == NR_NANOSLEEP || nr == NR_CLOCK_NANOSLEEP);
+}
+
+static int is_marker(const char *p, const char *marker)
+{
+	size_t len = strlen(marker);
+
+	if (strncmp(p, marker, len) != 0)
+		return 0;
+
+	return (p[len] == 0 || p[len] == '\n' || p[len] == ' ');
+}
+
+static void cs_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct cycles *cs = data;
+	struct cycle_task *ct;
+	const char *p;
+	int fi;
+
+	(void)ev;
+	(void)cpu;
+
+	fi = focus_index(cs, task);
+	if (fi < 0)
+		return;
+	ct = &cs->focus[fi];
+
+	p = strstr(traceline, SYS_ENTER_STR);
+	if (p) {
+		if (is_sleep_nr(p + strlen(SYS_ENTER_STR))) {
+			end_work(ct, ts_to_ns(ts));
+			ct->sleeping = 1;
+			ct->has_expiry = 0;
+		}
+		return;
+	}
+
+	p = strstr(traceline, SYS_EXIT_STR);
+	if (p) {
+		if (ct->sleeping && is_sleep_nr(p + strlen(SYS_EXIT_STR))) {
+			ct->sleeping = 0;
+			if (!ct->markers)
+				begin_cycle(cs, ct, task, ts_to_ns(ts));
+		}
+		return;
+	}
+
+	p = strstr(traceline, MARKER_STR);
+	if (!p || !is_marker(p + strlen(MARKER_STR), CYCLE_STR))
+		return;
+
+	/* markers replace the cycles seen so far */
+	if (!ct->markers) {
+		memset(ct, 0, sizeof(*ct));
+		ct->period = cs->period_ns;
+		ct->markers = 1;
+	}
+	begin_cycle(cs, ct, task, ts_to_ns(ts));
+	ct->has_expiry = 0;
+}
+
+static void cs_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	const struct hrtimer_event *out;
+	const struct hrtimer_event *ev;
+	struct cycles *cs = data;
+	struct cycle_task *ct;
+	unsigned long long entry;
+	int fi;
+
+	ev = hrtimer_expiry_of(sp_inst);
+	if (!ev)
+		return;
+	out = hrtimer_expiry_of(sp_inst->partner);
+
+	fi = focus_index(cs, ev->task);
+	if (fi < 0)
+		return;
+	ct = &cs->focus[fi];
+
+	if (!ct->sleeping || out->cancelled || out->now < ev->expires)
+		return;
+
+	/* the requested expiry in the trace clock */
+	entry = ts_to_ns(&sp_inst->partner->ts);
+	ct->expiry = entry - (out->now - ev->expires);
+	ct->has_expiry = 1;
+}
+
+static void print_stat_line(const char *name, struct cycle_stat *st)
+{
+	printf("%-10s %10lld %10lld %10lld\n", name, st->min / 1000,
+	       st->total / (long long)st->samples / 1000, st->max / 1000);
+}
+
+static void print_hist(const char *name, struct cycle_stat *st)
+{
+	unsigned long width;
+	int i;
+	int j;
+
+	printf("%s:\n", name);
+
+	for (i = 0; i < MAX_LOG2; i++) {
+		if (!st->log2[i])
+			continue;
+
+		printf("  %8lu - %-8lu us %10lu ", i ? 1UL << i : 0UL,
+		       (2UL << i) - 1, st->log2[i]);
+
+		width = st->log2[i] * 40 / st->samples;
+		for (j = 0; j < (int)width; j++)
+			printf("#");
+		printf("\n");
+	}
+	printf("\n");
+}
+
+static void cs_report(void *data)
+{
+	struct cycles *cs = data;
+	struct cycle_task *ct;
+	struct cycle *c;
+	unsigned long i;
+	int fi;
+
+	for (fi = 0; fi < cs->ntasks; fi++) {
+		ct = &cs->focus[fi];
+		if (!ct->period || !ct->jitter_st.samples)
+			continue;
+
+		printf("cycles of task %u: %lu cycles, period %llu us (%s),"
+		       " %s\n\n", cs->tasks[fi], ct->nr_cycles,
+		       ct->period / 1000, cs->period_ns ? "given" : "detected",
+		       ct->markers ? "delimited by markers" :
+				     "delimited by sleeps");
+
+		printf("%-10s %10s %10s %10s\n", "us", "min", "avg", "max");
+		print_stat_line("jitter", &ct->jitter_st);
+		if (ct->work_st.samples)
+			print_stat_line("work", &ct->work_st);
+		printf("\n");
+
+		print_hist("wakeup jitter (absolute)", &ct->jitter_st);
+		if (ct->work_st.samples)
+			print_hist("work time", &ct->work_st);
+
+		if (!ct->nr_outliers)
+			continue;
+
+		printf("%lu outlier cycles with a wakeup jitter over %llu us:\n\n",
+		       ct->nr_outliers, outlier_limit(cs, ct) / 1000);
+		for (i = 0; i < ct->nr_listed; i++) {
+			c = &ct->outliers[i];
+
+			printf("%llu.%06llu cycle %lu jitter %lld us (%s)",
+			       c->start / 1000000000ULL,
+			       c->start % 1000000000ULL / 1000, c->nr,
+			       c->jitter / 1000,
+			       c->timer ? "timer" : "period");
+			if (c->work)
+				printf(" work %llu us", c->work / 1000);
+			printf("\n");
+		}
+		if (ct->nr_outliers > ct->nr_listed) {
+			printf("... and %lu more\n",
+			       ct->nr_outliers - ct->nr_listed);
+		}
+		printf("\n");
+	}
+}
+
+/* forget the outliers before the retained history */
+static void cs_prune(void *data, unsigned long long before)
+{
+	struct cycles *cs = data;
+	struct cycle_task *ct;
+	unsigned long i;
+	unsigned long n;
+	int fi;
+
+	for (fi = 0; fi < cs->ntasks; fi++) {
+		ct = &cs->focus[fi];
+
+		for (i = 0, n = 0; i < ct->nr_listed; i++) {
+			if (ct->outliers[i].start >= before)
+				ct->outliers[n++] = ct->outliers[i];
+		}
+		ct->nr_outliers -= ct->nr_listed - n;
+		ct->nr_listed = n;
+	}
+}
+
+static void *cs_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	const struct latcheck_config *cfg = subpattern_config(lc);
+	struct cycles *cs;
+	int i;
+
+	cs = calloc(1, sizeof(*cs));
+	if (!cs) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	cs->focus = calloc(ntasks, sizeof(*cs->focus));
+	if (!cs->focus) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		free(cs);
+		return NULL;
+	}
+
+	cs->period_ns = cfg->period_us * 1000ULL;
+	cs->jitter_ns = cfg->jitter_us * 1000ULL;
+	for (i = 0; i < ntasks; i++)
+		cs->focus[i].period = cs->period_ns;
+
+	cs->lc = lc;
+	cs->tasks = tasks;
+	cs->ntasks = ntasks;
+
+	return cs;
+}
+
+static void cs_free_data(void *data)
+{
+	struct cycles *cs = data;
+
+	if (!cs)
+		return;
+
+	free(cs->focus);
+	free(cs);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = cs_init,
+	.traceline = cs_traceline,
+	.closed = cs_closed,
+	.report = cs_report,
+	.prune = cs_prune,
+	.free_data = cs_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "cycles",
+	.ops = &pat_ops,
+};
+
+int register_cycles(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include "util.h"
+#include "futex.h"
+#include "pattern.h"
+
+/*
+ * Profile futex contention per futex address (uaddr). The futex
+ * operations of the traced tasks are correlated per address:
+ *
+ * - wait:  a blocking operation (FUTEX_WAIT*, FUTEX_LOCK_PI*) from
+ *          sys_enter to sys_exit
+ * - wake:  a waking operation (FUTEX_WAKE*, FUTEX_REQUEUE*,
+ *          FUTEX_UNLOCK_PI). If a waiter of the same address is woken
+ *          by the waking task, the time from the wake to the return of
+ *          the waiter is accounted.
+ * - hold:  a PI lock from the successful return of FUTEX_LOCK_PI* to
+ *          FUTEX_UNLOCK_PI of the same task. Uncontended PI locks are
+ *          taken and released in user space, so only holds acquired
+ *          or released through the kernel are visible.
+ */
+
+#define ENTER_STR " sys_enter: "
+#define EXIT_STR " sys_exit: "
+#define WAKEUP_STR " sched_wakeup: "
+
+struct futex_stats {
+	unsigned long uaddr;
+
+	unsigned long waits;
+	unsigned long long wait_total;
+	unsigned long long wait_max;
+	int waiters;
+	int max_waiters;
+
+	unsigned long wakes;
+	unsigned long woken;
+	unsigned long long wake_total;
+
+	unsigned long holds;
+	unsigned long long hold_total;
+	unsigned long long hold_max;
+
+	/* the last operation on the address */
+	unsigned long long last;
+};
+
+struct held_lock {
+	unsigned long uaddr;
+	unsigned long long since;
+};
+
+struct futex_task {
+	pid_t pid;
+	/* the last futex syscall of the task */
+	unsigned long long last;
+
+	/* the futex operation currently in progress */
+	int in_futex;
+	unsigned long uaddr;
+	unsigned int cmd;
+	unsigned long long enter;
+	unsigned long long woken_at;
+
+	struct held_lock *held;
+	int nr_held;
+};
+
+struct futex_contention {
+	struct futex_task *tasks;
+	int nr_tasks;
+
+	struct futex_stats *stats;
+	int nr_stats;
+};
+
+static struct futex_task *find_task(struct futex_contention *fc, pid_t pid,
+				    int create)
+{
+	struct futex_task *t;
+	int i;
+
+	for (i = 0; i < fc->nr_tasks; i++) {
+		if (fc->tasks[i].pid == pid)
+			return &fc->tasks[i];
+	}
+
+	if (!create)
+		return NULL;
+
+	t = array_grow(fc->tasks, fc->nr_tasks, sizeof(*t));
+	if (!t)
+		return NULL;
+	fc->tasks = t;
+
+	t = &fc->tasks[fc->nr_tasks++];
+	memset(t, 0, sizeof(*t));
+	t->pid = pid;
+
+	return t;
+}
+
+static struct futex_stats *find_stats(struct futex_contention *fc,
+				      unsigned long uaddr)
+{
+	struct futex_stats *st;
+	int i;
+
+	for (i = 0; i < fc->nr_stats; i++) {
+		if (fc->stats[i].uaddr == uaddr)
+			return &fc->stats[i];
+	}
+
+	st = array_grow(fc->stats, fc->nr_stats, sizeof(*st));
+	if (!st)
+		return NULL;
+	fc->stats = st;
+
+	st = &fc->stats[fc->nr_stats++];
+	memset(st, 0, sizeof(*st));
+	st->uaddr = uaddr;
+
+	return st;
+}
+
+static int is_wait_cmd(unsigned int cmd)
+{
+	switch (cmd) {
+	case FUTEX_WAIT:
+	case FUTEX_WAIT_BITSET:
+	case FUTEX_WAIT_REQUEUE_PI:
+	case FUTEX_LOCK_PI:
+#ifdef FUTEX_LOCK_PI2
+	case FUTEX_LOCK_PI2:
+#endif
+		return 1;
+	}
+
+	return 0;
+}
+
+static int is_wake_cmd(unsigned int cmd)
+{
+	switch (cmd) {
+	case FUTEX_WAKE:
+	case FUTEX_WAKE_BITSET:
+	case FUTEX_WAKE_OP:
+	case FUTEX_REQUEUE:
+	case FUTEX_CMP_REQUEUE:
+	case FUTEX_CMP_REQUEUE_PI:
+	case FUTEX_UNLOCK_PI:
+		return 1;
+	}
+
+	return 0;
+}
+
+/* operations that return with the PI lock held on success */
+static int is_lock_cmd(unsigned int cmd)
+{
+	switch (cmd) {
+	case FUTEX_LOCK_PI:
+#ifdef FUTEX_LOCK_PI2
+	case FUTEX_LOCK_PI2:
+#endif
+	case FUTEX_TRYLOCK_PI:
+	case FUTEX_WAIT_REQUEUE_PI:
+		return 1;
+	}
+
+	return 0;
+}
+
+static void release_lock(struct futex_contention *fc, struct futex_task *t,
+			 unsigned long uaddr, unsigned long long ts)
+{
+	struct futex_stats *st;
+	unsigned long long held;
+	int i;
+
+	for (i = 0; i < t->nr_held; i++) {
+		if (t->held[i].uaddr != uaddr)
+			continue;
+
+		st = find_stats(fc, uaddr);
+		if (st) {
+			held = ts - t->held[i].since;
+			st->holds++;
+			st->hold_total += held;
+			if (held > st->hold_max)
+				st->hold_max = held;
+			st->last = ts;
+		}
+
+		t->held[i] = t->held[--t->nr_held];
+		return;
+	}
+}
+
+static void handle_sys_enter(struct futex_contention *fc,
+			     const char *traceline, unsigned long long ts,
+			     pid_t task)
+{
+	struct futex_stats *st;
+	struct futex_task *t;
+	unsigned long uaddr;
+	unsigned long nr;
+	unsigned int cmd;
+
+	if (trace_field_ul(traceline, " NR ", &nr) != 0 || nr != NR_FUTEX)
+		return;
+
+	if (futex_parse_args(traceline, &uaddr, &cmd) != 0)
+		return;
+
+	t = find_task(fc, task, 1);
+	st = find_stats(fc, uaddr);
+	if (!t || !st)
+		return;
+
+	t->in_futex = 1;
+	t->uaddr = uaddr;
+	t->cmd = cmd;
+	t->enter = ts;
+	t->woken_at = 0;
+	t->last = ts;
+	st->last = ts;
+
+	if (is_wait_cmd(cmd)) {
+		st->waits++;
+		st->waiters++;
+		if (st->waiters > st->max_waiters)
+			st->max_waiters = st->waiters;
+	} else if (is_wake_cmd(cmd)) {
+		st->wakes++;
+	}
+
+	if (cmd == FUTEX_UNLOCK_PI)
+		release_lock(fc, t, uaddr, ts);
+}
+
+static void handle_sys_exit(struct futex_contention *fc,
+			    const char *traceline, unsigned long long ts,
+			    pid_t task)
+{
+	struct futex_stats *st;
+	struct futex_task *t;
+	struct held_lock *h;
+	unsigned long long waited;
+	unsigned long nr;
+	long ret = -1;
+	char *p;
+
+	if (trace_field_ul(traceline, " NR ", &nr) != 0 || nr != NR_FUTEX)
+		return;
+
+	t = find_task(fc, task, 0);
+	if (!t || !t->in_futex)
+		return;
+	t->in_futex = 0;
+	t->last = ts;
+
+	st = find_stats(fc, t->uaddr);
+	if (!st)
+		return;
+	st->last = ts;
+
+	p = strstr(traceline, " = ");
+	if (p)
+		ret = strtol(p + 3, NULL, 10);
+
+	if (is_wait_cmd(t->cmd)) {
+		waited = ts - t->enter;
+		st->wait_total += waited;
+		if (waited > st->wait_max)
+			st->wait_max = waited;
+		if (st->waiters > 0)
+			st->waiters--;
+
+		if (t->woken_at) {
+			st->woken++;
+			st->wake_total += ts - t->woken_at;
+		}
+	}
+
+	if (is_lock_cmd(t->cmd) && ret == 0) {
+		h = array_grow(t->held, t->nr_held, sizeof(*h));
+		if (!h)
+			return;
+		t->held = h;
+		h = &t->held[t->nr_held++];
+		h->uaddr = t->uaddr;
+		h->since = ts;
+	}
+}
+
+static void handle_wakeup(struct futex_contention *fc,
+			  const char *traceline, pid_t task)
+{
+	struct futex_task *waker;
+	struct futex_task *t;
+	unsigned long pid;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0)
+		return;
+
+	t = find_task(fc, pid, 0);
+	if (!t || !t->in_futex || !is_wait_cmd(t->cmd) || t->woken_at)
+		return;
+
+	/* only wakes through the same futex are correlated */
+	waker = find_task(fc, task, 0);
+	if (!waker || !waker->in_futex || !is_wake_cmd(waker->cmd) ||
+	    waker->uaddr != t->uaddr) {
+		return;
+	}
+
+	t->woken_at = waker->enter;
+}
+
+static void fc_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct futex_contention *fc = data;
+	unsigned long long ns = ts_to_ns(ts);
+
+	(void)ev;
+	(void)cpu;
+
+	if (strstr(traceline, ENTER_STR))
+		handle_sys_enter(fc, traceline, ns, task);
+	else if (strstr(traceline, EXIT_STR))
+		handle_sys_exit(fc, traceline, ns, task);
+	else if (strstr(traceline, WAKEUP_STR))
+		handle_wakeup(fc, traceline, task);
+}
+
+static int cmp_wait_total(const void *lhs, const void *rhs)
+{
+	const struct futex_stats *l = lhs;
+	const struct futex_stats *r = rhs;
+
+	if (l->wait_total != r->wait_total)
+		return (l->wait_total < r->wait_total) ? 1 : -1;
+	if (l->waits != r->waits)
+		return (l->waits < r->waits) ? 1 : -1;
+
+	return 0;
+}
+
+static void fc_report(void *data)
+{
+	struct futex_contention *fc = data;
+	struct futex_stats *st;
+	int i;
+
+	if (!fc->nr_stats)
+		return;
+
+	qsort(fc->stats, fc->nr_stats, sizeof(*fc->stats), cmp_wait_total);
+
+	printf("futex contention (ranked by total wait time):\n\n");
+	printf("%-18s %7s %7s %12s %12s %7s %12s %7s %12s %12s\n",
+	       "uaddr", "waits", "waiters", "wait us", "wait max us",
+	       "wakes", "wake->ret us", "holds", "hold us", "hold max us");
+
+	for (i = 0; i < fc->nr_stats; i++) {
+		st = &fc->stats[i];
+
+		/* addresses that never blocked or were held are not contended */
+		if (!st->waits && !st->holds)
+			continue;
+
+		printf("0x%-16lx %7lu %7d %12llu %12llu %7lu",
+		       st->uaddr, st->waits, st->max_waiters,
+		       st->wait_total / 1000, st->wait_max / 1000,
+		       st->wakes);
+		if (st->woken)
+			printf(" %12llu", st->wake_total / st->woken / 1000);
+		else
+			printf(" %12s", "-");
+		printf(" %7lu", st->holds);
+		if (st->holds)
+			printf(" %12llu %12llu\n", st->hold_total / 1000,
+			       st->hold_max / 1000);
+		else
+			printf(" %12s %12s\n", "-", "-");
+	}
+
+	printf("\n");
+}
+
+static int is_held(struct futex_contention *fc, unsigned long uaddr)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < fc->nr_tasks; i++) {
+		for (j = 0; j < fc->tasks[i].nr_held; j++) {
+			if (fc->tasks[i].held[j].uaddr == uaddr)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Forget the tasks and addresses without a futex operation in the
+ * retained history, unless a task is still in one or holds a lock.
+ */
+static void fc_prune(void *data, unsigned long long before)
+{
+	struct futex_contention *fc = data;
+	struct futex_stats *st;
+	struct futex_task *t;
+	int i;
+	int n;
+
+	for (i = 0, n = 0; i < fc->nr_tasks; i++) {
+		t = &fc->tasks[i];
+		if (t->last >= before || t->in_futex || t->nr_held)
+			fc->tasks[n++] = *t;
+		else
+			free(t->held);
+	}
+	fc->nr_tasks = n;
+
+	for (i = 0, n = 0; i < fc->nr_stats; i++) {
+		st = &fc->stats[i];
+		if (st->last >= before || st->waiters ||
+		    is_held(fc, st->uaddr)) {
+			fc->stats[n++] = *st;
+		}
+	}
+	fc->nr_stats = n;
+}
+
+static void *fc_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct futex_contention *fc;
+
+	(void)lc;
+	(void)tasks;
+	(void)ntasks;
+
+	fc = calloc(1, sizeof(*fc));
+	if (!fc)
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+
+	return fc;
+}
+
+static void fc_free_data(void *data)
+{
+	struct futex_contention *fc = data;
+	int i;
+
+	if (!fc)
+		return;
+
+	for (i = 0; i < fc->nr_tasks; i++)
+		free(fc->tasks[i].held);
+	free(fc->tasks);
+	free(fc->stats);
+	free(fc);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = fc_init,
+	.traceline = fc_traceline,
+	.report = fc_report,
+	.prune = fc_prune,
+	.free_data = fc_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "futex_contention",
+	.ops = &pat_ops,
+};
+
+int register_futex_contention(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "pattern.h"
+
+/*
+ * Aggregate the kernel stacks of significant sched_outs of the focus
+ * tasks. Identical stacks are merged and weighted by the time the
+ * focus task was scheduled out. The summary is printed in the folded
+ * format ("outermost;...;innermost weight") understood by flame graph
+ * tools.
+ */
+
+struct folded_stack {
+	const char *stack;
+	unsigned long count;
+	unsigned long long offcpu;
+	/* the end of the last sched_out */
+	unsigned long long last;
+};
+
+struct offcpu_stacks {
+	struct folded_stack *stacks;
+	int nr_stacks;
+};
+
+static void os_significant(void *data, struct subpattern_instance *sp_inst,
+			   pid_t focus_task)
+{
+	struct offcpu_stacks *os = data;
+	struct folded_stack *fs;
+	int i;
+
+	if (sp_inst->bound != in || !sp_inst->partner || !sp_inst->stack ||
+	    !sp_inst->def->ops->sched_out ||
+	    sp_inst->def->ops->sched_out(focus_task, sp_inst->data) <= 0) {
+		return;
+	}
+
+	for (i = 0; i < os->nr_stacks; i++) {
+		if (strcmp(os->stacks[i].stack, sp_inst->stack) == 0)
+			break;
+	}
+
+	if (i == os->nr_stacks) {
+		fs = array_grow(os->stacks, os->nr_stacks, sizeof(*fs));
+		if (!fs)
+			return;
+		os->stacks = fs;
+
+		fs = &os->stacks[os->nr_stacks++];
+		memset(fs, 0, sizeof(*fs));
+
+		/* the instances are gone by the time we report */
+		fs->stack = strdup(sp_inst->stack);
+		if (!fs->stack) {
+			os->nr_stacks--;
+			return;
+		}
+	}
+
+	fs = &os->stacks[i];
+	fs->count++;
+	fs->offcpu += ts_to_ns(&sp_inst->partner->ts) -
+		      ts_to_ns(&sp_inst->ts);
+	fs->last = ts_to_ns(&sp_inst->partner->ts);
+}
+
+static int cmp_offcpu(const void *lhs, const void *rhs)
+{
+	const struct folded_stack *l = lhs;
+	const struct folded_stack *r = rhs;
+
+	if (l->offcpu != r->offcpu)
+		return (l->offcpu < r->offcpu) ? 1 : -1;
+
+	return 0;
+}
+
+static void os_report(void *data)
+{
+	struct offcpu_stacks *os = data;
+	struct folded_stack *fs;
+	int i;
+
+	if (!os->nr_stacks)
+		return;
+
+	qsort(os->stacks, os->nr_stacks, sizeof(*os->stacks), cmp_offcpu);
+
+	printf("off-CPU stacks of significant sched_outs"
+	       " (folded, weighted by off-CPU us):\n\n");
+
+	for (i = 0; i < os->nr_stacks; i++) {
+		fs = &os->stacks[i];
+		printf("%s %llu\n", fs->stack, fs->offcpu / 1000);
+	}
+
+	printf("\n");
+}
+
+/* forget the stacks not seen in the retained history */
+static void os_prune(void *data, unsigned long long before)
+{
+	struct offcpu_stacks *os = data;
+	int i;
+	int n;
+
+	for (i = 0, n = 0; i < os->nr_stacks; i++) {
+		if (os->stacks[i].last >= before)
+			os->stacks[n++] = os->stacks[i];
+		else
+			free((char *)os->stacks[i].stack);
+	}
+	os->nr_stacks = n;
+}
+
+static void *os_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct offcpu_stacks *os;
+
+	(void)lc;
+	(void)tasks;
+	(void)ntasks;
+
+	os = calloc(1, sizeof(*os));
+	if (!os)
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+
+	return os;
+}
+
+static void os_free_data(void *data)
+{
+	struct offcpu_stacks *os = data;
+	int i;
+
+	if (!os)
+		return;
+
+	for (i = 0; i < os->nr_stacks; i++)
+		free((char *)os->stacks[i].stack);
+	free(os->stacks);
+	free(os);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = os_init,
+	.significant = os_significant,
+	.report = os_report,
+	.prune = os_prune,
+	.free_data = os_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "offcpu_stacks",
+	.ops = &pat_ops,
+};
+
+int register_offcpu_stacks(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
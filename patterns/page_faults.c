@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "pattern.h"
+#include "subpatterns/page_fault.h"
+
+/*
+ * Account the page faults of the focus tasks per faulting code address.
+ * An application signals that it entered its real-time phase by
+ * writing "latcheck:rt" to the trace_marker of the tracing instance
+ * (and "latcheck:nrt" when it leaves it). All memory should be locked
+ * and prefaulted by then, so every fault in the RT phase is reported
+ * as a warning and, when tracing continuously, its trace window.
+ */
+
+#define MARKER_STR " tracing_mark_write: "
+#define RT_BEGIN_STR "latcheck:rt"
+#define RT_END_STR "latcheck:nrt"
+
+/* faults in the RT phase listed in the report */
+#define MAX_RT_FAULTS 16
+
+struct fault_site {
+	int kernel;
+	unsigned long long ip;
+	unsigned long faults;
+	unsigned long slept;
+	unsigned long long total;
+	unsigned long long max;
+	/* the end of the last fault */
+	unsigned long long last;
+};
+
+struct rt_fault {
+	struct page_fault pf;
+	unsigned long long begin;
+	unsigned long long end;
+};
+
+struct page_faults {
+	struct latcheck *lc;
+	const pid_t *tasks;
+	int ntasks;
+
+	/* begin of the RT phase, 0 if not in the RT phase */
+	unsigned long long rt_since;
+	unsigned long long rt_first;
+
+	struct fault_site *sites;
+	int nr_sites;
+
+	/* the first faults in the RT phase (of the retained history) */
+	struct rt_fault rt[MAX_RT_FAULTS];
+	unsigned long nr_listed;
+	unsigned long nr_rt;
+};
+
+static int is_focus_task(struct page_faults *pfs, pid_t task)
+{
+	int i;
+
+	for (i = 0; i < pfs->ntasks; i++) {
+		if (pfs->tasks[i] == task)
+			return 1;
+	}
+
+	return 0;
+}
+
+static struct fault_site *find_site(struct page_faults *pfs,
+				    const struct page_fault *pf)
+{
+	struct fault_site *site;
+	int i;
+
+	for (i = 0; i < pfs->nr_sites; i++) {
+		site = &pfs->sites[i];
+		if (site->ip == pf->ip && site->kernel == pf->kernel)
+			return site;
+	}
+
+	site = array_grow(pfs->sites, pfs->nr_sites, sizeof(*site));
+	if (!site)
+		return NULL;
+	pfs->sites = site;
+
+	site = &pfs->sites[pfs->nr_sites++];
+	memset(site, 0, sizeof(*site));
+	site->kernel = pf->kernel;
+	site->ip = pf->ip;
+
+	return site;
+}
+
+/* does the marker text follow the trace_marker event? */
+static int is_marker(const char *p, const char *marker)
+{
+	size_t len = strlen(marker);
+
+	if (strncmp(p, marker, len) != 0)
+		return 0;
+
+	return (p[len] == 0 || p[len] == '\n' || p[len] == ' ');
+}
+
+static void pf_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct page_faults *pfs = data;
+	const char *p;
+
+	(void)ev;
+	(void)cpu;
+	(void)task;
+
+	p = strstr(traceline, MARKER_STR);
+	if (!p)
+		return;
+	p += strlen(MARKER_STR);
+
+	if (is_marker(p, RT_BEGIN_STR)) {
+		pfs->rt_since = ts_to_ns(ts);
+		if (!pfs->rt_first)
+			pfs->rt_first = pfs->rt_since;
+	} else if (is_marker(p, RT_END_STR)) {
+		pfs->rt_since = 0;
+	}
+}
+
+static void pf_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct page_faults *pfs = data;
+	const struct page_fault *out;
+	const struct page_fault *pf;
+	struct fault_site *site;
+	unsigned long long begin;
+	unsigned long long end;
+	struct rt_fault *rt;
+
+	pf = page_fault_of(sp_inst);
+	if (!pf || !is_focus_task(pfs, pf->task))
+		return;
+
+	/* only the end knows whether the task slept */
+	out = page_fault_of(sp_inst->partner);
+
+	begin = ts_to_ns(&sp_inst->ts);
+	end = ts_to_ns(&sp_inst->partner->ts);
+
+	site = find_site(pfs, pf);
+	if (site) {
+		site->faults++;
+		if (out->slept)
+			site->slept++;
+		site->total += end - begin;
+		if (end - begin > site->max)
+			site->max = end - begin;
+		site->last = end;
+	}
+
+	if (!pfs->rt_since || begin < pfs->rt_since)
+		return;
+
+	if (pfs->nr_listed < MAX_RT_FAULTS) {
+		rt = &pfs->rt[pfs->nr_listed++];
+		rt->pf = *out;
+		rt->begin = begin;
+		rt->end = end;
+	}
+	pfs->nr_rt++;
+
+	subpattern_request_window(pfs->lc, &sp_inst->ts,
+				  &sp_inst->partner->ts,
+				  "page fault in RT phase");
+}
+
+static int cmp_total(const void *lhs, const void *rhs)
+{
+	const struct fault_site *l = lhs;
+	const struct fault_site *r = rhs;
+
+	if (l->total != r->total)
+		return (l->total < r->total) ? 1 : -1;
+	if (l->faults != r->faults)
+		return (l->faults < r->faults) ? 1 : -1;
+
+	return 0;
+}
+
+static void pf_report(void *data)
+{
+	struct page_faults *pfs = data;
+	struct fault_site *site;
+	struct page_fault pf;
+	struct rt_fault *rt;
+	unsigned long i;
+	char ip[64];
+
+	if (!pfs->nr_sites)
+		return;
+
+	qsort(pfs->sites, pfs->nr_sites, sizeof(*pfs->sites), cmp_total);
+
+	printf("page faults of focus tasks per code address:\n\n");
+	printf("%-32s %-6s %7s %7s %10s %10s\n", "ip", "type", "faults",
+	       "slept", "total us", "max us");
+
+	for (i = 0; i < (unsigned long)pfs->nr_sites; i++) {
+		site = &pfs->sites[i];
+
+		memset(&pf, 0, sizeof(pf));
+		pf.kernel = site->kernel;
+		pf.ip = site->ip;
+		page_fault_ip(&pf, ip, sizeof(ip));
+
+		printf("%-32s %-6s %7lu %7lu %10llu %10llu\n", ip,
+		       site->kernel ? "kernel" : "user", site->faults,
+		       site->slept, site->total / 1000, site->max / 1000);
+	}
+	printf("\n");
+
+	if (!pfs->nr_rt)
+		return;
+
+	printf("WARNING: %lu page fault%s after the RT phase began at"
+	       " %llu.%06llu (memory not locked or prefaulted?):\n\n",
+	       pfs->nr_rt, pfs->nr_rt > 1 ? "s" : "",
+	       pfs->rt_first / 1000000000ULL,
+	       pfs->rt_first % 1000000000ULL / 1000);
+
+	for (i = 0; i < pfs->nr_listed; i++) {
+		rt = &pfs->rt[i];
+
+		page_fault_ip(&rt->pf, ip, sizeof(ip));
+		printf("%llu.%06llu task %u %s fault at 0x%llx ip=%s %s"
+		       " %llu us%s\n",
+		       rt->begin / 1000000000ULL,
+		       rt->begin % 1000000000ULL / 1000, rt->pf.task,
+		       rt->pf.kernel ? "kernel" : "user", rt->pf.address, ip,
+		       page_fault_type(rt->pf.error_code),
+		       (rt->end - rt->begin) / 1000,
+		       rt->pf.slept ? " (slept)" : "");
+	}
+	if (pfs->nr_rt > pfs->nr_listed)
+		printf("...\n");
+	printf("\n");
+}
+
+/* forget the code addresses and RT faults before the retained history */
+static void pf_prune(void *data, unsigned long long before)
+{
+	struct page_faults *pfs = data;
+	unsigned long i;
+	unsigned long n;
+
+	for (i = 0, n = 0; i < (unsigned long)pfs->nr_sites; i++) {
+		if (pfs->sites[i].last >= before)
+			pfs->sites[n++] = pfs->sites[i];
+	}
+	pfs->nr_sites = n;
+
+	for (i = 0, n = 0; i < pfs->nr_listed; i++) {
+		if (pfs->rt[i].end >= before)
+			pfs->rt[n++] = pfs->rt[i];
+	}
+	pfs->nr_rt -= pfs->nr_listed - n;
+	pfs->nr_listed = n;
+}
+
+static void *pf_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct page_faults *pfs;
+
+	pfs = calloc(1, sizeof(*pfs));
+	if (!pfs) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	pfs->lc = lc;
+	pfs->tasks = tasks;
+	pfs->ntasks = ntasks;
+
+	return pfs;
+}
+
+static void pf_free_data(void *data)
+{
+	struct page_faults *pfs = data;
+
+	if (!pfs)
+		return;
+
+	free(pfs->sites);
+	free(pfs);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = pf_init,
+	.traceline = pf_traceline,
+	.closed = pf_closed,
+	.report = pf_report,
+	.prune = pf_prune,
+	.free_data = pf_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "page_faults",
+	.ops = &pat_ops,
+};
+
+int register_page_faults(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
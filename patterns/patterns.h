@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+struct pattern_set;
+
+extern int register_pi_chain(struct pattern_set *ps);
+extern int register_futex_contention(struct pattern_set *ps);
+extern int register_offcpu_stacks(struct pattern_set *ps);
+extern int register_budget(struct pattern_set *ps);
+extern int register_runqueue(struct pattern_set *ps);
+extern int register_page_faults(struct pattern_set *ps);
+extern int register_timer_latency(struct pattern_set *ps);
+extern int register_block_io(struct pattern_set *ps);
+extern int register_critical_path(struct pattern_set *ps);
+extern int register_cycles(struct pattern_set *ps);
+extern int register_summary(struct pattern_set *ps);
+
+/* the longest key of a summary line (see summary.c) */
+#define SUMMARY_KEY_MAX 48
+
+#endif /* PATTERNS_H */
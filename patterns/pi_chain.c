@@ -0,0 +1,673 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include "util.h"
+#include "futex.h"
+#include "pattern.h"
+
+/*
+ * Reconstruct a time-indexed wait-for graph of the traced tasks from
+ * futex syscalls, PI boosts (sched_pi_setprio) and wakeups. For each
+ * significant sched_out of a blocked RT task the full blocking chain
+ * is reported.
+ *
+ * An edge "waiter -> owner" is created when a task enters a blocking
+ * futex operation. The owner is learned from the first PI boost done
+ * in the context of the waiter (the direct lock owner) or, for non-PI
+ * futexes, from the task that wakes the waiter. Further boosts done
+ * in the context of the waiter are the kernel walking the PI chain,
+ * so they add (inferred) edges to the owners further down the chain.
+ */
+
+#define MAX_CHAIN_DEPTH 16
+
+#define SWITCH_STR " sched_switch: "
+#define WAKEUP_STR " sched_wakeup: "
+#define SETPRIO_STR " sched_pi_setprio: "
+#define ENTER_STR " sys_enter: "
+#define EXIT_STR " sys_exit: "
+
+struct offcpu {
+	unsigned long long begin;
+	unsigned long long end;
+	int prio;
+	char state;
+};
+
+struct task_state {
+	pid_t pid;
+	int wait;
+	pid_t chain_tail;
+
+	struct offcpu *offcpu;
+	int nr_offcpu;
+};
+
+struct wait_edge {
+	pid_t waiter;
+	pid_t owner;
+	unsigned long uaddr;
+	unsigned int cmd;
+	int inferred;
+	int root;
+	int owner_prio;
+	unsigned long long begin;
+	unsigned long long end;
+};
+
+struct sched_out {
+	pid_t task;
+	const char *name;
+	unsigned long long begin;
+	unsigned long long end;
+};
+
+struct pi_chain {
+	const pid_t *tasks;
+	int ntasks;
+
+	struct task_state *task_states;
+	int nr_task_states;
+
+	struct wait_edge *edges;
+	int nr_edges;
+
+	struct sched_out *sched_outs;
+	int nr_sched_outs;
+};
+
+static struct task_state *find_task(struct pi_chain *pc, pid_t pid,
+				    int create)
+{
+	struct task_state *t;
+	int i;
+
+	for (i = 0; i < pc->nr_task_states; i++) {
+		if (pc->task_states[i].pid == pid)
+			return &pc->task_states[i];
+	}
+
+	if (!create)
+		return NULL;
+
+	t = array_grow(pc->task_states, pc->nr_task_states, sizeof(*t));
+	if (!t)
+		return NULL;
+	pc->task_states = t;
+
+	t = &pc->task_states[pc->nr_task_states++];
+	memset(t, 0, sizeof(*t));
+	t->pid = pid;
+	t->wait = -1;
+
+	return t;
+}
+
+static struct wait_edge *add_edge(struct pi_chain *pc, pid_t waiter,
+				  unsigned long long ts)
+{
+	struct wait_edge *e;
+
+	e = array_grow(pc->edges, pc->nr_edges, sizeof(*e));
+	if (!e)
+		return NULL;
+	pc->edges = e;
+
+	e = &pc->edges[pc->nr_edges++];
+	memset(e, 0, sizeof(*e));
+	e->waiter = waiter;
+	e->begin = ts;
+	e->root = pc->nr_edges - 1;
+	e->owner_prio = -1;
+
+	return e;
+}
+
+static int is_blocking_cmd(unsigned int cmd)
+{
+	switch (cmd) {
+	case FUTEX_WAIT:
+	case FUTEX_WAIT_BITSET:
+	case FUTEX_WAIT_REQUEUE_PI:
+	case FUTEX_LOCK_PI:
+#ifdef FUTEX_LOCK_PI2
+	case FUTEX_LOCK_PI2:
+#endif
+		return 1;
+	}
+
+	return 0;
+}
+
+static void handle_switch(struct pi_chain *pc, const char *traceline,
+			  unsigned long long ts)
+{
+	unsigned long prev_pid;
+	unsigned long next_pid;
+	unsigned long prio;
+	struct task_state *t;
+	struct offcpu *oc;
+	char state[8];
+
+	if (trace_field_ul(traceline, " prev_pid=", &prev_pid) != 0 ||
+	    trace_field_ul(traceline, " prev_prio=", &prio) != 0 ||
+	    trace_field_str(traceline, " prev_state=", state,
+			    sizeof(state)) != 0 ||
+	    trace_field_ul(traceline, " next_pid=", &next_pid) != 0) {
+		return;
+	}
+
+	t = find_task(pc, prev_pid, 1);
+	if (t) {
+		oc = array_grow(t->offcpu, t->nr_offcpu, sizeof(*oc));
+		if (oc) {
+			t->offcpu = oc;
+			oc = &t->offcpu[t->nr_offcpu++];
+			oc->begin = ts;
+			oc->end = 0;
+			oc->prio = prio;
+			oc->state = state[0];
+		}
+	}
+
+	t = find_task(pc, next_pid, 0);
+	if (t && t->nr_offcpu && !t->offcpu[t->nr_offcpu - 1].end)
+		t->offcpu[t->nr_offcpu - 1].end = ts;
+}
+
+static void handle_wakeup(struct pi_chain *pc, const char *traceline,
+			  pid_t task)
+{
+	struct task_state *t;
+	struct wait_edge *e;
+	unsigned long pid;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0)
+		return;
+
+	t = find_task(pc, pid, 0);
+	if (!t || t->wait < 0)
+		return;
+
+	/* for non-PI futexes the waker is who the waiter waited for */
+	e = &pc->edges[t->wait];
+	if (!e->owner && pid != (unsigned long)task)
+		e->owner = task;
+}
+
+static void handle_setprio(struct pi_chain *pc, const char *traceline,
+			   unsigned long long ts, pid_t task)
+{
+	unsigned long oldprio;
+	unsigned long newprio;
+	struct task_state *t;
+	struct wait_edge *e;
+	unsigned long pid;
+	int root;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0 ||
+	    trace_field_ul(traceline, " oldprio=", &oldprio) != 0 ||
+	    trace_field_ul(traceline, " newprio=", &newprio) != 0) {
+		return;
+	}
+
+	/* only boosts done by a blocking waiter build the chain */
+	if (newprio >= oldprio)
+		return;
+
+	t = find_task(pc, task, 0);
+	if (!t || t->wait < 0)
+		return;
+
+	root = t->wait;
+	e = &pc->edges[root];
+
+	if (!e->owner) {
+		e->owner = pid;
+		e->owner_prio = oldprio;
+		t->chain_tail = pid;
+		return;
+	}
+
+	if ((pid_t)pid == t->chain_tail || (pid_t)pid == e->owner)
+		return;
+
+	/* the kernel is walking the PI chain */
+	e = add_edge(pc, t->chain_tail, ts);
+	if (!e)
+		return;
+	e->owner = pid;
+	e->owner_prio = oldprio;
+	e->inferred = 1;
+	e->root = root;
+	t->chain_tail = pid;
+}
+
+static void handle_sys_enter(struct pi_chain *pc, const char *traceline,
+			     unsigned long long ts, pid_t task)
+{
+	struct task_state *t;
+	struct wait_edge *e;
+	unsigned long uaddr;
+	unsigned long nr;
+	unsigned int cmd;
+
+	if (trace_field_ul(traceline, " NR ", &nr) != 0 || nr != NR_FUTEX)
+		return;
+
+	if (futex_parse_args(traceline, &uaddr, &cmd) != 0)
+		return;
+
+	if (!is_blocking_cmd(cmd))
+		return;
+
+	t = find_task(pc, task, 1);
+	if (!t)
+		return;
+
+	e = add_edge(pc, task, ts);
+	if (!e)
+		return;
+	e->uaddr = uaddr;
+	e->cmd = cmd;
+
+	t->wait = pc->nr_edges - 1;
+	t->chain_tail = 0;
+}
+
+static void handle_sys_exit(struct pi_chain *pc, const char *traceline,
+			    unsigned long long ts, pid_t task)
+{
+	struct task_state *t;
+	unsigned long nr;
+	int i;
+
+	if (trace_field_ul(traceline, " NR ", &nr) != 0 || nr != NR_FUTEX)
+		return;
+
+	t = find_task(pc, task, 0);
+	if (!t || t->wait < 0)
+		return;
+
+	/* close the wait and all edges inferred from its chain walk */
+	for (i = t->wait; i < pc->nr_edges; i++) {
+		if (pc->edges[i].root == t->wait && !pc->edges[i].end)
+			pc->edges[i].end = ts;
+	}
+
+	t->wait = -1;
+	t->chain_tail = 0;
+}
+
+static void pc_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct pi_chain *pc = data;
+	unsigned long long ns = ts_to_ns(ts);
+
+	(void)ev;
+	(void)cpu;
+
+	if (strstr(traceline, SWITCH_STR))
+		handle_switch(pc, traceline, ns);
+	else if (strstr(traceline, WAKEUP_STR))
+		handle_wakeup(pc, traceline, task);
+	else if (strstr(traceline, SETPRIO_STR))
+		handle_setprio(pc, traceline, ns, task);
+	else if (strstr(traceline, ENTER_STR))
+		handle_sys_enter(pc, traceline, ns, task);
+	else if (strstr(traceline, EXIT_STR))
+		handle_sys_exit(pc, traceline, ns, task);
+}
+
+static void pc_significant(void *data, struct subpattern_instance *sp_inst,
+			   pid_t focus_task)
+{
+	struct pi_chain *pc = data;
+	struct sched_out *so;
+
+	if (sp_inst->bound != in || !sp_inst->partner ||
+	    !sp_inst->def->ops->sched_out ||
+	    sp_inst->def->ops->sched_out(focus_task, sp_inst->data) <= 0) {
+		return;
+	}
+
+	so = array_grow(pc->sched_outs, pc->nr_sched_outs, sizeof(*so));
+	if (!so)
+		return;
+	pc->sched_outs = so;
+
+	so = &pc->sched_outs[pc->nr_sched_outs++];
+	so->task = focus_task;
+	so->name = sp_inst->def->name;
+	so->begin = ts_to_ns(&sp_inst->ts);
+	so->end = ts_to_ns(&sp_inst->partner->ts);
+}
+
+static struct offcpu *find_offcpu(struct task_state *t,
+				  unsigned long long ts)
+{
+	int i;
+
+	for (i = 0; i < t->nr_offcpu; i++) {
+		if (t->offcpu[i].begin == ts)
+			return &t->offcpu[i];
+	}
+
+	return NULL;
+}
+
+/* find the edge of a waiter that is open at the given time */
+static struct wait_edge *find_edge(struct pi_chain *pc, pid_t waiter,
+				   unsigned long long ts)
+{
+	struct wait_edge *found = NULL;
+	struct wait_edge *e;
+	int i;
+
+	for (i = 0; i < pc->nr_edges; i++) {
+		e = &pc->edges[i];
+
+		if (e->waiter != waiter || !e->owner)
+			continue;
+		if (e->begin > ts || (e->end && e->end < ts))
+			continue;
+
+		/* prefer edges from traced futex operations */
+		if (!found || (found->inferred && !e->inferred))
+			found = e;
+	}
+
+	return found;
+}
+
+/* time the owner slept (blocked) during the link */
+static unsigned long long owner_slept(struct pi_chain *pc,
+				      struct wait_edge *e,
+				      unsigned long long end)
+{
+	unsigned long long slept = 0;
+	unsigned long long begin;
+	struct task_state *t;
+	struct offcpu *oc;
+	unsigned long long oc_end;
+	int i;
+
+	t = find_task(pc, e->owner, 0);
+	if (!t)
+		return 0;
+
+	for (i = 0; i < t->nr_offcpu; i++) {
+		oc = &t->offcpu[i];
+		if (oc->state != 'S' && oc->state != 'D')
+			continue;
+
+		oc_end = oc->end ? oc->end : end;
+		begin = oc->begin > e->begin ? oc->begin : e->begin;
+		if (oc_end > end)
+			oc_end = end;
+		if (oc_end > begin)
+			slept += oc_end - begin;
+	}
+
+	return slept;
+}
+
+static void print_chain(struct pi_chain *pc, struct sched_out *so,
+			struct offcpu *oc, struct wait_edge *e)
+{
+	struct wait_edge *chain[MAX_CHAIN_DEPTH];
+	unsigned long long end;
+	const char *cmd;
+	int inversions = 0;
+	int depth = 0;
+	int cycle = 0;
+	int i;
+
+	while (e && depth < MAX_CHAIN_DEPTH) {
+		for (i = 0; i < depth; i++) {
+			if (chain[i]->waiter == e->owner)
+				cycle = 1;
+		}
+		chain[depth++] = e;
+		if (cycle)
+			break;
+		e = find_edge(pc, e->owner, so->begin);
+	}
+
+	printf("%llu.%06llu - %llu.%06llu %s task=%u prio=%u chain depth %d\n",
+	       so->begin / 1000000000ULL, (so->begin % 1000000000ULL) / 1000,
+	       so->end / 1000000000ULL, (so->end % 1000000000ULL) / 1000,
+	       so->name, so->task, rt_prio(oc->prio), depth);
+
+	for (i = 0; i < depth; i++) {
+		e = chain[i];
+		end = e->end ? e->end : so->end;
+
+		printf("  %u -> %u", e->waiter, e->owner);
+		cmd = futex_cmd_name(e->cmd);
+		if (e->inferred)
+			printf(" (PI chain)");
+		else if (cmd)
+			printf(" %s uaddr=0x%lx", cmd, e->uaddr);
+		printf(" %llu us", (end - e->begin) / 1000);
+		if (e->owner_prio >= 0)
+			printf(" owner prio=%u", rt_prio(e->owner_prio));
+		printf(" owner slept %llu us\n",
+		       owner_slept(pc, e, end) / 1000);
+
+		if (e->owner_prio > oc->prio) {
+			printf("  priority inversion: %u (prio %u) blocks"
+			       " %u (prio %u)\n", e->owner,
+			       rt_prio(e->owner_prio), so->task,
+			       rt_prio(oc->prio));
+			inversions++;
+		}
+	}
+
+	if (cycle)
+		printf("  deadlock: task %u closes the chain\n",
+		       chain[depth - 1]->owner);
+
+	if (inversions > 1)
+		printf("  %d lock holders cause priority inversion\n",
+		       inversions);
+}
+
+static void pc_report(void *data)
+{
+	struct pi_chain *pc = data;
+	struct task_state *t;
+	struct sched_out *so;
+	struct wait_edge *e;
+	struct offcpu *oc;
+	int header = 0;
+	int i;
+
+	for (i = 0; i < pc->nr_sched_outs; i++) {
+		so = &pc->sched_outs[i];
+
+		/* only RT tasks that blocked (rather than being preempted) */
+		t = find_task(pc, so->task, 0);
+		if (!t)
+			continue;
+		oc = find_offcpu(t, so->begin);
+		if (!oc || oc->prio >= 100 || oc->state == 'R')
+			continue;
+
+		e = find_edge(pc, so->task, so->begin);
+		if (!e)
+			continue;
+
+		if (!header) {
+			printf("blocking chains of significant sched_out"
+			       " sub-patterns:\n\n");
+			header = 1;
+		}
+
+		print_chain(pc, so, oc, e);
+	}
+
+	if (header)
+		printf("\n");
+}
+
+/*
+ * Drop off-CPU intervals and wait edges that ended before the retained
+ * trace history. Inferred edges refer to the edge of their chain walk
+ * by index, so edges are only dropped from the front.
+ */
+static void pc_prune(void *data, unsigned long long before)
+{
+	struct pi_chain *pc = data;
+	struct task_state *t;
+	struct wait_edge *e;
+	int n;
+	int i;
+
+	for (i = 0; i < pc->nr_task_states; i++) {
+		t = &pc->task_states[i];
+
+		for (n = 0; n < t->nr_offcpu; n++) {
+			if (!t->offcpu[n].end || t->offcpu[n].end >= before)
+				break;
+		}
+		if (!n)
+			continue;
+
+		memmove(t->offcpu, t->offcpu + n,
+			(t->nr_offcpu - n) * sizeof(*t->offcpu));
+		t->nr_offcpu -= n;
+	}
+
+	/* tasks that neither wait nor were off the CPU are forgotten */
+	for (i = 0, n = 0; i < pc->nr_task_states; i++) {
+		t = &pc->task_states[i];
+		if (t->wait >= 0 || t->nr_offcpu)
+			pc->task_states[n++] = *t;
+		else
+			free(t->offcpu);
+	}
+	pc->nr_task_states = n;
+
+	for (n = 0; n < pc->nr_edges; n++) {
+		e = &pc->edges[n];
+		if (!e->end || e->end >= before)
+			break;
+	}
+	for (i = n; i < pc->nr_edges; i++) {
+		if (pc->edges[i].root < n)
+			n = pc->edges[i].root;
+	}
+	if (!n)
+		return;
+
+	memmove(pc->edges, pc->edges + n,
+		(pc->nr_edges - n) * sizeof(*pc->edges));
+	pc->nr_edges -= n;
+
+	for (i = 0; i < pc->nr_edges; i++)
+		pc->edges[i].root -= n;
+
+	for (i = 0; i < pc->nr_task_states; i++) {
+		t = &pc->task_states[i];
+		if (t->wait >= 0)
+			t->wait -= n;
+	}
+}
+
+static void *pc_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct pi_chain *pc;
+
+	(void)lc;
+
+	pc = calloc(1, sizeof(*pc));
+	if (!pc) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	pc->tasks = tasks;
+	pc->ntasks = ntasks;
+
+	return pc;
+}
+
+static int pc_enable(void *data, const char *tracingpath)
+{
+	struct pi_chain *pc = data;
+	char filter[FILTER_MAX];
+	int ret = 0;
+
+	/*
+	 * The focus tasks boost the lock owners (and walk the PI chain)
+	 * in their own context, so also trace boosts done by them.
+	 */
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "pid",
+			       pc->tasks, pc->ntasks);
+	ret |= filter_add_pids(filter, sizeof(filter), "common_pid",
+			       pc->tasks, pc->ntasks);
+	ret |= set_tracing(tracingpath, "events/sched/sched_pi_setprio/filter",
+			   filter);
+
+	return ret;
+}
+
+static void pc_free_data(void *data)
+{
+	struct pi_chain *pc = data;
+	int i;
+
+	if (!pc)
+		return;
+
+	for (i = 0; i < pc->nr_task_states; i++)
+		free(pc->task_states[i].offcpu);
+	free(pc->task_states);
+	free(pc->edges);
+	free(pc->sched_outs);
+	free(pc);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = pc_init,
+	.enable = pc_enable,
+	.traceline = pc_traceline,
+	.significant = pc_significant,
+	.report = pc_report,
+	.prune = pc_prune,
+	.free_data = pc_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "pi_chain",
+	.ops = &pat_ops,
+};
+
+int register_pi_chain(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
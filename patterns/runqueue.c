@@ -0,0 +1,618 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "latcheck.h"
+#include "util.h"
+#include "pattern.h"
+
+/*
+ * Attribute the runqueue waits of the focus tasks (sched_latency and
+ * sched_out_runnable) to the CPU they waited on and to the tasks that
+ * ran on that CPU meanwhile. The tasks running on each CPU are tracked
+ * from all sched_switch events, and migrations of the focus tasks from
+ * sched_migrate_task. The waits of significant sub-patterns are listed
+ * with their competitors, and the waits of all sub-patterns are summed
+ * up per CPU.
+ */
+
+#define SWITCH_STR " sched_switch: "
+#define WAKEUP_STR " sched_wakeup: "
+#define MIGRATE_STR " sched_migrate_task: "
+
+/* competitors listed per wait */
+#define MAX_TOP 3
+
+struct cpu_run {
+	pid_t task;
+	char comm[16];
+	unsigned long long begin;
+	unsigned long long end;
+};
+
+struct competitor {
+	pid_t task;
+	char comm[16];
+	unsigned long long ns;
+};
+
+struct cpu_state {
+	/* the task running since "since", if known */
+	pid_t curr;
+	char comm[16];
+	unsigned long long since;
+	int known;
+
+	/* finished runs still overlapping a wait of a focus task */
+	struct cpu_run *runs;
+	int nr_runs;
+
+	/* aggregated over the waits of focus tasks on this CPU */
+	unsigned long waits;
+	unsigned long long wait_ns;
+	unsigned long migrations_in;
+	unsigned long migrations_out;
+	struct competitor *competitors;
+	int nr_competitors;
+};
+
+struct focus_state {
+	/* runnable since, 0 if running or sleeping */
+	unsigned long long wait_since;
+
+	/* migrations since last scheduled out */
+	int migrations;
+	int first_cpu;
+};
+
+/* the attribution of a closed wait of a focus task */
+struct wait_attr {
+	unsigned long tracelineno;
+	const struct subpattern_definition *def;
+	const char *name;
+	pid_t task;
+	unsigned long long begin;
+	unsigned long long end;
+	int cpu;
+	int from_cpu;
+	int migrations;
+	struct competitor top[MAX_TOP];
+	int nr_top;
+	int significant;
+};
+
+struct runqueue {
+	const pid_t *tasks;
+	int ntasks;
+	struct focus_state *focus;
+
+	struct cpu_state *cpus;
+	int nr_cpus;
+
+	struct wait_attr *attrs;
+	int nr_attrs;
+	int sorted;
+};
+
+static int focus_index(struct runqueue *rq, pid_t task)
+{
+	int i;
+
+	for (i = 0; i < rq->ntasks; i++) {
+		if (rq->tasks[i] == task)
+			return i;
+	}
+
+	return -1;
+}
+
+static struct cpu_state *get_cpu(struct runqueue *rq, int cpu)
+{
+	struct cpu_state *cpus;
+
+	if (cpu < 0)
+		return NULL;
+
+	if (cpu >= rq->nr_cpus) {
+		cpus = realloc(rq->cpus, (cpu + 1) * sizeof(*cpus));
+		if (!cpus) {
+			fprintf(stderr, "realloc failed: %s\n",
+				strerror(errno));
+			return NULL;
+		}
+		memset(&cpus[rq->nr_cpus], 0,
+		       (cpu + 1 - rq->nr_cpus) * sizeof(*cpus));
+		rq->cpus = cpus;
+		rq->nr_cpus = cpu + 1;
+	}
+
+	return &rq->cpus[cpu];
+}
+
+/* drop the runs that ended before any focus task started waiting */
+static void trim_runs(struct runqueue *rq, unsigned long long now)
+{
+	unsigned long long bound = now;
+	struct cpu_state *cs;
+	int i;
+	int n;
+
+	for (i = 0; i < rq->ntasks; i++) {
+		if (rq->focus[i].wait_since &&
+		    rq->focus[i].wait_since < bound) {
+			bound = rq->focus[i].wait_since;
+		}
+	}
+
+	for (i = 0; i < rq->nr_cpus; i++) {
+		cs = &rq->cpus[i];
+
+		for (n = 0; n < cs->nr_runs && cs->runs[n].end < bound; n++)
+			;
+
+		/* move in chunks */
+		if (n && (n == cs->nr_runs || n >= ARRAY_CHUNK)) {
+			memmove(cs->runs, cs->runs + n,
+				(cs->nr_runs - n) * sizeof(*cs->runs));
+			cs->nr_runs -= n;
+		}
+	}
+}
+
+static void handle_switch(struct runqueue *rq, const char *traceline,
+			  unsigned long long ns, int cpu)
+{
+	unsigned long prev_pid;
+	unsigned long next_pid;
+	struct cpu_state *cs;
+	struct cpu_run *run;
+	char next_comm[16];
+	char state[8];
+	int fi;
+
+	if (trace_field_ul(traceline, " prev_pid=", &prev_pid) != 0 ||
+	    trace_field_str(traceline, " prev_state=", state,
+			    sizeof(state)) != 0 ||
+	    trace_field_ul(traceline, " next_pid=", &next_pid) != 0 ||
+	    trace_field_str(traceline, " next_comm=", next_comm,
+			    sizeof(next_comm)) != 0) {
+		return;
+	}
+
+	trim_runs(rq, ns);
+
+	cs = get_cpu(rq, cpu);
+	if (!cs)
+		return;
+
+	/* the idle task does not compete */
+	if (cs->known && cs->curr) {
+		run = array_grow(cs->runs, cs->nr_runs, sizeof(*run));
+		if (run) {
+			cs->runs = run;
+			run = &cs->runs[cs->nr_runs++];
+			run->task = cs->curr;
+			strcpy(run->comm, cs->comm);
+			run->begin = cs->since;
+			run->end = ns;
+		}
+	}
+
+	cs->curr = next_pid;
+	strcpy(cs->comm, next_comm);
+	cs->since = ns;
+	cs->known = 1;
+
+	fi = focus_index(rq, prev_pid);
+	if (fi >= 0) {
+		rq->focus[fi].migrations = 0;
+		rq->focus[fi].wait_since = (state[0] == 'R') ? ns : 0;
+	}
+
+	fi = focus_index(rq, next_pid);
+	if (fi >= 0)
+		rq->focus[fi].wait_since = 0;
+}
+
+static void handle_wakeup(struct runqueue *rq, const char *traceline,
+			  unsigned long long ns)
+{
+	unsigned long pid;
+	int fi;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0)
+		return;
+
+	fi = focus_index(rq, pid);
+	if (fi >= 0 && !rq->focus[fi].wait_since)
+		rq->focus[fi].wait_since = ns;
+}
+
+static void handle_migrate(struct runqueue *rq, const char *traceline)
+{
+	unsigned long orig_cpu;
+	unsigned long dest_cpu;
+	struct cpu_state *cs;
+	unsigned long pid;
+	int fi;
+
+	if (trace_field_ul(traceline, " pid=", &pid) != 0 ||
+	    trace_field_ul(traceline, " orig_cpu=", &orig_cpu) != 0 ||
+	    trace_field_ul(traceline, " dest_cpu=", &dest_cpu) != 0) {
+		return;
+	}
+
+	fi = focus_index(rq, pid);
+	if (fi < 0)
+		return;
+
+	if (!rq->focus[fi].migrations++)
+		rq->focus[fi].first_cpu = orig_cpu;
+
+	cs = get_cpu(rq, orig_cpu);
+	if (cs)
+		cs->migrations_out++;
+	cs = get_cpu(rq, dest_cpu);
+	if (cs)
+		cs->migrations_in++;
+}
+
+static void rq_traceline(void *data, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct runqueue *rq = data;
+	unsigned long long ns = ts_to_ns(ts);
+
+	(void)ev;
+	(void)task;
+
+	if (strstr(traceline, SWITCH_STR))
+		handle_switch(rq, traceline, ns, cpu);
+	else if (strstr(traceline, WAKEUP_STR))
+		handle_wakeup(rq, traceline, ns);
+	else if (strstr(traceline, MIGRATE_STR))
+		handle_migrate(rq, traceline);
+}
+
+static int add_competitor(struct competitor **competitors, int *nr,
+			  pid_t task, const char *comm,
+			  unsigned long long ns)
+{
+	struct competitor *c;
+	int i;
+
+	for (i = 0; i < *nr; i++) {
+		if ((*competitors)[i].task == task) {
+			(*competitors)[i].ns += ns;
+			return 0;
+		}
+	}
+
+	c = array_grow(*competitors, *nr, sizeof(*c));
+	if (!c)
+		return -1;
+	*competitors = c;
+
+	c = &c[(*nr)++];
+	c->task = task;
+	strcpy(c->comm, comm);
+	c->ns = ns;
+
+	return 0;
+}
+
+static int cmp_competitor(const void *lhs, const void *rhs)
+{
+	const struct competitor *l = lhs;
+	const struct competitor *r = rhs;
+
+	if (l->ns != r->ns)
+		return (l->ns < r->ns) ? 1 : -1;
+
+	return 0;
+}
+
+static int is_wait(struct subpattern_instance *sp_inst)
+{
+	return (strcmp(sp_inst->def->name, "sched_latency") == 0 ||
+		strcmp(sp_inst->def->name, "sched_out_runnable") == 0);
+}
+
+static void rq_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct subpattern_instance *out = sp_inst->partner;
+	struct competitor *competitors = NULL;
+	struct runqueue *rq = data;
+	int nr_competitors = 0;
+	struct wait_attr *attr;
+	unsigned long long lo;
+	unsigned long long hi;
+	struct cpu_state *cs;
+	struct cpu_run *run;
+	int fi;
+	int i;
+
+	if (!is_wait(sp_inst))
+		return;
+
+	/* only waits ended by scheduling in a focus task */
+	for (fi = 0; fi < rq->ntasks; fi++) {
+		if (out->def->ops->sched_out &&
+		    out->def->ops->sched_out(rq->tasks[fi], out->data) < 0)
+			break;
+	}
+	if (fi == rq->ntasks)
+		return;
+
+	cs = get_cpu(rq, out->cpu);
+	if (!cs)
+		return;
+
+	attr = array_grow(rq->attrs, rq->nr_attrs, sizeof(*attr));
+	if (!attr)
+		return;
+	rq->attrs = attr;
+
+	attr = &rq->attrs[rq->nr_attrs++];
+	memset(attr, 0, sizeof(*attr));
+	attr->tracelineno = sp_inst->tracelineno;
+	attr->def = sp_inst->def;
+	attr->name = sp_inst->def->name;
+	attr->task = rq->tasks[fi];
+	attr->begin = ts_to_ns(&sp_inst->ts);
+	attr->end = ts_to_ns(&out->ts);
+	attr->cpu = out->cpu;
+	attr->migrations = rq->focus[fi].migrations;
+	attr->from_cpu = attr->migrations ? rq->focus[fi].first_cpu :
+					    out->cpu;
+	rq->sorted = 0;
+
+	/* the tasks running on the CPU while the focus task waited */
+	for (i = 0; i < cs->nr_runs; i++) {
+		run = &cs->runs[i];
+		if (run->end <= attr->begin || run->begin >= attr->end ||
+		    run->task == attr->task) {
+			continue;
+		}
+
+		lo = run->begin > attr->begin ? run->begin : attr->begin;
+		hi = run->end < attr->end ? run->end : attr->end;
+
+		add_competitor(&competitors, &nr_competitors, run->task,
+			       run->comm, hi - lo);
+		add_competitor(&cs->competitors, &cs->nr_competitors,
+			       run->task, run->comm, hi - lo);
+	}
+
+	qsort(competitors, nr_competitors, sizeof(*competitors),
+	      cmp_competitor);
+	for (i = 0; i < nr_competitors && i < MAX_TOP; i++)
+		attr->top[i] = competitors[i];
+	attr->nr_top = i;
+	free(competitors);
+
+	cs->waits++;
+	cs->wait_ns += attr->end - attr->begin;
+}
+
+static int cmp_attr(const void *lhs, const void *rhs)
+{
+	const struct wait_attr *l = lhs;
+	const struct wait_attr *r = rhs;
+
+	if (l->tracelineno != r->tracelineno)
+		return (l->tracelineno < r->tracelineno) ? -1 : 1;
+
+	if (l->def != r->def)
+		return (l->def < r->def) ? -1 : 1;
+
+	return 0;
+}
+
+static void rq_significant(void *data, struct subpattern_instance *sp_inst,
+			   pid_t focus_task)
+{
+	struct runqueue *rq = data;
+	struct wait_attr *attr;
+	struct wait_attr key;
+
+	if (sp_inst->bound != in || !sp_inst->partner || !is_wait(sp_inst))
+		return;
+
+	if (!rq->sorted) {
+		qsort(rq->attrs, rq->nr_attrs, sizeof(*rq->attrs), cmp_attr);
+		rq->sorted = 1;
+	}
+
+	key.tracelineno = sp_inst->tracelineno;
+	key.def = sp_inst->def;
+	attr = bsearch(&key, rq->attrs, rq->nr_attrs, sizeof(*rq->attrs),
+		       cmp_attr);
+	if (attr && attr->task == focus_task)
+		attr->significant = 1;
+}
+
+static void print_attr(struct wait_attr *attr)
+{
+	int i;
+
+	printf("%llu.%06llu %s task %u waited %llu us on cpu %d",
+	       attr->begin / 1000000000ULL, attr->begin % 1000000000ULL / 1000,
+	       attr->name, attr->task, (attr->end - attr->begin) / 1000,
+	       attr->cpu);
+	if (attr->migrations) {
+		printf(" (from cpu %d, %d migration%s)", attr->from_cpu,
+		       attr->migrations, attr->migrations > 1 ? "s" : "");
+	}
+
+	for (i = 0; i < attr->nr_top; i++) {
+		printf("%s %s-%u %llu us", i ? "," : ":", attr->top[i].comm,
+		       attr->top[i].task, attr->top[i].ns / 1000);
+	}
+	printf("\n");
+}
+
+static void rq_report(void *data)
+{
+	struct runqueue *rq = data;
+	struct competitor *top;
+	struct cpu_state *cs;
+	int header = 0;
+	int i;
+
+	for (i = 0; i < rq->nr_attrs; i++) {
+		if (!rq->attrs[i].significant)
+			continue;
+
+		if (!header) {
+			printf("runqueue waits of significant"
+			       " sub-patterns:\n\n");
+			header = 1;
+		}
+		print_attr(&rq->attrs[i]);
+	}
+	if (header)
+		printf("\n");
+
+	header = 0;
+	for (i = 0; i < rq->nr_cpus; i++) {
+		cs = &rq->cpus[i];
+		if (!cs->waits && !cs->migrations_in && !cs->migrations_out)
+			continue;
+
+		if (!header) {
+			printf("runqueue waits of focus tasks per CPU:\n\n");
+			printf("%-5s %8s %10s %8s %8s  %s\n", "cpu", "waits",
+			       "wait us", "migr in", "migr out",
+			       "top competitor");
+			header = 1;
+		}
+
+		qsort(cs->competitors, cs->nr_competitors,
+		      sizeof(*cs->competitors), cmp_competitor);
+		top = cs->nr_competitors ? &cs->competitors[0] : NULL;
+
+		printf("%-5d %8lu %10llu %8lu %8lu  ", i, cs->waits,
+		       cs->wait_ns / 1000, cs->migrations_in,
+		       cs->migrations_out);
+		if (top)
+			printf("%s-%u %llu us\n", top->comm, top->task,
+			       top->ns / 1000);
+		else
+			printf("-\n");
+	}
+	if (header)
+		printf("\n");
+}
+
+/* forget the waits of pruned sub-patterns */
+static void rq_prune(void *data, unsigned long long before)
+{
+	struct runqueue *rq = data;
+	int i;
+	int n;
+
+	for (i = 0, n = 0; i < rq->nr_attrs; i++) {
+		if (rq->attrs[i].end >= before)
+			rq->attrs[n++] = rq->attrs[i];
+	}
+	rq->nr_attrs = n;
+}
+
+static void *rq_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct runqueue *rq;
+
+	/* it traces all sched_switch events, so it is opt-in */
+	if (!(subpattern_config(lc)->flags & SP_RUNQUEUE))
+		return NULL;
+
+	rq = calloc(1, sizeof(*rq));
+	if (!rq) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	rq->focus = calloc(ntasks, sizeof(*rq->focus));
+	if (!rq->focus) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		free(rq);
+		return NULL;
+	}
+
+	rq->tasks = tasks;
+	rq->ntasks = ntasks;
+	rq->sorted = 1;
+
+	return rq;
+}
+
+static int rq_enable(void *data, const char *tracingpath)
+{
+	(void)data;
+
+	/*
+	 * To know the tasks competing with the focus tasks for a CPU,
+	 * trace the sched_switch events of all tasks.
+	 */
+	return set_tracing(tracingpath, "events/sched/sched_switch/filter",
+			   "0");
+}
+
+static void rq_free_data(void *data)
+{
+	struct runqueue *rq = data;
+	int i;
+
+	if (!rq)
+		return;
+
+	for (i = 0; i < rq->nr_cpus; i++) {
+		free(rq->cpus[i].runs);
+		free(rq->cpus[i].competitors);
+	}
+	free(rq->cpus);
+	free(rq->attrs);
+	free(rq->focus);
+	free(rq);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = rq_init,
+	.enable = rq_enable,
+	.traceline = rq_traceline,
+	.closed = rq_closed,
+	.significant = rq_significant,
+	.report = rq_report,
+	.prune = rq_prune,
+	.free_data = rq_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "runqueue",
+	.ops = &pat_ops,
+};
+
+int register_runqueue(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
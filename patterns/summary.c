@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "latcheck.h"
+#include "util.h"
+#include "pattern.h"
+#include "patterns/patterns.h"
+#include "subpatterns/syscall.h"
+
+/*
+ * Collect the durations of all closed sub-patterns relevant to a focus
+ * task and count the significant ones (once, not per focus task), keyed
+ * by sub-pattern and syscalls by name. Only active if the config has a
+ * summary file descriptor, the summary is then written to it instead of
+ * a report (see capture.c):
+ *
+ *   t <pid>          a focus task
+ *   d <key> <ns>     a closed sub-pattern
+ *   s <key>          a significant sub-pattern
+ */
+
+struct summary_key {
+	char key[SUMMARY_KEY_MAX];
+	unsigned long long *ns;
+	int nr;
+	unsigned long significant;
+};
+
+struct summary {
+	struct latcheck *lc;
+	const pid_t *tasks;
+	int ntasks;
+	struct summary_key *keys;
+	int nr_keys;
+
+	/* -1 once the summary is written */
+	int fd;
+};
+
+static void make_key(struct subpattern_instance *sp_inst, char *key,
+		     size_t size)
+{
+	int nr = syscall_nr_of(sp_inst);
+	char name[64];
+
+	if (nr < 0) {
+		snprintf(key, size, "%s", sp_inst->def->name);
+		return;
+	}
+
+	if (syscall_name(nr, name, sizeof(name)) == 0)
+		snprintf(key, size, "%s:%s", sp_inst->def->name, name);
+	else
+		snprintf(key, size, "%s:%d", sp_inst->def->name, nr);
+}
+
+static struct summary_key *get_key(struct summary *sum,
+				   struct subpattern_instance *sp_inst)
+{
+	char key[SUMMARY_KEY_MAX];
+	struct summary_key *k;
+	int i;
+
+	make_key(sp_inst, key, sizeof(key));
+
+	for (i = 0; i < sum->nr_keys; i++) {
+		if (strcmp(sum->keys[i].key, key) == 0)
+			return &sum->keys[i];
+	}
+
+	k = array_grow(sum->keys, sum->nr_keys, sizeof(*k));
+	if (!k)
+		return NULL;
+	sum->keys = k;
+
+	k = &sum->keys[sum->nr_keys++];
+	memset(k, 0, sizeof(*k));
+	strcpy(k->key, key);
+
+	return k;
+}
+
+static int is_relevant(struct summary *sum,
+		       struct subpattern_instance *sp_inst)
+{
+	const struct subpattern_ops *ops = sp_inst->def->ops;
+	int i;
+
+	for (i = 0; i < sum->ntasks; i++) {
+		if (!ops->is_relevant ||
+		    ops->is_relevant(sum->tasks[i], sp_inst->data) ||
+		    ops->is_relevant(sum->tasks[i], sp_inst->partner->data)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void sum_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct summary *sum = data;
+	struct summary_key *k;
+	unsigned long long *ns;
+
+	if (sum->fd < 0 || !is_relevant(sum, sp_inst))
+		return;
+
+	k = get_key(sum, sp_inst);
+	if (!k)
+		return;
+
+	ns = array_grow(k->ns, k->nr, sizeof(*ns));
+	if (!ns)
+		return;
+	k->ns = ns;
+
+	k->ns[k->nr++] = ts_to_ns(&sp_inst->partner->ts) -
+			 ts_to_ns(&sp_inst->ts);
+}
+
+static void sum_significant(void *data, struct subpattern_instance *sp_inst,
+			    pid_t focus_task)
+{
+	struct summary *sum = data;
+	struct summary_key *k;
+	int fi;
+
+	if (sum->fd < 0 || sp_inst->bound != in || !sp_inst->partner)
+		return;
+
+	/* count each instance once, not per focus task */
+	for (fi = subpattern_focus_index(sum->lc, focus_task) - 1;
+	     fi >= 0; fi--) {
+		if (sp_inst->is_significant[fi])
+			return;
+	}
+
+	k = get_key(sum, sp_inst);
+	if (k)
+		k->significant++;
+}
+
+static void sum_report(void *data)
+{
+	struct summary *sum = data;
+	struct summary_key *k;
+	unsigned long j;
+	FILE *f;
+	int i;
+
+	if (sum->fd < 0)
+		return;
+
+	f = fdopen(sum->fd, "w");
+	if (!f) {
+		fprintf(stderr, "fdopen failed: %s\n", strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < sum->ntasks; i++)
+		fprintf(f, "t %u\n", sum->tasks[i]);
+
+	for (i = 0; i < sum->nr_keys; i++) {
+		k = &sum->keys[i];
+
+		for (j = 0; j < (unsigned long)k->nr; j++)
+			fprintf(f, "d %s %llu\n", k->key, k->ns[j]);
+		for (j = 0; j < k->significant; j++)
+			fprintf(f, "s %s\n", k->key);
+	}
+
+	fclose(f);
+	sum->fd = -1;
+}
+
+static void *sum_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	int fd = subpattern_config(lc)->summary_fd;
+	struct summary *sum;
+
+	if (!fd)
+		return NULL;
+
+	sum = calloc(1, sizeof(*sum));
+	if (!sum) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	sum->lc = lc;
+	sum->tasks = tasks;
+	sum->ntasks = ntasks;
+	sum->fd = fd;
+
+	return sum;
+}
+
+static void sum_free_data(void *data)
+{
+	struct summary *sum = data;
+	int i;
+
+	if (!sum)
+		return;
+
+	for (i = 0; i < sum->nr_keys; i++)
+		free(sum->keys[i].ns);
+	free(sum->keys);
+	free(sum);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = sum_init,
+	.closed = sum_closed,
+	.significant = sum_significant,
+	.report = sum_report,
+	.free_data = sum_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "summary",
+	.ops = &pat_ops,
+};
+
+int register_summary(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "pattern.h"
+#include "subpatterns/hrtimer.h"
+
+/*
+ * Decompose the latency from the requested expiry of a timer of a focus
+ * task to the task running again:
+ *
+ * - slack:    the timer expired late (actual minus requested expiry)
+ * - handler:  from the start of the timer callback to the wakeup of
+ *             the task (sched_wakeup within the callback, same CPU)
+ * - wakeup:   the sched_latency of that wakeup
+ *
+ * The requested expiry is in the clock of the timer, only the slack is
+ * computed in that clock. All other parts use the trace clock.
+ */
+
+struct timer_part {
+	long long total;
+	long long max;
+};
+
+struct timer_chain {
+	long long slack;
+	long long handler;
+	long long wakeup;
+	unsigned long long begin;
+};
+
+struct timer_task {
+	/* the last expiry, waiting for its wakeup */
+	int pending;
+	int cpu;
+	long long slack;
+	unsigned long long entry;
+	unsigned long long exit;
+
+	unsigned long timers;
+	struct timer_part slack_st;
+	struct timer_part handler_st;
+	struct timer_part wakeup_st;
+	struct timer_part total_st;
+	struct timer_chain worst;
+};
+
+struct timer_latency {
+	const pid_t *tasks;
+	int ntasks;
+	struct timer_task *focus;
+};
+
+static int focus_index(struct timer_latency *tl, pid_t task)
+{
+	int i;
+
+	for (i = 0; i < tl->ntasks; i++) {
+		if (tl->tasks[i] == task)
+			return i;
+	}
+
+	return -1;
+}
+
+static void add_part(struct timer_part *part, long long ns)
+{
+	part->total += ns;
+	if (ns > part->max)
+		part->max = ns;
+}
+
+static void expiry_closed(struct timer_latency *tl,
+			  struct subpattern_instance *sp_inst,
+			  const struct hrtimer_event *ev)
+{
+	const struct hrtimer_event *out = hrtimer_expiry_of(sp_inst->partner);
+	struct timer_task *t;
+	int fi;
+
+	fi = focus_index(tl, ev->task);
+	if (fi < 0)
+		return;
+	t = &tl->focus[fi];
+
+	t->pending = 0;
+	if (out->cancelled)
+		return;
+
+	t->pending = 1;
+	t->cpu = sp_inst->partner->cpu;
+	t->slack = (long long)out->now - (long long)ev->expires;
+	t->entry = ts_to_ns(&sp_inst->partner->ts);
+	t->exit = 0;
+}
+
+static void handler_closed(struct timer_latency *tl,
+			   struct subpattern_instance *sp_inst,
+			   const struct hrtimer_event *ev)
+{
+	struct timer_task *t;
+	int fi;
+
+	fi = focus_index(tl, ev->task);
+	if (fi < 0)
+		return;
+	t = &tl->focus[fi];
+
+	if (t->pending && t->entry == ts_to_ns(&sp_inst->ts))
+		t->exit = ts_to_ns(&sp_inst->partner->ts);
+}
+
+static void latency_closed(struct timer_latency *tl,
+			   struct subpattern_instance *sp_inst)
+{
+	struct subpattern_instance *out = sp_inst->partner;
+	unsigned long long wakeup;
+	struct timer_chain chain;
+	struct timer_task *t;
+	int fi;
+
+	for (fi = 0; fi < tl->ntasks; fi++) {
+		if (out->def->ops->sched_out &&
+		    out->def->ops->sched_out(tl->tasks[fi], out->data) < 0)
+			break;
+	}
+	if (fi == tl->ntasks)
+		return;
+	t = &tl->focus[fi];
+
+	/* only the wakeup from within the timer callback */
+	wakeup = ts_to_ns(&sp_inst->ts);
+	if (!t->pending || sp_inst->cpu != t->cpu || wakeup < t->entry ||
+	    (t->exit && wakeup > t->exit)) {
+		return;
+	}
+	t->pending = 0;
+
+	chain.slack = t->slack;
+	chain.handler = wakeup - t->entry;
+	chain.wakeup = ts_to_ns(&out->ts) - wakeup;
+	/* the requested expiry in the trace clock */
+	chain.begin = t->entry - t->slack;
+
+	t->timers++;
+	add_part(&t->slack_st, chain.slack);
+	add_part(&t->handler_st, chain.handler);
+	add_part(&t->wakeup_st, chain.wakeup);
+	add_part(&t->total_st, chain.slack + chain.handler + chain.wakeup);
+
+	if (t->timers == 1 ||
+	    chain.slack + chain.handler + chain.wakeup >
+	    t->worst.slack + t->worst.handler + t->worst.wakeup) {
+		t->worst = chain;
+	}
+}
+
+static void tl_closed(void *data, struct subpattern_instance *sp_inst)
+{
+	struct timer_latency *tl = data;
+	const struct hrtimer_event *ev;
+
+	ev = hrtimer_expiry_of(sp_inst);
+	if (ev) {
+		expiry_closed(tl, sp_inst, ev);
+		return;
+	}
+
+	ev = hrtimer_handler_of(sp_inst);
+	if (ev) {
+		handler_closed(tl, sp_inst, ev);
+		return;
+	}
+
+	if (strcmp(sp_inst->def->name, "sched_latency") == 0)
+		latency_closed(tl, sp_inst);
+}
+
+static void print_part(struct timer_part *part, unsigned long n)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%lld/%lld", part->total / (long long)n /
+		 1000, part->max / 1000);
+	printf(" %12s", buf);
+}
+
+static void tl_report(void *data)
+{
+	struct timer_latency *tl = data;
+	struct timer_task *t;
+	int header = 0;
+	int i;
+
+	for (i = 0; i < tl->ntasks; i++) {
+		t = &tl->focus[i];
+		if (!t->timers)
+			continue;
+
+		if (!header) {
+			printf("timer-to-run latency of focus tasks"
+			       " (avg/max us):\n\n");
+			printf("%-8s %7s %12s %12s %12s %12s\n", "task",
+			       "timers", "slack", "handler", "wakeup",
+			       "total");
+			header = 1;
+		}
+
+		printf("%-8u %7lu", tl->tasks[i], t->timers);
+		print_part(&t->slack_st, t->timers);
+		print_part(&t->handler_st, t->timers);
+		print_part(&t->wakeup_st, t->timers);
+		print_part(&t->total_st, t->timers);
+		printf("\n");
+	}
+	if (!header)
+		return;
+	printf("\n");
+
+	for (i = 0; i < tl->ntasks; i++) {
+		t = &tl->focus[i];
+		if (!t->timers)
+			continue;
+
+		printf("%llu.%06llu task %u worst timer-to-run latency %lld us:"
+		       " slack %lld us, handler %lld us, wakeup %lld us\n",
+		       t->worst.begin / 1000000000ULL,
+		       t->worst.begin % 1000000000ULL / 1000, tl->tasks[i],
+		       (t->worst.slack + t->worst.handler +
+			t->worst.wakeup) / 1000,
+		       t->worst.slack / 1000, t->worst.handler / 1000,
+		       t->worst.wakeup / 1000);
+	}
+	printf("\n");
+}
+
+/* an expiry before the retained history lost its wakeup */
+static void tl_prune(void *data, unsigned long long before)
+{
+	struct timer_latency *tl = data;
+	struct timer_task *t;
+	int i;
+
+	for (i = 0; i < tl->ntasks; i++) {
+		t = &tl->focus[i];
+		if (t->pending && t->entry < before)
+			t->pending = 0;
+	}
+}
+
+static void *tl_init(struct latcheck *lc, const pid_t *tasks, int ntasks)
+{
+	struct timer_latency *tl;
+
+	(void)lc;
+
+	tl = calloc(1, sizeof(*tl));
+	if (!tl) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	tl->focus = calloc(ntasks, sizeof(*tl->focus));
+	if (!tl->focus) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		free(tl);
+		return NULL;
+	}
+
+	tl->tasks = tasks;
+	tl->ntasks = ntasks;
+
+	return tl;
+}
+
+static void tl_free_data(void *data)
+{
+	struct timer_latency *tl = data;
+
+	if (!tl)
+		return;
+
+	free(tl->focus);
+	free(tl);
+}
+
+static const struct pattern_ops pat_ops = {
+	.init = tl_init,
+	.closed = tl_closed,
+	.report = tl_report,
+	.prune = tl_prune,
+	.free_data = tl_free_data,
+};
+
+static const struct pattern_definition pat_def = {
+	.name = "timer_latency",
+	.ops = &pat_ops,
+};
+
+int register_timer_latency(struct pattern_set *ps)
+{
+	return register_pattern(ps, &pat_def);
+}
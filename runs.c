@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "runs.h"
+
+/*
+ * Merge the summaries of repeated runs of a command. For every
+ * sub-pattern the durations of all runs are merged into one
+ * distribution and the runs with a significant instance are counted,
+ * which gives the probability of a significant latency recurring in a
+ * run.
+ */
+
+#define MAX_LOG2 32
+
+/* a run with a significant instance is worse than any run without */
+#define SCORE_SIGNIFICANT (1ULL << 62)
+
+static struct runs_kind *get_kind(struct runs *r, const char *key)
+{
+	struct runs_kind *k;
+	int i;
+
+	for (i = 0; i < r->nr_kinds; i++) {
+		if (strcmp(r->kinds[i].key, key) == 0)
+			return &r->kinds[i];
+	}
+
+	k = array_grow(r->kinds, r->nr_kinds, sizeof(*k));
+	if (!k)
+		return NULL;
+	r->kinds = k;
+
+	k = &r->kinds[r->nr_kinds++];
+	memset(k, 0, sizeof(*k));
+	snprintf(k->key, sizeof(k->key), "%s", key);
+
+	return k;
+}
+
+int runs_add(struct runs *r, struct capture *c)
+{
+	struct capture_kind *ck;
+	struct runs_kind *k;
+	unsigned long long *ns;
+	int i;
+
+	r->nr_runs++;
+
+	for (i = 0; i < c->nr_kinds; i++) {
+		ck = &c->kinds[i];
+
+		k = get_kind(r, ck->key);
+		if (!k)
+			return -1;
+
+		if (ck->nr) {
+			ns = realloc(k->ns, (k->nr + ck->nr) * sizeof(*ns));
+			if (!ns) {
+				fprintf(stderr, "realloc failed: %s\n",
+					strerror(errno));
+				return -1;
+			}
+			k->ns = ns;
+			memcpy(&k->ns[k->nr], ck->ns, ck->nr * sizeof(*ns));
+			k->nr += ck->nr;
+		}
+
+		k->seen++;
+		if (ck->significant)
+			k->significant_runs++;
+		k->significant += ck->significant;
+	}
+
+	return 0;
+}
+
+/*
+ * How bad a run is: the longest duration of a sub-pattern with a
+ * significant instance, else the longest wakeup latency.
+ */
+unsigned long long runs_score(struct capture *c)
+{
+	unsigned long long score = 0;
+	struct capture_kind *k;
+	int i;
+
+	for (i = 0; i < c->nr_kinds; i++) {
+		k = &c->kinds[i];
+		if (k->significant && k->nr && k->ns[k->nr - 1] > score)
+			score = k->ns[k->nr - 1];
+	}
+	if (score)
+		return score | SCORE_SIGNIFICANT;
+
+	k = capture_find(c, "sched_latency");
+	if (k && k->nr)
+		return k->ns[k->nr - 1];
+
+	return 0;
+}
+
+static int cmp_ull(const void *lhs, const void *rhs)
+{
+	const unsigned long long *l = lhs;
+	const unsigned long long *r = rhs;
+
+	if (*l != *r)
+		return (*l < *r) ? -1 : 1;
+
+	return 0;
+}
+
+static int cmp_kind(const void *lhs, const void *rhs)
+{
+	const struct runs_kind *l = lhs;
+	const struct runs_kind *r = rhs;
+
+	if (l->significant_runs != r->significant_runs)
+		return r->significant_runs - l->significant_runs;
+
+	return strcmp(l->key, r->key);
+}
+
+static void print_hist(struct runs_kind *k)
+{
+	unsigned long hist[MAX_LOG2];
+	unsigned long long us;
+	int i;
+	int j;
+
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < k->nr; i++) {
+		us = k->ns[i] / 1000;
+		for (j = 0; us > 1 && j < MAX_LOG2 - 1; j++)
+			us >>= 1;
+		hist[j]++;
+	}
+
+	printf("%s duration (all runs):\n\n", k->key);
+	printf("  %19s %10s\n", "us", "count");
+	for (i = 0; i < MAX_LOG2; i++) {
+		if (!hist[i])
+			continue;
+
+		printf("  %8lu - %-8lu %10lu\n", i ? 1UL << i : 0UL,
+		       (2UL << i) - 1, hist[i]);
+	}
+	printf("\n");
+}
+
+void runs_print(struct runs *r)
+{
+	struct runs_kind *k;
+	int i;
+
+	for (i = 0; i < r->nr_kinds; i++) {
+		qsort(r->kinds[i].ns, r->kinds[i].nr, sizeof(*r->kinds[i].ns),
+		      cmp_ull);
+	}
+	qsort(r->kinds, r->nr_kinds, sizeof(*r->kinds), cmp_kind);
+
+	printf("%d runs:\n\n", r->nr_runs);
+	printf("%-28s %6s %8s %8s %8s %8s %8s\n", "sub-pattern", "runs",
+	       "sig runs", "recur %", "sig", "p99 us", "max us");
+	for (i = 0; i < r->nr_kinds; i++) {
+		k = &r->kinds[i];
+
+		printf("%-28s %6d %8d %8.1f %8lu", k->key, k->seen,
+		       k->significant_runs,
+		       100.0 * k->significant_runs / r->nr_runs,
+		       k->significant);
+		if (k->nr) {
+			printf(" %8llu %8llu\n",
+			       k->ns[(k->nr * 99 + 99) / 100 - 1] / 1000,
+			       k->ns[k->nr - 1] / 1000);
+		} else {
+			printf(" %8s %8s\n", "-", "-");
+		}
+	}
+	printf("\n");
+
+	for (i = 0; i < r->nr_kinds; i++) {
+		if (r->kinds[i].significant_runs)
+			print_hist(&r->kinds[i]);
+	}
+}
+
+void runs_free(struct runs *r)
+{
+	int i;
+
+	for (i = 0; i < r->nr_kinds; i++)
+		free(r->kinds[i].ns);
+	free(r->kinds);
+	memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RUNS_H
+#define RUNS_H
+
+#include "capture.h"
+
+/* one sub-pattern over all runs */
+struct runs_kind {
+	char key[SUMMARY_KEY_MAX];
+	unsigned long long *ns;
+	int nr;
+	int seen;
+	int significant_runs;
+	unsigned long significant;
+};
+
+/* the merged summaries of repeated runs (see capture.c) */
+struct runs {
+	int nr_runs;
+	struct runs_kind *kinds;
+	int nr_kinds;
+};
+
+extern int runs_add(struct runs *r, struct capture *c);
+extern unsigned long long runs_score(struct capture *c);
+extern void runs_print(struct runs *r);
+extern void runs_free(struct runs *r);
+
+#endif /* RUNS_H */
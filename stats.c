@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+int stats_enabled;
+__thread struct stats stats_local;
+
+static struct stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *def_names[STATS_MAX_DEFS];
+
+static const char *phase_names[STATS_NR_PHASES] = {
+	[STATS_MATCH] = "match",
+	[STATS_SIGNIFICANCE] = "significance",
+	[STATS_LEVELS] = "levels",
+	[STATS_PRINT] = "print",
+	[STATS_REPORT] = "report",
+};
+
+void stats_enable(void)
+{
+	stats_enabled = 1;
+}
+
+void stats_def_name(int id, const char *name)
+{
+	if (id < 0 || id >= STATS_MAX_DEFS)
+		return;
+
+	/* all contexts register the same names, the first one is kept */
+	pthread_mutex_lock(&totals_lock);
+	if (!def_names[id])
+		def_names[id] = name;
+	pthread_mutex_unlock(&totals_lock);
+}
+
+unsigned long long stats_begin(void)
+{
+	struct timespec ts;
+
+	if (!stats_enabled)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_end(enum stats_phase phase, unsigned long long begin)
+{
+	if (!stats_enabled)
+		return;
+
+	stats_local.ns[phase] += stats_begin() - begin;
+}
+
+void stats_merge(void)
+{
+	int i;
+
+	if (!stats_enabled)
+		return;
+
+	pthread_mutex_lock(&totals_lock);
+
+	totals.lines += stats_local.lines;
+	totals.parse_failures += stats_local.parse_failures;
+	totals.instances += stats_local.instances;
+	totals.marks += stats_local.marks;
+	if (stats_local.open_max > totals.open_max)
+		totals.open_max = stats_local.open_max;
+	for (i = 0; i < STATS_MAX_DEFS; i++) {
+		totals.match_calls[i] += stats_local.match_calls[i];
+		totals.match_hits[i] += stats_local.match_hits[i];
+	}
+	for (i = 0; i < STATS_NR_PHASES; i++)
+		totals.ns[i] += stats_local.ns[i];
+
+	pthread_mutex_unlock(&totals_lock);
+
+	memset(&stats_local, 0, sizeof(stats_local));
+}
+
+static long peak_rss_kb(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+
+	return ru.ru_maxrss;
+}
+
+static void report_text(FILE *f)
+{
+	int i;
+
+	fprintf(f, "statistics:\n\n");
+	fprintf(f, "lines                %lu\n", totals.lines);
+	fprintf(f, "parse failures       %lu\n", totals.parse_failures);
+	fprintf(f, "instances            %lu\n", totals.instances);
+	fprintf(f, "open instances max   %lu\n", totals.open_max);
+	fprintf(f, "significance marks   %lu\n", totals.marks);
+	fprintf(f, "peak RSS             %ld kB\n", peak_rss_kb());
+
+	fprintf(f, "\n%-24s %12s %12s\n", "sub-pattern", "match calls",
+		"matches");
+	for (i = 0; i < STATS_MAX_DEFS; i++) {
+		if (!def_names[i])
+			continue;
+		fprintf(f, "%-24s %12lu %12lu\n", def_names[i],
+			totals.match_calls[i], totals.match_hits[i]);
+	}
+
+	fprintf(f, "\n%-24s %12s\n", "phase", "ms");
+	for (i = 0; i < STATS_NR_PHASES; i++)
+		fprintf(f, "%-24s %12.3f\n", phase_names[i],
+			totals.ns[i] / 1000000.0);
+	fprintf(f, "\n");
+}
+
+static void report_json(FILE *f)
+{
+	int first = 1;
+	int i;
+
+	fprintf(f, "{\"lines\": %lu, \"parse_failures\": %lu,"
+		" \"instances\": %lu, \"open_max\": %lu, \"marks\": %lu,"
+		" \"peak_rss_kb\": %ld,\n", totals.lines,
+		totals.parse_failures, totals.instances, totals.open_max,
+		totals.marks, peak_rss_kb());
+
+	fprintf(f, " \"subpatterns\": {");
+	for (i = 0; i < STATS_MAX_DEFS; i++) {
+		if (!def_names[i])
+			continue;
+		fprintf(f, "%s\"%s\": {\"match_calls\": %lu, \"matches\": %lu}",
+			first ? "" : ", ", def_names[i],
+			totals.match_calls[i], totals.match_hits[i]);
+		first = 0;
+	}
+	fprintf(f, "},\n");
+
+	fprintf(f, " \"phases_ms\": {");
+	for (i = 0; i < STATS_NR_PHASES; i++)
+		fprintf(f, "%s\"%s\": %.3f", i ? ", " : "", phase_names[i],
+			totals.ns[i] / 1000000.0);
+	fprintf(f, "}}\n");
+}
+
+void stats_report(FILE *f, int json)
+{
+	stats_merge();
+
+	if (json)
+		report_json(f);
+	else
+		report_text(f);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/*
+ * Self-instrumentation. The counters are per thread and only touched
+ * if statistics are enabled, so they cost a predictable branch when
+ * disabled. Threads merge their counters into the totals with
+ * stats_merge() before they exit.
+ */
+
+#define STATS_MAX_DEFS 64
+
+enum stats_phase {
+	STATS_MATCH = 0,
+	STATS_SIGNIFICANCE,
+	STATS_LEVELS,
+	STATS_PRINT,
+	STATS_REPORT,
+	STATS_NR_PHASES,
+};
+
+struct stats {
+	unsigned long lines;
+	unsigned long parse_failures;
+	unsigned long instances;
+	unsigned long open;
+	unsigned long open_max;
+	unsigned long marks;
+	unsigned long match_calls[STATS_MAX_DEFS];
+	unsigned long match_hits[STATS_MAX_DEFS];
+	unsigned long long ns[STATS_NR_PHASES];
+};
+
+extern int stats_enabled;
+extern __thread struct stats stats_local;
+
+#define STATS_INC(field) \
+	do { if (stats_enabled) stats_local.field++; } while (0)
+
+#define STATS_DEF_INC(field, id)					\
+	do {								\
+		if (stats_enabled && (id) < STATS_MAX_DEFS)		\
+			stats_local.field[(id)]++;			\
+	} while (0)
+
+#define STATS_OPEN(delta)						\
+	do {								\
+		if (stats_enabled) {					\
+			stats_local.open += (delta);			\
+			if (stats_local.open > stats_local.open_max)	\
+				stats_local.open_max = stats_local.open; \
+		}							\
+	} while (0)
+
+extern void stats_enable(void);
+extern void stats_def_name(int id, const char *name);
+extern unsigned long long stats_begin(void);
+extern void stats_end(enum stats_phase phase, unsigned long long begin);
+extern void stats_merge(void);
+extern void stats_report(FILE *f, int json);
+
+#endif /* STATS_H */
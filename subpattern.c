@@ -20,8 +20,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "subpatterns/subpatterns.h"
 #include "subpattern.h"
+#include "pattern.h"
+#include "latcheck.h"
+#include "stats.h"
+#include "trace_event.h"
+#include "util.h"
 
 #define TERM_RESET() printf("\e[0m")
 #define TERM_CURSOR_END() printf("\e[K")
@@ -29,45 +35,217 @@
 #define TERM_FGBG_NORMAL() printf("\e[107m\e[30m")
 #define TERM_FGBG_HIGHLIGHT() printf("\e[48;5;228m\e[38;5;124m")
 
-struct subpattern_instance {
-	struct timespec ts;
-	char taskname[16];
-	pid_t task;
-	enum subpattern_boundary bound;
-	struct subpattern_instance *partner;
-	struct subpattern_definition *def;
+/*
+ * In windowed mode only the trace windows around violations reported
+ * by patterns are printed. Instances that are older than the retained
+ * history are dropped while the trace is processed, so that memory
+ * stays bounded when tracing continuously.
+ */
+#define MAX_WINDOW_REASONS 8
+#define PRUNE_INTERVAL 1024
+
+#define MAX_STACK_DEPTH 64
+#define MAX_DEFINITIONS 32
+
+/* a registered sub-pattern of one analysis context */
+struct subpattern_entry {
+	const struct subpattern_definition *def;
+	/* the id of the definition in the context (for --stats) */
+	int id;
+	/* the state of the definition in the context */
 	void *data;
 
-	int is_significant;
-	int level;
-	unsigned long tracelineno;
+	LIST_ENTRY(subpattern_entry) list;
+};
 
-	TAILQ_ENTRY(subpattern_instance) list_trace;
-	LIST_ENTRY(subpattern_instance) list_open;
+/*
+ * The state of one analysis. All state of the matching and significance
+ * engine lives here (and the state of the sub-patterns and patterns in
+ * the context as well), so that several analyses can run independently,
+ * e.g. one per thread of a monitoring agent (see latcheck.h).
+ */
+struct latcheck {
+	LIST_HEAD(listhead_definitions, subpattern_entry) head_def;
+	TAILQ_HEAD(listhead_instances, subpattern_instance) head_inst;
+	LIST_HEAD(listhead_open, subpattern_instance) head_open;
+	int nr_defs;
+	struct pattern_set *patterns;
+
+	pid_t focus_tasks[MAX_FOCUS_TASKS];
+	int nr_focus_tasks;
+
+	unsigned long tracelineno;
+	unsigned long nr_instances;
+
+	int windowed;
+	int stacktrace;
+	int quiet;
+	unsigned long long window_ns;
+	unsigned long max_instances;
+	unsigned long overhead_ns;
+
+	/* the number of trace events per CPU so far (for -O) */
+	unsigned long *cpu_events;
+	int nr_cpus;
+
+	/* the time range of interest (--from/--to), 0 if unbounded */
+	unsigned long long range_begin;
+	unsigned long long range_end;
+
+	int window_pending;
+	unsigned long long window_begin;
+	unsigned long long window_end;
+	char window_reasons[MAX_WINDOW_REASONS][128];
+	int nr_window_reasons;
+
+	int deepest_level;
+	char levels[32];
+
+	/* the first instance created by the most recent trace event line */
+	struct subpattern_instance *line_inst;
+
+	/* the instance the current <stack trace> block is attached to */
+	struct subpattern_instance *stack_inst;
+	char stack_frames[MAX_STACK_DEPTH][128];
+	int stack_depth;
+
+	latcheck_closed_fn closed;
+	latcheck_significant_fn significant;
+	void *arg;
+
+	/* the config given to latcheck_new(), only while in it */
+	const struct latcheck_config *cfg;
 };
 
-static LIST_HEAD(listhead_definitions, subpattern_definition) head_def;
-static TAILQ_HEAD(listhead_instances, subpattern_instance) head_inst;
-static LIST_HEAD(listhead_open, subpattern_instance) head_open;
-static int def_id_last;
+/* the defaults of latcheck_config */
+#define DEFAULT_WINDOW_NS 10000000ULL
+#define DEFAULT_MAX_INSTANCES 100000
 
-static unsigned long tracelineno;
+/* the context of subpattern_init() and its config */
+static struct latcheck *default_lc;
+static struct latcheck_config default_cfg;
 
-int register_subpattern(struct subpattern_definition *def)
+int register_subpattern(struct latcheck *lc,
+			const struct subpattern_definition *def)
 {
-	def_id_last++;
-	def->id = def_id_last;
-	LIST_INSERT_HEAD(&head_def, def, list);
+	struct subpattern_entry *se;
+
+	if (lc->nr_defs >= MAX_DEFINITIONS) {
+		fprintf(stderr, "too many sub-patterns (max %d)\n",
+			MAX_DEFINITIONS);
+		return -1;
+	}
+
+	se = calloc(1, sizeof(*se));
+	if (!se) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* all contexts register the definitions in the same order */
+	lc->nr_defs++;
+	se->id = lc->nr_defs;
+	se->def = def;
+	LIST_INSERT_HEAD(&lc->head_def, se, list);
+
+	stats_def_name(se->id, def->name);
 
 	return 0;
 }
 
-static void check_match(const char *line, struct subpattern_instance *inbound,
-			struct timespec *ts, pid_t task, const char *taskname)
+static struct subpattern_entry *
+find_entry(struct latcheck *lc, const struct subpattern_definition *def)
+{
+	struct subpattern_entry *se;
+
+	LIST_FOREACH(se, &lc->head_def, list) {
+		if (se->def == def)
+			return se;
+	}
+
+	return NULL;
+}
+
+/* the state of a sub-pattern definition in the context */
+void *subpattern_data(struct latcheck *lc,
+		      const struct subpattern_definition *def)
+{
+	struct subpattern_entry *se = find_entry(lc, def);
+
+	return se ? se->data : NULL;
+}
+
+void subpattern_set_data(struct latcheck *lc,
+			 const struct subpattern_definition *def, void *data)
 {
-	struct subpattern_definition *sp_def;
+	struct subpattern_entry *se = find_entry(lc, def);
+
+	if (se)
+		se->data = data;
+}
+
+/* a closed instance as seen by library callbacks */
+static void to_public(struct subpattern_instance *sp_inst,
+		      struct latcheck_instance *inst)
+{
+	struct subpattern_instance *begin = sp_inst;
+
+	if (sp_inst->bound == out)
+		begin = sp_inst->partner;
+
+	inst->name = begin->def->name;
+	inst->taskname = begin->taskname;
+	inst->task = begin->task;
+	inst->cpu = begin->cpu;
+	inst->begin_ns = ts_to_ns(&begin->ts);
+	inst->end_ns = ts_to_ns(&begin->partner->ts);
+}
+
+/* the events on a CPU so far, 0 if none were counted */
+static unsigned long cpu_event_count(struct latcheck *lc, int cpu)
+{
+	if (cpu < 0 || cpu >= lc->nr_cpus)
+		return 0;
+
+	return lc->cpu_events[cpu];
+}
+
+/* count a trace event on a CPU, returns the events on the CPU so far */
+static unsigned long count_cpu_event(struct latcheck *lc, int cpu)
+{
+	unsigned long *cpu_events;
+
+	if (cpu < 0)
+		return 0;
+
+	if (cpu >= lc->nr_cpus) {
+		cpu_events = realloc(lc->cpu_events,
+				     (cpu + 1) * sizeof(*cpu_events));
+		if (!cpu_events) {
+			fprintf(stderr, "realloc failed: %s\n",
+				strerror(errno));
+			return 0;
+		}
+		memset(&cpu_events[lc->nr_cpus], 0,
+		       (cpu + 1 - lc->nr_cpus) * sizeof(*cpu_events));
+		lc->cpu_events = cpu_events;
+		lc->nr_cpus = cpu + 1;
+	}
+
+	return ++lc->cpu_events[cpu];
+}
+
+static void check_match(struct latcheck *lc, const char *line,
+			const struct trace_event *ev,
+			struct subpattern_instance *inbound,
+			struct timespec *ts, int cpu, pid_t task,
+			const char *taskname)
+{
+	const struct subpattern_definition *sp_def;
 	struct subpattern_instance *sp_inst;
 	enum subpattern_boundary bound = in;
+	struct latcheck_instance pub;
+	struct subpattern_entry *se;
 	void *inbound_data = NULL;
 	void *data;
 
@@ -80,18 +258,24 @@ static void check_match(const char *line, struct subpattern_instance *inbound,
 		inbound_data = inbound->data;
 	}
 
-	LIST_FOREACH(sp_def, &head_def, list) {
+	LIST_FOREACH(se, &lc->head_def, list) {
+		sp_def = se->def;
 
 		if (!sp_def->ops || !sp_def->ops->match)
 			continue;
 
-		if (inbound && inbound->def->id != sp_def->id)
+		if (inbound && inbound->def != sp_def)
 			continue;
 
-		data = sp_def->ops->match(line, task, bound, inbound_data);
+		STATS_DEF_INC(match_calls, se->id);
+
+		data = sp_def->ops->match(lc, line, ev, task, bound,
+					  inbound_data);
 		if (!data)
 			continue;
 
+		STATS_DEF_INC(match_hits, se->id);
+
 		sp_inst = calloc(1, sizeof(*sp_inst));
 		if (!sp_inst) {
 			fprintf(stderr, "calloc failed: %s\n",
@@ -104,16 +288,31 @@ static void check_match(const char *line, struct subpattern_instance *inbound,
 		sp_inst->bound = bound;
 		sp_inst->def = sp_def;
 		sp_inst->task = task;
+		sp_inst->cpu = cpu;
 		strcpy(sp_inst->taskname, taskname);
 		sp_inst->data = data;
-		sp_inst->tracelineno = tracelineno;
+		sp_inst->tracelineno = lc->tracelineno;
 
-		TAILQ_INSERT_TAIL(&head_inst, sp_inst, list_trace);
+		/* the events on the CPU where the subpattern began */
+		if (lc->overhead_ns) {
+			sp_inst->cpu_events = cpu_event_count(lc,
+				inbound ? inbound->cpu : cpu);
+		}
+
+		TAILQ_INSERT_TAIL(&lc->head_inst, sp_inst, list_trace);
+		lc->nr_instances++;
+		STATS_INC(instances);
 
 		if (inbound) {
 			sp_inst->partner = inbound;
 			inbound->partner = sp_inst;
 
+			pattern_closed(lc->patterns, inbound);
+			if (lc->closed) {
+				to_public(inbound, &pub);
+				lc->closed(&pub, lc->arg);
+			}
+
 			/*
 			 * There can only be one pair. Since we've found
 			 * a partner, we must stop looking. The caller
@@ -123,15 +322,14 @@ static void check_match(const char *line, struct subpattern_instance *inbound,
 			 */
 			break;
 		} else {
-			LIST_INSERT_HEAD(&head_open, sp_inst, list_open);
+			LIST_INSERT_HEAD(&lc->head_open, sp_inst, list_open);
+			STATS_OPEN(1);
 		}
 	}
 }
 
-static int deepest_level;
-static char levels[32];
-
-static void print_blankline(struct timespec *ts, int so_level)
+static void print_blankline(struct latcheck *lc, struct timespec *ts,
+			    int so_level)
 {
 	char tsbuf[16];
 	int i;
@@ -141,11 +339,11 @@ static void print_blankline(struct timespec *ts, int so_level)
 		printf(" ");
 	printf("        ");
 
-	for (i = 1; i < deepest_level; i++) {
+	for (i = 1; i < lc->deepest_level; i++) {
 		if (i == so_level)
 			TERM_FGBG_HIGHLIGHT();
 
-		if (levels[i])
+		if (lc->levels[i])
 			printf("|  ");
 		else
 			printf("   ");
@@ -155,7 +353,8 @@ static void print_blankline(struct timespec *ts, int so_level)
 	}
 }
 
-static void print_instance(struct subpattern_instance *sp_inst, int so_level)
+static void print_instance(struct latcheck *lc,
+			   struct subpattern_instance *sp_inst, int so_level)
 {
 	int first = 1;
 	int i;
@@ -167,7 +366,7 @@ static void print_instance(struct subpattern_instance *sp_inst, int so_level)
 			if (i == so_level)
 				TERM_FGBG_HIGHLIGHT();
 
-			if (levels[i])
+			if (lc->levels[i])
 				printf("|  ");
 			else
 				printf("   ");
@@ -176,7 +375,7 @@ static void print_instance(struct subpattern_instance *sp_inst, int so_level)
 				TERM_FG_BLACK();
 		}
 
-		for (; i < deepest_level; i++) {
+		for (; i < lc->deepest_level; i++) {
 			if (i == so_level)
 				TERM_FGBG_HIGHLIGHT();
 
@@ -187,7 +386,7 @@ static void print_instance(struct subpattern_instance *sp_inst, int so_level)
 				else
 					printf("`--");
 			} else {
-				if (levels[i])
+				if (lc->levels[i])
 					printf("+--");
 				else
 					printf("---");
@@ -196,26 +395,141 @@ static void print_instance(struct subpattern_instance *sp_inst, int so_level)
 		printf(" ");
 		sp_inst->def->ops->print(sp_inst->data);
 		printf(" (%s-%u)", sp_inst->taskname, sp_inst->task);
+
+		if (lc->overhead_ns && sp_inst->bound == out) {
+			printf(" [%llu us, ~%llu us tracing]",
+			       (ts_to_ns(&sp_inst->ts) -
+				ts_to_ns(&sp_inst->partner->ts)) / 1000,
+			       subpattern_overhead(lc, sp_inst->partner) /
+			       1000);
+		}
 	}
 }
 
-static char schedin_pidstr[32];
-static char schedout_pidstr[32];
+static void print_stack(struct latcheck *lc,
+			struct subpattern_instance *sp_inst, int so_level)
+{
+	const char *end = sp_inst->stack + strlen(sp_inst->stack);
+	const char *p = end;
 
-int subpattern_handle_traceline(const char *traceline)
+	/* print the innermost frame first, like the kernel does */
+	while (p > sp_inst->stack) {
+		for (p = end; p > sp_inst->stack && p[-1] != ';'; p--)
+			;
+
+		TERM_FGBG_NORMAL();
+		print_blankline(lc, &sp_inst->ts, so_level);
+		printf(" => %.*s", (int)(end - p), p);
+		TERM_CURSOR_END();
+		printf("\n");
+
+		end = p - 1;
+	}
+}
+
+static void window_traceline(struct latcheck *lc, struct timespec *ts);
+
+#define STACK_TRACE_STR ": <stack trace>"
+#define STACK_FRAME_STR " => "
+
+/*
+ * A <stack trace> block follows the event that triggered it. Attach
+ * it to the instance of that event scheduling out the task.
+ */
+static void begin_stack(struct latcheck *lc, struct timespec *ts, pid_t task)
 {
 	struct subpattern_instance *sp_inst;
+
+	lc->stack_inst = NULL;
+	lc->stack_depth = 0;
+
+	for (sp_inst = lc->line_inst; sp_inst;
+	     sp_inst = TAILQ_NEXT(sp_inst, list_trace)) {
+
+		if (sp_inst->tracelineno != lc->line_inst->tracelineno)
+			break;
+
+		if (sp_inst->ts.tv_sec != ts->tv_sec ||
+		    sp_inst->ts.tv_nsec != ts->tv_nsec ||
+		    sp_inst->task != task || sp_inst->bound != in ||
+		    !sp_inst->def->ops->sched_out) {
+			continue;
+		}
+
+		if (sp_inst->def->ops->sched_out(task, sp_inst->data) > 0) {
+			lc->stack_inst = sp_inst;
+			break;
+		}
+	}
+}
+
+static void add_stack_frame(struct latcheck *lc, const char *frame)
+{
+	if (!lc->stack_inst || lc->stack_depth >= MAX_STACK_DEPTH)
+		return;
+
+	snprintf(lc->stack_frames[lc->stack_depth],
+		 sizeof(lc->stack_frames[0]), "%.*s",
+		 (int)strcspn(frame, "\n"), frame);
+	lc->stack_depth++;
+}
+
+static void finish_stack(struct latcheck *lc)
+{
+	size_t len = 0;
+	int i;
+
+	if (!lc->stack_inst || !lc->stack_depth)
+		goto out;
+
+	for (i = 0; i < lc->stack_depth; i++)
+		len += strlen(lc->stack_frames[i]) + 1;
+
+	free(lc->stack_inst->stack);
+	lc->stack_inst->stack = malloc(len);
+	if (!lc->stack_inst->stack) {
+		fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+		goto out;
+	}
+
+	/* fold with the outermost frame first */
+	lc->stack_inst->stack[0] = 0;
+	for (i = lc->stack_depth - 1; i >= 0; i--) {
+		strcat(lc->stack_inst->stack, lc->stack_frames[i]);
+		if (i)
+			strcat(lc->stack_inst->stack, ";");
+	}
+out:
+	lc->stack_inst = NULL;
+	lc->stack_depth = 0;
+}
+
+static int handle_event(struct latcheck *lc, const char *traceline,
+			const struct trace_event *ev,
+			struct timespec *ts, int cpu, pid_t task,
+			const char *taskname);
+
+static int handle_traceline(struct latcheck *lc, const char *traceline)
+{
 	struct timespec ts;
 	char taskname[16];
 	pid_t task;
 	char *p;
+	int cpu;
 
-	tracelineno++;
+	lc->tracelineno++;
+
+	if (strncmp(traceline, STACK_FRAME_STR, strlen(STACK_FRAME_STR)) == 0) {
+		add_stack_frame(lc, traceline + strlen(STACK_FRAME_STR));
+		return 0;
+	}
+	finish_stack(lc);
 
-	/* parse task */
+	/* parse task and CPU */
 	p = strstr(traceline, " [");
 	if (!p)
 		return -1;
+	cpu = strtoul(p + 2, NULL, 10);
 	while (*p != '-') {
 		if (p == traceline)
 			return -1;
@@ -246,47 +560,311 @@ int subpattern_handle_traceline(const char *traceline)
 	}
 	ts.tv_sec = strtoul(p + 1, NULL, 10);
 
+	return handle_event(lc, traceline, NULL, &ts, cpu, task, taskname);
+}
+
+/*
+ * Handle a trace event line with its header already parsed. The typed
+ * fields (ev) are parsed from the line if not given.
+ */
+static int handle_event(struct latcheck *lc, const char *traceline,
+			const struct trace_event *ev,
+			struct timespec *ts, int cpu, pid_t task,
+			const char *taskname)
+{
+	struct subpattern_instance *sp_inst;
+	struct subpattern_instance *last;
+	struct subpattern_entry *se;
+	struct trace_event parsed;
+	const char *p;
+
+	if (strstr(traceline, STACK_TRACE_STR)) {
+		begin_stack(lc, ts, task);
+		return 0;
+	}
+
+	if (!ev) {
+		p = strstr(traceline, ": ");
+		trace_event_parse(p ? p + 2 : "", &parsed);
+		ev = &parsed;
+	}
+
+	LIST_FOREACH(se, &lc->head_def, list) {
+		if (se->def->ops->traceline)
+			se->def->ops->traceline(lc, traceline, ev, ts,
+						 cpu, task);
+	}
+
+	pattern_traceline(lc->patterns, traceline, ev, ts, cpu, task);
+
+	if (lc->overhead_ns)
+		count_cpu_event(lc, cpu);
+
+	last = TAILQ_LAST(&lc->head_inst, listhead_instances);
+
 	/* check for outbound on line */
-	LIST_FOREACH(sp_inst, &head_open, list_open) {
-		check_match(traceline, sp_inst, &ts, task, taskname);
-		if (sp_inst->partner)
+	LIST_FOREACH(sp_inst, &lc->head_open, list_open) {
+		check_match(lc, traceline, ev, sp_inst, ts, cpu, task,
+			    taskname);
+		if (sp_inst->partner) {
 			LIST_REMOVE(sp_inst, list_open);
+			STATS_OPEN(-1);
+		}
 	}
 
 	/* check for new inbound(s) on line */
-	check_match(traceline, NULL, &ts, task, taskname);
+	check_match(lc, traceline, ev, NULL, ts, cpu, task, taskname);
+
+	lc->line_inst = last ? TAILQ_NEXT(last, list_trace) :
+			   TAILQ_FIRST(&lc->head_inst);
+
+	if (lc->windowed)
+		window_traceline(lc, ts);
 
 	return 0;
 }
 
-static pid_t focus_task;
+int latcheck_push_line(struct latcheck *lc, const char *traceline)
+{
+	unsigned long long begin = stats_begin();
+	int ret;
+
+	ret = handle_traceline(lc, traceline);
+
+	STATS_INC(lines);
+	if (ret != 0)
+		STATS_INC(parse_failures);
+	stats_end(STATS_MATCH, begin);
+
+	return ret;
+}
+
+int subpattern_handle_traceline(const char *traceline)
+{
+	return latcheck_push_line(default_lc, traceline);
+}
+
+/*
+ * Handle a pre-parsed trace line (e.g. from an event store), with its
+ * typed fields if known. For <stack trace> frames, ev, cpu, task and
+ * taskname are ignored.
+ */
+static int push_parsed(struct latcheck *lc, const char *traceline,
+		       const struct trace_event *ev,
+		       const struct timespec *ts, int cpu, pid_t task,
+		       const char *taskname)
+{
+	unsigned long long begin = stats_begin();
+	struct timespec t = *ts;
+	int ret = 0;
+
+	lc->tracelineno++;
+
+	if (strncmp(traceline, STACK_FRAME_STR, strlen(STACK_FRAME_STR)) == 0) {
+		add_stack_frame(lc, traceline + strlen(STACK_FRAME_STR));
+	} else {
+		finish_stack(lc);
+		ret = handle_event(lc, traceline, ev, &t, cpu, task, taskname);
+	}
+
+	STATS_INC(lines);
+	stats_end(STATS_MATCH, begin);
+
+	return ret;
+}
+
+int subpattern_handle_event(const char *traceline,
+			    const struct trace_event *ev,
+			    const struct timespec *ts, int cpu, pid_t task,
+			    const char *taskname)
+{
+	return push_parsed(default_lc, traceline, ev, ts, cpu, task, taskname);
+}
+
+/*
+ * An event in the form of an event store replay: the sub-patterns only
+ * see ": <event>: <fields>" besides the parsed header.
+ */
+int latcheck_push_event(struct latcheck *lc, const struct latcheck_event *ev)
+{
+	struct timespec ts;
+	char line[512];
+	int len;
+
+	ts.tv_sec = ev->ts_ns / 1000000000ULL;
+	ts.tv_nsec = ev->ts_ns % 1000000000ULL;
+
+	/* a truncated event would match wrongly, refuse it instead */
+	if (ev->comm && strlen(ev->comm) >= 16)
+		return -1;
+
+	if (ev->fields)
+		len = snprintf(line, sizeof(line), ": %s: %s", ev->name,
+			       ev->fields);
+	else
+		len = snprintf(line, sizeof(line), ": %s", ev->name);
+	if (len < 0 || len >= (int)sizeof(line))
+		return -1;
+
+	return push_parsed(lc, line, NULL, &ts, ev->cpu, ev->pid,
+			   ev->comm ? ev->comm : "");
+}
+
+/* the index of a focus task (as used for significance), -1 if none */
+int subpattern_focus_index(struct latcheck *lc, pid_t task)
+{
+	int fi;
+
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++) {
+		if (lc->focus_tasks[fi] == task)
+			return fi;
+	}
 
-void subpattern_init(const char *tracingpath, pid_t task)
+	return -1;
+}
+
+/*
+ * Record the kernel stack whenever a focus task is scheduled out. The
+ * trigger is removed together with the tracing instance.
+ */
+static int arm_stacktrace(const char *tracingpath, const pid_t *tasks,
+			  int ntasks)
 {
-	struct subpattern_definition *sp_def;
+	char trigger[FILTER_MAX + 16];
 
-	LIST_INIT(&head_def);
-	TAILQ_INIT(&head_inst);
-	LIST_INIT(&head_open);
+	strcpy(trigger, "stacktrace if ");
+	if (filter_add_pids(trigger + strlen(trigger),
+			    sizeof(trigger) - strlen(trigger), "prev_pid",
+			    tasks, ntasks) != 0) {
+		return -1;
+	}
 
-	register_sched_out_nonint_sleeping();
-	register_sched_out_sleeping();
-	register_sched_out_runnable();
-	register_sched_latency();
-	register_prio_boost();
-	register_syscall();
+	return set_tracing(tracingpath, "events/sched/sched_switch/trigger",
+			   trigger);
+}
 
-	LIST_FOREACH(sp_def, &head_def, list) {
-		if (!sp_def->ops->enable)
+static void enable_tasks(struct latcheck *lc, const char *tracingpath,
+			 const pid_t *tasks, int ntasks, int flags)
+{
+	struct subpattern_entry *se;
+
+	LIST_FOREACH(se, &lc->head_def, list) {
+		if (!se->def->ops->enable)
 			continue;
-		sp_def->ops->enable(tracingpath, task);
+		se->def->ops->enable(lc, tracingpath, tasks, ntasks);
+	}
+
+	if ((flags & SP_STACKTRACE) &&
+	    arm_stacktrace(tracingpath, tasks, ntasks) != 0) {
+		fprintf(stderr, "failed to arm stacktrace trigger\n");
+	}
+
+	pattern_enable(lc->patterns, tracingpath);
+}
+
+void latcheck_enable(struct latcheck *lc, const char *tracingpath)
+{
+	enable_tasks(lc, tracingpath, lc->focus_tasks, lc->nr_focus_tasks,
+		     lc->stacktrace ? SP_STACKTRACE : 0);
+}
+
+/*
+ * Enable the events of all sub-patterns and patterns for "tasks" in a
+ * tracing instance. Several instances may trace disjoint sets of the
+ * focus tasks, their traces are merged by timestamp (see manifest.c).
+ */
+void subpattern_enable(const char *tracingpath, const pid_t *tasks,
+		       int ntasks, int flags)
+{
+	enable_tasks(default_lc, tracingpath, tasks, ntasks, flags);
+}
+
+struct latcheck *latcheck_new(const struct latcheck_config *cfg)
+{
+	int ntasks = cfg->ntasks;
+	struct latcheck *lc;
+
+	lc = calloc(1, sizeof(*lc));
+	if (!lc) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	LIST_INIT(&lc->head_def);
+	TAILQ_INIT(&lc->head_inst);
+	LIST_INIT(&lc->head_open);
+	lc->windowed = (cfg->flags & SP_WINDOWED);
+	lc->stacktrace = (cfg->flags & SP_STACKTRACE);
+	lc->quiet = (cfg->flags & SP_QUIET);
+	lc->window_ns = cfg->window_us ? cfg->window_us * 1000ULL :
+			DEFAULT_WINDOW_NS;
+	lc->max_instances = cfg->max_instances ? cfg->max_instances :
+			    DEFAULT_MAX_INSTANCES;
+	lc->overhead_ns = cfg->overhead_ns;
+	lc->closed = cfg->closed;
+	lc->significant = cfg->significant;
+	lc->arg = cfg->arg;
+	lc->cfg = cfg;
+
+	register_sched_out_nonint_sleeping(lc);
+	register_sched_out_sleeping(lc);
+	register_sched_out_runnable(lc);
+	register_sched_latency(lc);
+	register_sched_migrate(lc);
+	register_prio_boost(lc);
+	register_syscall(lc);
+	register_preemptirq(lc);
+	register_page_fault(lc);
+	register_hrtimer(lc);
+	register_block_rq(lc);
+	register_marker(lc);
+
+	if (ntasks > MAX_FOCUS_TASKS)
+		ntasks = MAX_FOCUS_TASKS;
+	memcpy(lc->focus_tasks, cfg->tasks, ntasks * sizeof(*cfg->tasks));
+	lc->nr_focus_tasks = ntasks;
+
+	lc->patterns = pattern_init(lc, NULL, lc->focus_tasks,
+				    lc->nr_focus_tasks);
+	if (!lc->patterns) {
+		latcheck_free(lc);
+		return NULL;
 	}
+	lc->cfg = NULL;
+
+	return lc;
+}
 
-	snprintf(schedin_pidstr, sizeof(schedin_pidstr), " next_pid=%d ",
-		 task);
-	snprintf(schedout_pidstr, sizeof(schedout_pidstr), " prev_pid=%d ",
-		 task);
-	focus_task = task;
+const struct latcheck_config *subpattern_config(struct latcheck *lc)
+{
+	return lc->cfg;
+}
+
+/*
+ * The config of the contexts of subpattern_init() created after it is
+ * changed, as set from the command line.
+ */
+struct latcheck_config *subpattern_defaults(void)
+{
+	return &default_cfg;
+}
+
+void subpattern_init(const char *tracingpath, const pid_t *tasks, int ntasks,
+		     int flags)
+{
+	struct latcheck_config cfg = default_cfg;
+
+	cfg.tasks = tasks;
+	cfg.ntasks = ntasks;
+	cfg.flags |= flags;
+
+	default_lc = latcheck_new(&cfg);
+	if (!default_lc)
+		exit(1);
+
+	/* offline traces have nothing to enable */
+	if (tracingpath)
+		latcheck_enable(default_lc, tracingpath);
 }
 
 static int is_sp_ts_lt(struct subpattern_instance *lhs,
@@ -317,10 +895,12 @@ static int is_sp_ts_gt(struct subpattern_instance *lhs,
 	return 0;
 }
 
-static void mark_sp_significant(struct subpattern_instance *sp_inst);
+static void mark_sp_significant(struct latcheck *lc,
+				struct subpattern_instance *sp_inst, int fi);
 
-static void range_identify_significant(struct subpattern_instance *begin,
-				       struct subpattern_instance *end)
+static void range_identify_significant(struct latcheck *lc,
+				       struct subpattern_instance *begin,
+				       struct subpattern_instance *end, int fi)
 {
 	struct subpattern_instance *sp_inst;
 
@@ -343,11 +923,11 @@ static void range_identify_significant(struct subpattern_instance *begin,
 			continue;
 		}
 
-		mark_sp_significant(sp_inst);
+		mark_sp_significant(lc, sp_inst, fi);
 	}
 }
 
-static int contains_significant(struct subpattern_instance *sp_inst)
+static int contains_significant(struct subpattern_instance *sp_inst, int fi)
 {
 	struct subpattern_instance *begin;
 	struct subpattern_instance *end;
@@ -357,7 +937,7 @@ static int contains_significant(struct subpattern_instance *sp_inst)
 		return 0;
 
 	/* have we already been marked? */
-	if (sp_inst->is_significant)
+	if (sp_inst->is_significant[fi])
 		return 0;
 
 	begin = sp_inst;
@@ -367,24 +947,28 @@ static int contains_significant(struct subpattern_instance *sp_inst)
 	     sp_inst != end;
 	     sp_inst = TAILQ_NEXT(sp_inst, list_trace)) {
 
-		if (sp_inst->is_significant)
+		if (sp_inst->is_significant[fi])
 			return 1;
 	}
 
 	return 0;
 }
 
-static void mark_sp_significant(struct subpattern_instance *sp_inst)
+static void mark_sp_significant(struct latcheck *lc,
+				struct subpattern_instance *sp_inst, int fi)
 {
+	pid_t focus_task = lc->focus_tasks[fi];
 	struct subpattern_instance *begin;
 	struct subpattern_instance *end;
 
+	STATS_INC(marks);
+
 	/* ignore open subpatterns */
 	if (!sp_inst->partner)
 		return;
 
 	/* have we already been marked? */
-	if (sp_inst->is_significant)
+	if (sp_inst->is_significant[fi])
 		return;
 
 	if (sp_inst->bound == in) {
@@ -404,8 +988,8 @@ static void mark_sp_significant(struct subpattern_instance *sp_inst)
 	}
 
 	/* we are significant! */
-	begin->is_significant = 1;
-	end->is_significant = 1;
+	begin->is_significant[fi] = 1;
+	end->is_significant[fi] = 1;
 
 	/*
 	 * Now that we have a new significant subpattern, we must check for
@@ -415,31 +999,36 @@ static void mark_sp_significant(struct subpattern_instance *sp_inst)
 	 * NOTE: This does not detect subpatterns that begin before and
 	 *       end after the range. That must be detected elsewhere.
 	 */
-	range_identify_significant(begin, end);
+	range_identify_significant(lc, begin, end, fi);
 }
 
-void subpattern_cleanup(void)
+/*
+ * Identify the significant subpatterns for a single focus task. Each
+ * focus task only touches its own significance bits, so this may run
+ * concurrently for all focus tasks.
+ */
+struct identify_arg {
+	struct latcheck *ctx;
+	int fi;
+};
+
+static void *identify_significant(void *arg)
 {
-	struct subpattern_instance *last_inst = NULL;
-	struct subpattern_definition *sp_def;
+	struct identify_arg *ia = arg;
+	struct latcheck *lc = ia->ctx;
 	struct subpattern_instance *sp_inst;
-	int next_level = 1;
-	int so_level = 0;
-	int ret;
-
-	memset(levels, 0, sizeof(levels));
-	levels[0] = 255;
+	int fi = ia->fi;
 
 	/*
 	 * First we indentify significant subpatterns based on the
 	 * overlapping of significant subpatterns. (A subpattern
 	 * begins XOR ends within a significant subpattern.)
 	 */
-	TAILQ_FOREACH(sp_inst, &head_inst, list_trace) {
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
 		if (!sp_inst->def->has_sched_switch)
 			continue;
 
-		mark_sp_significant(sp_inst);
+		mark_sp_significant(lc, sp_inst, fi);
 	}
 
 	/*
@@ -447,71 +1036,115 @@ void subpattern_cleanup(void)
 	 * of significant subpatterns. (A subpattern begins before and
 	 * ends after a significant subpattern.)
 	 */
-	TAILQ_FOREACH(sp_inst, &head_inst, list_trace) {
-		if (sp_inst->is_significant)
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if (sp_inst->is_significant[fi])
 			continue;
 
 		if (sp_inst->bound != in)
 			continue;
 
 		if (sp_inst->def->ops->is_relevant &&
-		    !sp_inst->def->ops->is_relevant(focus_task,
+		    !sp_inst->def->ops->is_relevant(lc->focus_tasks[fi],
 						    sp_inst->data)) {
 			continue;
 		}
 
-		if (contains_significant(sp_inst))
-			mark_sp_significant(sp_inst);
+		if (contains_significant(sp_inst, fi))
+			mark_sp_significant(lc, sp_inst, fi);
 	}
 
+	stats_merge();
+
+	return NULL;
+}
+
+/* does the (closed) subpattern lie within the time range? */
+static int in_range(struct subpattern_instance *sp_inst,
+		    unsigned long long begin, unsigned long long end)
+{
+	unsigned long long ts = ts_to_ns(&sp_inst->ts);
+	unsigned long long partner_ts = ts_to_ns(&sp_inst->partner->ts);
+
+	return (ts >= begin && ts <= end &&
+		partner_ts >= begin && partner_ts <= end);
+}
+
+/*
+ * Print the significant subpatterns of a focus task. If "end" is
+ * non-zero, only subpatterns within the time range are printed.
+ */
+static void print_significant(struct latcheck *lc, int fi,
+			      unsigned long long begin, unsigned long long end)
+{
+	struct subpattern_instance *last_inst = NULL;
+	struct subpattern_instance *sp_inst;
+	pid_t focus_task = lc->focus_tasks[fi];
+	unsigned long long t0 = stats_begin();
+	int next_level = 1;
+	int so_level = 0;
+	int ret;
+
+	memset(lc->levels, 0, sizeof(lc->levels));
+	lc->levels[0] = 255;
+	lc->deepest_level = 0;
+
 	/*
 	 * Identify the print levels for the subpatterns for
 	 * a pretty output.
 	 */
-	TAILQ_FOREACH(sp_inst, &head_inst, list_trace) {
-		if (!sp_inst->is_significant)
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if (!sp_inst->is_significant[fi])
+			continue;
+
+		if (end && !in_range(sp_inst, begin, end))
 			continue;
 
 		if (sp_inst->bound == in) {
-			levels[next_level] = 1;
+			lc->levels[next_level] = 1;
 			sp_inst->level = next_level;
 			next_level++;
-			if (next_level > deepest_level)
-				deepest_level = next_level;
+			if (next_level > lc->deepest_level)
+				lc->deepest_level = next_level;
 			continue;
 		}
 
 		sp_inst->level = sp_inst->partner->level;
-		levels[sp_inst->level] = 0;
+		lc->levels[sp_inst->level] = 0;
 		if (next_level - 1 > sp_inst->level)
 			continue;
 
-		while (levels[next_level - 1] == 0)
+		while (lc->levels[next_level - 1] == 0)
 			next_level--;
 	}
 
+	stats_end(STATS_LEVELS, t0);
+	t0 = stats_begin();
+
 	/*
 	 * All significant subpatterns have been marked.
 	 * Print them.
 	 */
-	TAILQ_FOREACH(sp_inst, &head_inst, list_trace) {
-		if (!sp_inst->is_significant)
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if (!sp_inst->is_significant[fi])
+			continue;
+
+		if (end && !in_range(sp_inst, begin, end))
 			continue;
 
 		if (last_inst &&
 		    sp_inst->tracelineno != last_inst->tracelineno) {
 			TERM_FGBG_NORMAL();
 
-			print_blankline(&sp_inst->ts, so_level);
+			print_blankline(lc, &sp_inst->ts, so_level);
 
 			TERM_CURSOR_END();
 			printf("\n");
 		}
 
 		if (sp_inst->bound == in)
-			levels[sp_inst->level] = 1;
+			lc->levels[sp_inst->level] = 1;
 		else
-			levels[sp_inst->level] = 0;
+			lc->levels[sp_inst->level] = 0;
 
 		if (sp_inst->def->ops->sched_out) {
 			ret = sp_inst->def->ops->sched_out(focus_task,
@@ -524,11 +1157,14 @@ void subpattern_cleanup(void)
 
 		TERM_FGBG_NORMAL();
 
-		print_instance(sp_inst, so_level);
+		print_instance(lc, sp_inst, so_level);
 
 		TERM_CURSOR_END();
 		printf("\n");
 
+		if (ret > 0 && sp_inst->stack)
+			print_stack(lc, sp_inst, so_level);
+
 		if (ret < 0)
 			so_level = 0;
 
@@ -538,23 +1174,632 @@ void subpattern_cleanup(void)
 	TERM_CURSOR_END();
 	printf("\n");
 
-	while (LIST_FIRST(&head_open))
-		LIST_REMOVE(LIST_FIRST(&head_open), list_open);
+	stats_end(STATS_PRINT, t0);
+}
+
+static void print_span(const char *who, struct subpattern_instance *begin)
+{
+	struct subpattern_instance *end = begin->partner;
+
+	printf("%-7s %lu.%06lu - %lu.%06lu ", who,
+	       begin->ts.tv_sec, begin->ts.tv_nsec / 1000,
+	       end->ts.tv_sec, end->ts.tv_nsec / 1000);
+	begin->def->ops->print(begin->data);
+	printf(" (%s-%u)", begin->taskname, begin->task);
+}
+
+/* a significant subpattern of one or both focus tasks of a pair */
+struct overlap_span {
+	struct subpattern_instance *inst;
+	int for_a;
+	int for_b;
+	/* the number of the span in the report, 0 if not listed */
+	int nr;
+
+	/* the spans of the other task it is linked to */
+	int *links;
+	int nr_links;
+};
+
+/*
+ * Collect the (closed) significant subpatterns of two focus tasks,
+ * ordered by their begin timestamp.
+ */
+static struct overlap_span *collect_significant(struct latcheck *lc, int fa,
+						int fb, int *count)
+{
+	struct subpattern_instance *sp_inst;
+	struct overlap_span *spans;
+	int n = 0;
+
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if ((sp_inst->is_significant[fa] ||
+		     sp_inst->is_significant[fb]) &&
+		    sp_inst->bound == in && sp_inst->def->ops->print) {
+			n++;
+		}
+	}
+
+	spans = calloc(n + 1, sizeof(*spans));
+	if (!spans) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		*count = 0;
+		return NULL;
+	}
+
+	n = 0;
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if ((sp_inst->is_significant[fa] ||
+		     sp_inst->is_significant[fb]) &&
+		    sp_inst->bound == in && sp_inst->def->ops->print) {
+			spans[n].inst = sp_inst;
+			spans[n].for_a = sp_inst->is_significant[fa];
+			spans[n].for_b = sp_inst->is_significant[fb];
+			n++;
+		}
+	}
+
+	*count = n;
+	return spans;
+}
+
+/* does the subpattern begin with the focus task being scheduled out? */
+static int is_off_cpu(struct latcheck *lc, struct subpattern_instance *sp_inst,
+		      int fi)
+{
+	if (!sp_inst->def->ops->sched_out)
+		return 0;
+
+	return (sp_inst->def->ops->sched_out(lc->focus_tasks[fi],
+					     sp_inst->data) > 0);
+}
+
+/*
+ * Is a significant subpattern of one task linked to a significant
+ * subpattern of the other task? They must overlap while one of the
+ * tasks is scheduled out.
+ */
+static int is_linked(struct latcheck *lc, struct overlap_span *x,
+		     struct overlap_span *y, int fa, int fb)
+{
+	if (is_sp_ts_lt(y->inst->partner, x->inst))
+		return 0;
+
+	if (x->for_a && y->for_b &&
+	    (is_off_cpu(lc, x->inst, fa) || is_off_cpu(lc, y->inst, fb))) {
+		return 1;
+	}
+
+	if (x->for_b && y->for_a &&
+	    (is_off_cpu(lc, x->inst, fb) || is_off_cpu(lc, y->inst, fa))) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static int add_link(struct overlap_span *x, int to)
+{
+	int *links;
+
+	links = array_grow(x->links, x->nr_links, sizeof(*links));
+	if (!links)
+		return -1;
+	x->links = links;
+	x->links[x->nr_links++] = to;
+
+	return 0;
+}
+
+/*
+ * Link the spans of a pair of focus tasks. As the spans are ordered by
+ * their begin timestamp, only the spans beginning before the end of a
+ * span can overlap it.
+ */
+static void link_spans(struct latcheck *lc, struct overlap_span *spans,
+		       int count, int fa, int fb)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < count; i++) {
+		for (j = i + 1; j < count; j++) {
+			if (is_sp_ts_gt(spans[j].inst, spans[i].inst->partner))
+				break;
+
+			if (!is_linked(lc, &spans[i], &spans[j], fa, fb))
+				continue;
+
+			if (add_link(&spans[i], j) != 0 ||
+			    add_link(&spans[j], i) != 0) {
+				return;
+			}
+		}
+	}
+}
+
+static void free_spans(struct overlap_span *spans, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		free(spans[i].links);
+	free(spans);
+}
+
+/*
+ * Report where the significant subpatterns of one focus task overlap
+ * the significant subpatterns of another focus task. Only overlaps
+ * where one of the tasks is scheduled out are reported, since these
+ * are the links of cross-task latency chains. A subpattern that is
+ * significant for both tasks is the most direct link between them.
+ * Each subpattern is listed once per pair of tasks, followed by the
+ * numbers of the subpatterns of the other task it overlaps.
+ */
+static void print_overlaps(struct latcheck *lc)
+{
+	struct overlap_span *spans;
+	const char *who;
+	char who_a[16];
+	char who_b[16];
+	int count;
+	int nr;
+	int fa;
+	int fb;
+	int i;
+	int j;
+
+	printf("cross-task overlaps of significant sub-patterns:\n");
+
+	for (fa = 0; fa < lc->nr_focus_tasks; fa++) {
+		for (fb = fa + 1; fb < lc->nr_focus_tasks; fb++) {
+			spans = collect_significant(lc, fa, fb, &count);
+			if (!spans)
+				continue;
+
+			link_spans(lc, spans, count, fa, fb);
+
+			/* number the spans that take part in an overlap */
+			nr = 0;
+			for (i = 0; i < count; i++) {
+				if ((spans[i].for_a && spans[i].for_b) ||
+				    spans[i].nr_links) {
+					spans[i].nr = ++nr;
+				}
+			}
+
+			if (!nr) {
+				free_spans(spans, count);
+				continue;
+			}
+
+			snprintf(who_a, sizeof(who_a), "%u",
+				 lc->focus_tasks[fa]);
+			snprintf(who_b, sizeof(who_b), "%u",
+				 lc->focus_tasks[fb]);
+			printf("\ntask %u <-> task %u\n", lc->focus_tasks[fa],
+			       lc->focus_tasks[fb]);
+
+			for (i = 0; i < count; i++) {
+				if (!spans[i].nr)
+					continue;
+
+				if (spans[i].for_a && spans[i].for_b)
+					who = "both";
+				else if (spans[i].for_a)
+					who = who_a;
+				else
+					who = who_b;
+
+				printf("  #%-3d ", spans[i].nr);
+				print_span(who, spans[i].inst);
+
+				for (j = 0; j < spans[i].nr_links; j++) {
+					printf("%s #%d", j ? "" : " overlaps",
+					       spans[spans[i].links[j]].nr);
+				}
+				printf("\n");
+			}
+
+			free_spans(spans, count);
+		}
+	}
+	printf("\n");
+}
+
+/*
+ * Significance is identified independently for each focus task, so
+ * do it in parallel.
+ */
+static void identify_all(struct latcheck *lc)
+{
+	unsigned long long t0 = stats_begin();
+	struct identify_arg args[MAX_FOCUS_TASKS];
+	pthread_t threads[MAX_FOCUS_TASKS];
+	int started[MAX_FOCUS_TASKS];
+	int fi;
+
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++) {
+		args[fi].ctx = lc;
+		args[fi].fi = fi;
+		started[fi] = 0;
+		if (lc->nr_focus_tasks > 1 &&
+		    pthread_create(&threads[fi], NULL, identify_significant,
+				   &args[fi]) == 0) {
+			started[fi] = 1;
+		} else {
+			identify_significant(&args[fi]);
+		}
+	}
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++) {
+		if (started[fi])
+			pthread_join(threads[fi], NULL);
+	}
+
+	stats_end(STATS_SIGNIFICANCE, t0);
+}
+
+static void free_instance(struct latcheck *lc,
+			  struct subpattern_instance *sp_inst)
+{
+	TAILQ_REMOVE(&lc->head_inst, sp_inst, list_trace);
+	lc->nr_instances--;
+
+	if (sp_inst == lc->line_inst)
+		lc->line_inst = NULL;
+	if (sp_inst == lc->stack_inst)
+		lc->stack_inst = NULL;
+
+	if (sp_inst->def->ops->free_data)
+		sp_inst->def->ops->free_data(sp_inst->data);
+	free(sp_inst->stack);
+	free(sp_inst);
+}
+
+/* the config of the contexts of subpattern_init() created after the call */
+void subpattern_set_window(unsigned long window_us,
+			   unsigned long max_inst)
+{
+	default_cfg.window_us = window_us;
+	default_cfg.max_instances = max_inst;
+}
+
+void subpattern_set_overhead(unsigned long ns)
+{
+	default_cfg.overhead_ns = ns;
+}
+
+void subpattern_set_range(unsigned long long begin, unsigned long long end)
+{
+	default_lc->range_begin = begin;
+	default_lc->range_end = end;
+}
+
+/*
+ * The trace is read with a lead-in before and a lead-out after the
+ * time range, so that sub-patterns crossing its bounds are complete.
+ * Only keep the significant sub-patterns overlapping the range.
+ */
+static void clip_significant(struct latcheck *lc)
+{
+	struct subpattern_instance *sp_inst;
+	unsigned long long begin;
+	unsigned long long end;
+
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		begin = ts_to_ns(&sp_inst->ts);
+		end = sp_inst->partner ?
+		      ts_to_ns(&sp_inst->partner->ts) : begin;
+		if (sp_inst->bound == out) {
+			unsigned long long tmp = begin;
+
+			begin = end;
+			end = tmp;
+		}
+
+		if (end < lc->range_begin ||
+		    (lc->range_end && begin > lc->range_end)) {
+			memset(sp_inst->is_significant, 0,
+			       sizeof(sp_inst->is_significant));
+		}
+	}
+}
+
+/*
+ * Estimate the tracing overhead contained in a closed sub-pattern from
+ * the calibrated overhead per event (-O). Only the events traced on the
+ * CPU the sub-pattern began on are counted, from the inbound to the
+ * outbound event, since the events of other CPUs do not delay it.
+ */
+unsigned long long subpattern_overhead(struct latcheck *lc,
+				       struct subpattern_instance *sp_inst)
+{
+	struct subpattern_instance *partner = sp_inst->partner;
+	unsigned long events;
+
+	if (!lc->overhead_ns || !partner)
+		return 0;
+
+	if (sp_inst->bound == out) {
+		sp_inst = partner;
+		partner = sp_inst->partner;
+	}
+	/* the events of a CPU that could not be counted are unknown */
+	if (partner->cpu_events < sp_inst->cpu_events)
+		return 0;
+	events = partner->cpu_events - sp_inst->cpu_events + 1;
+
+	return (unsigned long long)events * lc->overhead_ns;
+}
+
+/*
+ * Request the trace window around a violation to be printed. Windows
+ * that overlap are merged and printed once the trace has moved past
+ * the end of the window.
+ */
+void subpattern_request_window(struct latcheck *lc,
+			       const struct timespec *begin,
+			       const struct timespec *end,
+			       const char *reason)
+{
+	unsigned long long b = ts_to_ns(begin);
+	unsigned long long e = ts_to_ns(end) + lc->window_ns;
+
+	if (!lc->windowed)
+		return;
+
+	b = (b > lc->window_ns) ? b - lc->window_ns : 0;
+
+	if (!lc->window_pending) {
+		lc->window_pending = 1;
+		lc->window_begin = b;
+		lc->window_end = e;
+		lc->nr_window_reasons = 0;
+	} else {
+		if (b < lc->window_begin)
+			lc->window_begin = b;
+		if (e > lc->window_end)
+			lc->window_end = e;
+	}
+
+	if (lc->nr_window_reasons < MAX_WINDOW_REASONS) {
+		snprintf(lc->window_reasons[lc->nr_window_reasons],
+			 sizeof(lc->window_reasons[0]), "%s", reason);
+	}
+	lc->nr_window_reasons++;
+}
+
+/*
+ * Tell the patterns (and the library callback) about the significant
+ * subpatterns of a focus task. If "end" is non-zero, only subpatterns
+ * within the time range are reported. Each subpattern is reported once,
+ * since the windows of a continuous trace may overlap.
+ */
+static void report_significant(struct latcheck *lc, int fi,
+			       unsigned long long begin,
+			       unsigned long long end)
+{
+	struct subpattern_instance *sp_inst;
+	struct latcheck_instance pub;
 
-	for (sp_inst = TAILQ_FIRST(&head_inst); sp_inst;
-	     sp_inst = TAILQ_FIRST(&head_inst)) {
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace) {
+		if (!sp_inst->is_significant[fi])
+			continue;
 
-		TAILQ_REMOVE(&head_inst, sp_inst, list_trace);
-		if (sp_inst->def->ops->free_data)
-			sp_inst->def->ops->free_data(sp_inst->data);
-		free(sp_inst);
+		if (sp_inst->is_reported[fi] ||
+		    (end && !in_range(sp_inst, begin, end))) {
+			continue;
+		}
+		sp_inst->is_reported[fi] = 1;
+
+		pattern_significant(lc->patterns, sp_inst,
+				    lc->focus_tasks[fi]);
+
+		if (lc->significant && sp_inst->bound == in) {
+			to_public(sp_inst, &pub);
+			lc->significant(&pub, lc->focus_tasks[fi], lc->arg);
+		}
 	}
+}
+
+static void print_window(struct latcheck *lc)
+{
+	struct subpattern_instance *sp_inst;
+	int fi;
+	int i;
+
+	TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace)
+		memset(sp_inst->is_significant, 0,
+		       sizeof(sp_inst->is_significant));
 
-	for (sp_def = LIST_FIRST(&head_def); sp_def;
-	     sp_def = LIST_FIRST(&head_def)) {
+	identify_all(lc);
 
-		LIST_REMOVE(sp_def, list);
-		if (sp_def->ops->unregister)
-			sp_def->ops->unregister(sp_def);
+	if (lc->quiet)
+		goto report;
+
+	for (i = 0; i < lc->nr_window_reasons && i < MAX_WINDOW_REASONS; i++)
+		printf("%s\n", lc->window_reasons[i]);
+	if (lc->nr_window_reasons > MAX_WINDOW_REASONS)
+		printf("... and %d more violations\n",
+		       lc->nr_window_reasons - MAX_WINDOW_REASONS);
+
+	printf("significant sub-patterns from %llu.%06llu to %llu.%06llu:\n\n",
+	       lc->window_begin / 1000000000ULL,
+	       (lc->window_begin % 1000000000ULL) / 1000,
+	       lc->window_end / 1000000000ULL,
+	       (lc->window_end % 1000000000ULL) / 1000);
+
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++) {
+		if (lc->nr_focus_tasks > 1)
+			printf("significant sub-patterns for task %u:\n\n",
+			       lc->focus_tasks[fi]);
+		print_significant(lc, fi, lc->window_begin, lc->window_end);
 	}
+
+	fflush(stdout);
+report:
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++)
+		report_significant(lc, fi, lc->window_begin, lc->window_end);
+
+	lc->window_pending = 0;
+	lc->nr_window_reasons = 0;
+}
+
+/*
+ * Drop the instances of subpatterns that closed before the retained
+ * history. The history reaches one window back from the current trace
+ * line, from the oldest open subpattern and from a pending window. If
+ * there are still too many instances, the oldest are dropped anyway.
+ */
+static void prune_instances(struct latcheck *lc, unsigned long long now)
+{
+	struct subpattern_instance *sp_inst;
+	struct subpattern_instance *next;
+	unsigned long long cutoff;
+	unsigned long long ts;
+
+	cutoff = (now > lc->window_ns) ? now - lc->window_ns : 0;
+
+	LIST_FOREACH(sp_inst, &lc->head_open, list_open) {
+		ts = ts_to_ns(&sp_inst->ts);
+		ts = (ts > lc->window_ns) ? ts - lc->window_ns : 0;
+		if (ts < cutoff)
+			cutoff = ts;
+	}
+
+	if (lc->window_pending && lc->window_begin < cutoff)
+		cutoff = lc->window_begin;
+
+	for (sp_inst = TAILQ_FIRST(&lc->head_inst); sp_inst; sp_inst = next) {
+		if (ts_to_ns(&sp_inst->ts) >= cutoff)
+			break;
+
+		next = TAILQ_NEXT(sp_inst, list_trace);
+
+		if (sp_inst->bound != in || !sp_inst->partner ||
+		    ts_to_ns(&sp_inst->partner->ts) >= cutoff) {
+			continue;
+		}
+
+		if (next == sp_inst->partner)
+			next = TAILQ_NEXT(next, list_trace);
+		free_instance(lc, sp_inst->partner);
+		free_instance(lc, sp_inst);
+	}
+
+	for (sp_inst = TAILQ_FIRST(&lc->head_inst);
+	     sp_inst && lc->nr_instances > lc->max_instances; sp_inst = next) {
+
+		next = TAILQ_NEXT(sp_inst, list_trace);
+
+		if (sp_inst->bound != in)
+			continue;
+
+		if (!sp_inst->partner) {
+			LIST_REMOVE(sp_inst, list_open);
+			STATS_OPEN(-1);
+		} else {
+			if (next == sp_inst->partner)
+				next = TAILQ_NEXT(next, list_trace);
+			free_instance(lc, sp_inst->partner);
+		}
+		free_instance(lc, sp_inst);
+	}
+
+	pattern_prune(lc->patterns, cutoff);
+}
+
+static void window_traceline(struct latcheck *lc, struct timespec *ts)
+{
+	unsigned long long now = ts_to_ns(ts);
+
+	if (lc->window_pending && now > lc->window_end)
+		print_window(lc);
+
+	if (lc->tracelineno % PRUNE_INTERVAL == 0)
+		prune_instances(lc, now);
+}
+
+/* identify and report the significant sub-patterns, once at the end */
+void latcheck_finish(struct latcheck *lc)
+{
+	struct subpattern_instance *sp_inst;
+	unsigned long long t0;
+	int fi;
+
+	/* the trace may end with a <stack trace> block */
+	finish_stack(lc);
+
+	if (lc->windowed) {
+		if (lc->window_pending)
+			print_window(lc);
+
+		/*
+		 * Only report the retained instances that no window
+		 * reported (nothing requested their printing).
+		 */
+		TAILQ_FOREACH(sp_inst, &lc->head_inst, list_trace)
+			memset(sp_inst->is_significant, 0,
+			       sizeof(sp_inst->is_significant));
+		identify_all(lc);
+		for (fi = 0; fi < lc->nr_focus_tasks; fi++)
+			report_significant(lc, fi, 0, 0);
+		goto report;
+	}
+
+	identify_all(lc);
+
+	if (lc->range_begin || lc->range_end)
+		clip_significant(lc);
+
+	for (fi = 0; fi < lc->nr_focus_tasks; fi++) {
+		if (!lc->quiet && lc->nr_focus_tasks > 1)
+			printf("significant sub-patterns for task %u:\n\n",
+			       lc->focus_tasks[fi]);
+		if (!lc->quiet)
+			print_significant(lc, fi, 0, 0);
+
+		report_significant(lc, fi, 0, 0);
+	}
+
+	if (lc->nr_focus_tasks > 1 && !lc->quiet)
+		print_overlaps(lc);
+report:
+	if (lc->quiet)
+		return;
+
+	t0 = stats_begin();
+	pattern_report(lc->patterns);
+	stats_end(STATS_REPORT, t0);
+}
+
+void latcheck_free(struct latcheck *lc)
+{
+	struct subpattern_entry *se;
+
+	while (LIST_FIRST(&lc->head_open))
+		LIST_REMOVE(LIST_FIRST(&lc->head_open), list_open);
+
+	while (TAILQ_FIRST(&lc->head_inst))
+		free_instance(lc, TAILQ_FIRST(&lc->head_inst));
+
+	while ((se = LIST_FIRST(&lc->head_def))) {
+		LIST_REMOVE(se, list);
+		if (se->def->ops->unregister)
+			se->def->ops->unregister(lc, se->def);
+		free(se);
+	}
+
+	if (lc->patterns)
+		pattern_cleanup(lc->patterns);
+
+	free(lc->cpu_events);
+	free(lc);
+}
+
+void subpattern_cleanup(void)
+{
+	latcheck_finish(default_lc);
+	latcheck_free(default_lc);
+	default_lc = NULL;
 }
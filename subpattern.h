@@ -23,34 +23,99 @@
 #include <sys/types.h>
 #include <sys/queue.h>
 
+#define MAX_FOCUS_TASKS 32
+
+/* subpattern_init() flags, as LATCHECK_* of latcheck.h */
+#define SP_STACKTRACE    0x1
+#define SP_WINDOWED      0x2
+#define SP_QUIET         0x4
+#define SP_RUNQUEUE      0x8
+#define SP_CRITICAL_PATH 0x10
+
+struct latcheck;
+struct latcheck_config;
 struct subpattern_definition;
 struct subpattern_instance;
+struct trace_event;
 
 enum subpattern_boundary {
 	in = 0,
 	out,
 };
 
+/*
+ * The ops that keep state across trace lines get the analysis context,
+ * their state in it is reached with subpattern_data().
+ */
 struct subpattern_ops {
-	int (*enable)(const char *tracingpath, pid_t task);
-	void *(*match)(const char *traceline, pid_t task,
+	int (*enable)(struct latcheck *lc, const char *tracingpath,
+		      const pid_t *tasks, int ntasks);
+	/*
+	 * optional, called for every trace line before matching, ev holds
+	 * the typed fields of the common events (trace_event.h)
+	 */
+	void (*traceline)(struct latcheck *lc, const char *traceline,
+			  const struct trace_event *ev,
+			  struct timespec *ts, int cpu, pid_t task);
+	/* ev as for traceline */
+	void *(*match)(struct latcheck *lc, const char *traceline,
+		       const struct trace_event *ev, pid_t task,
 		       enum subpattern_boundary bound, void *inbound_data);
 	int (*is_relevant)(pid_t task, void *data);
 	int (*sched_out)(pid_t task, void *data);
 	void (*print)(void *data);
 	void (*free_data)(void *data);
-	void (*unregister)(struct subpattern_definition *def);
+	void (*unregister)(struct latcheck *lc,
+			   const struct subpattern_definition *def);
 };
 
+/* definitions are shared by all analysis contexts and never written */
 struct subpattern_definition {
-	void *data;
-	struct subpattern_ops *ops;
+	const char *name;
+	const struct subpattern_ops *ops;
 	int has_sched_switch;
+};
+
+struct subpattern_instance {
+	struct timespec ts;
+	char taskname[16];
+	pid_t task;
+	int cpu;
+	enum subpattern_boundary bound;
+	struct subpattern_instance *partner;
+	const struct subpattern_definition *def;
+	void *data;
+
+	unsigned char is_significant[MAX_FOCUS_TASKS];
+	/* told to the patterns already (windows may overlap) */
+	unsigned char is_reported[MAX_FOCUS_TASKS];
+	int level;
+	unsigned long tracelineno;
+	/* the trace events on the CPU of the inbound instance so far (-O) */
+	unsigned long cpu_events;
+
+	/* folded kernel stack (outermost frame first), if traced */
+	char *stack;
 
-	int id;
-	LIST_ENTRY(subpattern_definition) list;
+	TAILQ_ENTRY(subpattern_instance) list_trace;
+	LIST_ENTRY(subpattern_instance) list_open;
 };
 
-extern int register_subpattern(struct subpattern_definition *def);
+extern int register_subpattern(struct latcheck *lc,
+			       const struct subpattern_definition *def);
+/* the config of the context, only while it is created (registered) */
+extern const struct latcheck_config *subpattern_config(struct latcheck *lc);
+extern void *subpattern_data(struct latcheck *lc,
+			     const struct subpattern_definition *def);
+extern void subpattern_set_data(struct latcheck *lc,
+				const struct subpattern_definition *def,
+				void *data);
+extern int subpattern_focus_index(struct latcheck *lc, pid_t task);
+extern unsigned long long
+subpattern_overhead(struct latcheck *lc, struct subpattern_instance *sp_inst);
+extern void subpattern_request_window(struct latcheck *lc,
+				      const struct timespec *begin,
+				      const struct timespec *end,
+				      const char *reason);
 
 #endif /* SUBPATTERN_H */
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "trace_event.h"
+#include "subpattern.h"
+#include "subpatterns.h"
+#include "block_rq.h"
+
+/*
+ * A block I/O request on the device, from block_rq_issue to
+ * block_rq_complete, keyed by device and sector. Requests are issued
+ * and completed in any context, so the focus task that queued the I/O
+ * (block_bio_queue) is remembered by device and sector. A request is
+ * relevant to its owner if it completed while the owner was sleeping
+ * uninterruptibly, i.e. the owner was waiting for it.
+ */
+
+#define QUEUE_STR " block_bio_queue: "
+#define ISSUE_STR " block_rq_issue: "
+#define COMPLETE_STR " block_rq_complete: "
+
+/* bios merged into other requests are never issued themselves */
+#define MAX_QUEUED 1024
+
+struct queued_io {
+	unsigned int major;
+	unsigned int minor;
+	unsigned long long sector;
+	pid_t owner;
+	unsigned long long queued;
+};
+
+/* the state of an analysis context */
+struct block_rq_state {
+	struct queued_io *queued;
+	int nr_queued;
+
+	/* the focus tasks in uninterruptible sleep */
+	int waiting[MAX_FOCUS_TASKS];
+};
+
+static const struct subpattern_definition sp_def;
+
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
+{
+	char filter[FILTER_MAX];
+	int ret = 0;
+
+	(void)lc;
+
+	ret |= set_tracing(tracingpath,
+			   "events/block/block_bio_queue/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/block/block_rq_issue/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/block/block_rq_complete/enable", "1\n");
+
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "common_pid",
+			       tasks, ntasks);
+	ret |= set_tracing(tracingpath, "events/block/block_bio_queue/filter",
+			   filter);
+
+	return ret;
+}
+
+/*
+ * Parse "<major>,<minor> <rwbs> ... <sector> + <nr_sector>" following
+ * the event name. Requests without sectors (flushes) are ignored.
+ */
+static int parse_rq(const char *traceline, const char *event,
+		    struct block_rq *rq)
+{
+	const char *p;
+	const char *s;
+
+	p = strstr(traceline, event);
+	if (!p)
+		return -1;
+	p += strlen(event);
+
+	if (sscanf(p, "%u,%u %7s", &rq->major, &rq->minor, rq->rwbs) != 3)
+		return -1;
+
+	p = strstr(p, " + ");
+	if (!p)
+		return -1;
+	for (s = p; s > traceline && s[-1] != ' '; s--)
+		;
+	rq->sector = strtoull(s, NULL, 10);
+	rq->nr_sector = strtoul(p + 3, NULL, 10);
+
+	return (rq->nr_sector ? 0 : -1);
+}
+
+static struct queued_io *find_queued(struct block_rq_state *st,
+				     struct block_rq *rq)
+{
+	int i;
+
+	for (i = 0; i < st->nr_queued; i++) {
+		if (st->queued[i].sector == rq->sector &&
+		    st->queued[i].major == rq->major &&
+		    st->queued[i].minor == rq->minor) {
+			return &st->queued[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct queued_io *oldest_queued(struct block_rq_state *st)
+{
+	struct queued_io *oldest = &st->queued[0];
+	int i;
+
+	for (i = 1; i < st->nr_queued; i++) {
+		if (st->queued[i].queued < oldest->queued)
+			oldest = &st->queued[i];
+	}
+
+	return oldest;
+}
+
+static void set_waiting(struct latcheck *lc, struct block_rq_state *st,
+			pid_t pid, int val)
+{
+	int fi;
+
+	fi = subpattern_focus_index(lc, pid);
+	if (fi >= 0)
+		st->waiting[fi] = val;
+}
+
+/* track the I/O queued by focus tasks and their uninterruptible sleeps */
+static void sp_traceline(struct latcheck *lc, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct block_rq_state *st = subpattern_data(lc, &sp_def);
+	struct queued_io *q;
+	struct block_rq rq;
+
+	(void)cpu;
+
+	if (ev->type == TEV_SCHED_SWITCH) {
+		set_waiting(lc, st, ev->pid, ev->prev_state[0] == 'D');
+		set_waiting(lc, st, ev->next_pid, 0);
+		return;
+	}
+
+	if (ev->type == TEV_SCHED_WAKEUP) {
+		set_waiting(lc, st, ev->pid, 0);
+		return;
+	}
+
+	if (!strstr(traceline, QUEUE_STR) ||
+	    subpattern_focus_index(lc, task) < 0 ||
+	    parse_rq(traceline, QUEUE_STR, &rq) != 0) {
+		return;
+	}
+
+	q = find_queued(st, &rq);
+	if (!q && st->nr_queued >= MAX_QUEUED)
+		q = oldest_queued(st);
+	if (!q) {
+		q = array_grow(st->queued, st->nr_queued, sizeof(*q));
+		if (!q)
+			return;
+		st->queued = q;
+		q = &st->queued[st->nr_queued++];
+	}
+
+	q->major = rq.major;
+	q->minor = rq.minor;
+	q->sector = rq.sector;
+	q->owner = task;
+	q->queued = ts_to_ns(ts);
+}
+
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
+{
+	struct block_rq_state *st = subpattern_data(lc, &sp_def);
+	struct block_rq *in_d = inbound_data;
+	struct queued_io *q;
+	struct block_rq rq;
+	struct block_rq *d;
+	int fi;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	(void)task;
+
+	memset(&rq, 0, sizeof(rq));
+
+	switch (bound) {
+	case in:
+		if (parse_rq(traceline, ISSUE_STR, &rq) != 0)
+			return NULL;
+		q = find_queued(st, &rq);
+		if (q) {
+			rq.owner = q->owner;
+			rq.queued = q->queued;
+			*q = st->queued[--st->nr_queued];
+		}
+		break;
+	case out:
+		if (parse_rq(traceline, COMPLETE_STR, &rq) != 0)
+			return NULL;
+		if (rq.sector != in_d->sector || rq.major != in_d->major ||
+		    rq.minor != in_d->minor) {
+			return NULL;
+		}
+		rq = *in_d;
+		fi = subpattern_focus_index(lc, in_d->owner);
+		if (in_d->owner && fi >= 0 && st->waiting[fi]) {
+			rq.owner_waiting = 1;
+			in_d->owner_waiting = 1;
+		}
+		break;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	*d = rq;
+	d->in = (bound == in);
+
+	return d;
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct block_rq *d = data;
+
+	return (d->owner == task && d->owner_waiting);
+}
+
+static void sp_print(void *data)
+{
+	struct block_rq *d = data;
+
+	printf("block_rq:%s%sdev=%u,%u %s sector=%llu bytes=%lu",
+	       d->in ? "in" : "out", d->in ? ISSUE_STR : COMPLETE_STR,
+	       d->major, d->minor, d->rwbs, d->sector,
+	       d->nr_sector * SECTOR_SIZE);
+	if (d->owner)
+		printf(" task=%u", d->owner);
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static void sp_unregister(struct latcheck *lc,
+			  const struct subpattern_definition *def)
+{
+	struct block_rq_state *st = subpattern_data(lc, def);
+
+	if (st)
+		free(st->queued);
+	free(st);
+}
+
+static const struct subpattern_ops sp_ops = {
+	.enable = sp_enable,
+	.traceline = sp_traceline,
+	.match = sp_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+	.unregister = sp_unregister,
+};
+
+static const struct subpattern_definition sp_def = {
+	.name = "block_rq",
+	.ops = &sp_ops,
+	.has_sched_switch = 1,
+};
+
+/* the request of a block_rq instance, NULL for other sub-patterns */
+const struct block_rq *block_rq_of(struct subpattern_instance *sp_inst)
+{
+	if (sp_inst->def != &sp_def)
+		return NULL;
+
+	return sp_inst->data;
+}
+
+int register_block_rq(struct latcheck *lc)
+{
+	struct block_rq_state *st;
+
+	if (register_subpattern(lc, &sp_def) != 0)
+		return -1;
+
+	st = calloc(1, sizeof(*st));
+	if (!st) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+	subpattern_set_data(lc, &sp_def, st);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCK_RQ_H
+#define BLOCK_RQ_H
+
+#include <sys/types.h>
+#include "subpattern.h"
+
+#define SECTOR_SIZE 512
+
+struct block_rq {
+	unsigned int major;
+	unsigned int minor;
+	unsigned long long sector;
+	unsigned long nr_sector;
+	char rwbs[8];
+
+	/* the focus task that queued the I/O, 0 if unknown */
+	pid_t owner;
+	unsigned long long queued;
+
+	/* completed while the owner was in uninterruptible sleep */
+	int owner_waiting;
+	int in;
+};
+
+extern const struct block_rq *block_rq_of(struct subpattern_instance *sp_inst);
+
+#endif /* BLOCK_RQ_H */
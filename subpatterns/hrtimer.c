@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "trace_event.h"
+#include "subpattern.h"
+#include "subpatterns.h"
+#include "hrtimer.h"
+
+/*
+ * The hrtimers armed by the focus tasks (e.g. for clock_nanosleep):
+ *
+ * - hrtimer_expiry:  from hrtimer_start to hrtimer_expire_entry (or
+ *                    hrtimer_cancel) of the timer. The expiry slack is
+ *                    the actual ("now") minus the requested expiry.
+ * - hrtimer_handler: the timer callback, from hrtimer_expire_entry to
+ *                    hrtimer_expire_exit.
+ *
+ * Timers expire in interrupt context of any task, so the owner of a
+ * timer is remembered from its hrtimer_start. A periodic timer is
+ * restarted from its callback, i.e. started by another task, and stays
+ * owned as long as its function is the same.
+ */
+
+#define START_STR " hrtimer_start: "
+#define CANCEL_STR " hrtimer_cancel: "
+#define ENTRY_STR " hrtimer_expire_entry: "
+#define EXIT_STR " hrtimer_expire_exit: "
+
+#define HRTIMER_STR " hrtimer="
+#define FUNCTION_STR " function="
+#define EXPIRES_STR " expires="
+#define NOW_STR " now="
+
+struct timer_owner {
+	char hrtimer[24];
+	char function[48];
+	pid_t task;
+};
+
+/* the state of an analysis context, kept by sp_expiry_def */
+struct hrtimer_state {
+	struct timer_owner *owners;
+	int nr_owners;
+};
+
+static const struct subpattern_definition sp_expiry_def;
+
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
+{
+	char filter[FILTER_MAX];
+	int ret = 0;
+
+	(void)lc;
+
+	ret |= set_tracing(tracingpath,
+			   "events/timer/hrtimer_start/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/timer/hrtimer_cancel/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/timer/hrtimer_expire_entry/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/timer/hrtimer_expire_exit/enable", "1\n");
+
+	/*
+	 * Expiries happen in any context, only arming by the focus tasks
+	 * can be filtered. (This misses the restarts of periodic timers
+	 * from their callback.)
+	 */
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "common_pid",
+			       tasks, ntasks);
+	ret |= set_tracing(tracingpath, "events/timer/hrtimer_start/filter",
+			   filter);
+
+	return ret;
+}
+
+/* expiries are ns of the timer clock, too large for 32 bit */
+static int field_ull(const char *traceline, const char *field,
+		     unsigned long long *val)
+{
+	char *p;
+
+	p = strstr(traceline, field);
+	if (!p)
+		return -1;
+
+	*val = strtoull(p + strlen(field), NULL, 10);
+
+	return 0;
+}
+
+static struct timer_owner *find_owner(struct latcheck *lc, const char *hrtimer)
+{
+	struct hrtimer_state *st = subpattern_data(lc, &sp_expiry_def);
+	int i;
+
+	for (i = 0; i < st->nr_owners; i++) {
+		if (strcmp(st->owners[i].hrtimer, hrtimer) == 0)
+			return &st->owners[i];
+	}
+
+	return NULL;
+}
+
+/* remember (or forget) the focus task owning a timer */
+static void sp_traceline(struct latcheck *lc, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct hrtimer_state *st = subpattern_data(lc, &sp_expiry_def);
+	struct timer_owner *owner;
+	char function[48];
+	char hrtimer[24];
+
+	(void)ev;
+	(void)ts;
+	(void)cpu;
+
+	if (!strstr(traceline, START_STR))
+		return;
+	if (trace_field_str(traceline, HRTIMER_STR, hrtimer,
+			    sizeof(hrtimer)) != 0 ||
+	    trace_field_str(traceline, FUNCTION_STR, function,
+			    sizeof(function)) != 0) {
+		return;
+	}
+
+	owner = find_owner(lc, hrtimer);
+	if (subpattern_focus_index(lc, task) < 0) {
+		/* the memory of the timer was reused */
+		if (owner && strcmp(owner->function, function) != 0)
+			*owner = st->owners[--st->nr_owners];
+		return;
+	}
+
+	if (!owner) {
+		owner = array_grow(st->owners, st->nr_owners, sizeof(*owner));
+		if (!owner)
+			return;
+		st->owners = owner;
+		owner = &st->owners[st->nr_owners++];
+		strcpy(owner->hrtimer, hrtimer);
+	}
+	strcpy(owner->function, function);
+	owner->task = task;
+}
+
+static struct hrtimer_event *new_event(const char *traceline, pid_t task,
+				       enum subpattern_boundary bound,
+				       struct hrtimer_event *in_d)
+{
+	struct hrtimer_event *d;
+	char *p;
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	d->task = task;
+	d->in = (bound == in);
+	trace_field_str(traceline, HRTIMER_STR, d->hrtimer,
+			sizeof(d->hrtimer));
+	if (in_d) {
+		strcpy(d->function, in_d->function);
+		d->expires = in_d->expires;
+	} else {
+		/* expire_entry has "function=hrtimer_wakeup/0x0" */
+		trace_field_str(traceline, FUNCTION_STR, d->function,
+				sizeof(d->function));
+		p = strchr(d->function, '/');
+		if (p)
+			*p = 0;
+	}
+
+	return d;
+}
+
+static int same_timer(const char *traceline, struct hrtimer_event *in_d)
+{
+	char hrtimer[24];
+
+	if (trace_field_str(traceline, HRTIMER_STR, hrtimer,
+			    sizeof(hrtimer)) != 0) {
+		return 0;
+	}
+
+	return (strcmp(hrtimer, in_d->hrtimer) == 0);
+}
+
+static void *sp_expiry_match(struct latcheck *lc, const char *traceline,
+			     const struct trace_event *ev, pid_t task,
+			     enum subpattern_boundary bound,
+			     void *inbound_data)
+{
+	struct hrtimer_event *in_d = inbound_data;
+	unsigned long long val = 0;
+	struct timer_owner *owner;
+	struct hrtimer_event *d;
+	char hrtimer[24];
+	int cancelled = 0;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	switch (bound) {
+	case in:
+		if (!strstr(traceline, START_STR))
+			return NULL;
+		if (trace_field_str(traceline, HRTIMER_STR, hrtimer,
+				    sizeof(hrtimer)) != 0) {
+			return NULL;
+		}
+		owner = find_owner(lc, hrtimer);
+		if (!owner)
+			return NULL;
+		task = owner->task;
+		if (field_ull(traceline, EXPIRES_STR, &val) != 0)
+			return NULL;
+		break;
+	case out:
+		if (strstr(traceline, CANCEL_STR))
+			cancelled = 1;
+		else if (!strstr(traceline, ENTRY_STR))
+			return NULL;
+		if (!same_timer(traceline, in_d))
+			return NULL;
+		if (!cancelled &&
+		    field_ull(traceline, NOW_STR, &val) != 0) {
+			return NULL;
+		}
+		task = in_d->task;
+		break;
+	}
+
+	d = new_event(traceline, task, bound, in_d);
+	if (!d)
+		return NULL;
+
+	if (bound == in)
+		d->expires = val;
+	else
+		d->now = val;
+	d->cancelled = cancelled;
+
+	return d;
+}
+
+static void *sp_handler_match(struct latcheck *lc, const char *traceline,
+			      const struct trace_event *ev, pid_t task,
+			      enum subpattern_boundary bound,
+			      void *inbound_data)
+{
+	struct hrtimer_event *in_d = inbound_data;
+	struct timer_owner *owner;
+	char hrtimer[24];
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	switch (bound) {
+	case in:
+		if (!strstr(traceline, ENTRY_STR))
+			return NULL;
+		if (trace_field_str(traceline, HRTIMER_STR, hrtimer,
+				    sizeof(hrtimer)) != 0) {
+			return NULL;
+		}
+		owner = find_owner(lc, hrtimer);
+		if (!owner)
+			return NULL;
+		task = owner->task;
+		break;
+	case out:
+		if (!strstr(traceline, EXIT_STR))
+			return NULL;
+		if (!same_timer(traceline, in_d))
+			return NULL;
+		task = in_d->task;
+		break;
+	}
+
+	return new_event(traceline, task, bound, in_d);
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct hrtimer_event *d = data;
+
+	return (d->task == task);
+}
+
+static void print_ns(const char *name, unsigned long long ns)
+{
+	printf(" %s=%llu.%06llu", name, ns / 1000000000ULL,
+	       ns % 1000000000ULL / 1000);
+}
+
+static void sp_expiry_print(void *data)
+{
+	struct hrtimer_event *d = data;
+
+	if (d->in) {
+		printf("hrtimer_expiry:in%stask=%u function=%s",
+		       START_STR, d->task, d->function);
+		print_ns("expires", d->expires);
+	} else if (d->cancelled) {
+		printf("hrtimer_expiry:out%stask=%u", CANCEL_STR, d->task);
+	} else {
+		printf("hrtimer_expiry:out%stask=%u slack=%lld us",
+		       ENTRY_STR, d->task,
+		       ((long long)d->now - (long long)d->expires) / 1000);
+	}
+}
+
+static void sp_handler_print(void *data)
+{
+	struct hrtimer_event *d = data;
+
+	printf("hrtimer_handler:%s%stask=%u function=%s",
+	       d->in ? "in" : "out", d->in ? ENTRY_STR : EXIT_STR,
+	       d->task, d->function);
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static void sp_unregister(struct latcheck *lc,
+			  const struct subpattern_definition *def)
+{
+	struct hrtimer_state *st = subpattern_data(lc, def);
+
+	if (st)
+		free(st->owners);
+	free(st);
+}
+
+/* only one of the two remembers the owners */
+static const struct subpattern_ops sp_expiry_ops = {
+	.enable = sp_enable,
+	.traceline = sp_traceline,
+	.match = sp_expiry_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_expiry_print,
+	.free_data = sp_free_data,
+	.unregister = sp_unregister,
+};
+
+static const struct subpattern_ops sp_handler_ops = {
+	.match = sp_handler_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_handler_print,
+	.free_data = sp_free_data,
+};
+
+static const struct subpattern_definition sp_expiry_def = {
+	.name = "hrtimer_expiry",
+	.ops = &sp_expiry_ops,
+};
+
+static const struct subpattern_definition sp_handler_def = {
+	.name = "hrtimer_handler",
+	.ops = &sp_handler_ops,
+};
+
+/* the timer of an hrtimer_expiry instance, NULL for other sub-patterns */
+const struct hrtimer_event *
+hrtimer_expiry_of(struct subpattern_instance *sp_inst)
+{
+	if (sp_inst->def != &sp_expiry_def)
+		return NULL;
+
+	return sp_inst->data;
+}
+
+/* the timer of an hrtimer_handler instance, NULL for other sub-patterns */
+const struct hrtimer_event *
+hrtimer_handler_of(struct subpattern_instance *sp_inst)
+{
+	if (sp_inst->def != &sp_handler_def)
+		return NULL;
+
+	return sp_inst->data;
+}
+
+int register_hrtimer(struct latcheck *lc)
+{
+	struct hrtimer_state *st;
+
+	if (register_subpattern(lc, &sp_expiry_def) != 0)
+		return -1;
+
+	st = calloc(1, sizeof(*st));
+	if (!st) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+	subpattern_set_data(lc, &sp_expiry_def, st);
+
+	return register_subpattern(lc, &sp_handler_def);
+}
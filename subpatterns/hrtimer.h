@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include <sys/types.h>
+#include "subpattern.h"
+
+struct hrtimer_event {
+	pid_t task;
+	char hrtimer[24];
+	char function[48];
+
+	/* requested and actual expiry, in the clock of the timer */
+	unsigned long long expires;
+	unsigned long long now;
+
+	int cancelled;
+	int in;
+};
+
+extern const struct hrtimer_event *
+hrtimer_expiry_of(struct subpattern_instance *sp_inst);
+extern const struct hrtimer_event *
+hrtimer_handler_of(struct subpattern_instance *sp_inst);
+
+#endif /* HRTIMER_H */
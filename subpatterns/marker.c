@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "trace_event.h"
+#include "subpattern.h"
+
+/*
+ * Application defined sub-patterns. A task writes "latcheck:in <name>"
+ * to the trace_marker when it enters a section of its own (e.g. a
+ * transaction) and "latcheck:out <name>" when it leaves it, see
+ * latcheck_marker.h. Sections of the same name must not be nested
+ * within one task.
+ */
+
+#define MARKER_STR " tracing_mark_write: "
+#define IN_STR "latcheck:in "
+#define OUT_STR "latcheck:out "
+
+#define MARKER_NAME_MAX 32
+
+struct sb_data {
+	pid_t task;
+	char name[MARKER_NAME_MAX];
+	int in;
+};
+
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
+{
+	int ret = 0;
+
+	(void)lc;
+	(void)tasks;
+	(void)ntasks;
+
+	ret |= set_tracing(tracingpath, "options/markers", "1\n");
+	ret |= set_tracing(tracingpath, "events/ftrace/print/enable", "1\n");
+
+	return ret;
+}
+
+/* copy the section name following the marker keyword */
+static int parse_name(const char *p, char *name, size_t size)
+{
+	size_t len = strcspn(p, " \n");
+
+	if (!len || len >= size)
+		return -1;
+
+	memcpy(name, p, len);
+	name[len] = 0;
+
+	return 0;
+}
+
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
+{
+	struct sb_data *in_d = inbound_data;
+	char name[MARKER_NAME_MAX];
+	const char *keyword;
+	struct sb_data *d;
+	const char *p;
+
+	(void)lc;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	p = strstr(traceline, MARKER_STR);
+	if (!p)
+		return NULL;
+	p += strlen(MARKER_STR);
+
+	keyword = (bound == in) ? IN_STR : OUT_STR;
+	if (strncmp(p, keyword, strlen(keyword)) != 0)
+		return NULL;
+	p += strlen(keyword);
+
+	if (parse_name(p, name, sizeof(name)) != 0)
+		return NULL;
+
+	if (in_d && (in_d->task != task || strcmp(in_d->name, name) != 0))
+		return NULL;
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	d->task = task;
+	strcpy(d->name, name);
+	d->in = (bound == in);
+
+	return d;
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct sb_data *d = data;
+
+	return (d->task == task);
+}
+
+static void sp_print(void *data)
+{
+	struct sb_data *d = data;
+
+	printf("marker:%s" MARKER_STR "%s%s task=%u", d->in ? "in" : "out",
+	       d->in ? IN_STR : OUT_STR, d->name, d->task);
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static const struct subpattern_ops sp_ops = {
+	.enable = sp_enable,
+	.match = sp_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+};
+
+static const struct subpattern_definition sp_def = {
+	.name = "marker",
+	.ops = &sp_ops,
+};
+
+int register_marker(struct latcheck *lc)
+{
+	return register_subpattern(lc, &sp_def);
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "kallsyms.h"
+#include "util.h"
+#include "trace_event.h"
+#include "subpattern.h"
+#include "page_fault.h"
+
+/*
+ * A page fault of a task, from the exceptions:page_fault_user or
+ * page_fault_kernel event (x86) to the next event the task traces
+ * itself after the fault, such as its next system call. There is no
+ * event for the end of the fault handling, so the span is an upper
+ * bound. Scheduler events are skipped, a fault that sleeps (e.g. to
+ * read the page from disk) spans the sched_out of the task.
+ */
+
+#define IN_USER_STR " page_fault_user: "
+#define IN_KERNEL_STR " page_fault_kernel: "
+#define IN_ADDRESS_STR " address="
+#define IN_IP_STR " ip="
+#define IN_ERROR_STR " error_code="
+
+#define SCHED_STR " sched_"
+
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
+{
+	char filter[FILTER_MAX];
+	int ret = 0;
+
+	(void)lc;
+
+	ret |= set_tracing(tracingpath,
+			   "events/exceptions/page_fault_user/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/exceptions/page_fault_kernel/enable",
+			   "1\n");
+
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "common_pid",
+			       tasks, ntasks);
+	ret |= set_tracing(tracingpath,
+			   "events/exceptions/page_fault_user/filter", filter);
+
+	ret |= set_tracing(tracingpath,
+			   "events/exceptions/page_fault_kernel/filter",
+			   filter);
+
+	return ret;
+}
+
+static int parse_hex(const char *traceline, const char *field,
+		     unsigned long long *val)
+{
+	char *p;
+
+	p = strstr(traceline, field);
+	if (!p)
+		return -1;
+
+	*val = strtoull(p + strlen(field), NULL, 16);
+
+	return 0;
+}
+
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
+{
+	struct page_fault *in_d = inbound_data;
+	unsigned long long error_code = 0;
+	unsigned long long address = 0;
+	unsigned long long ip = 0;
+	struct page_fault *d;
+	int kernel = 0;
+
+	(void)lc;
+
+	switch (bound) {
+	case in:
+		if (ev->type != TEV_OTHER)
+			return NULL;
+		if (strstr(traceline, IN_KERNEL_STR))
+			kernel = 1;
+		else if (!strstr(traceline, IN_USER_STR))
+			return NULL;
+		if (parse_hex(traceline, IN_ADDRESS_STR, &address) != 0 ||
+		    parse_hex(traceline, IN_IP_STR, &ip) != 0 ||
+		    parse_hex(traceline, IN_ERROR_STR, &error_code) != 0) {
+			return NULL;
+		}
+		break;
+	case out:
+		if (in_d->task != task)
+			return NULL;
+		if (strstr(traceline, SCHED_STR)) {
+			if (ev->type == TEV_SCHED_SWITCH && ev->pid == task)
+				in_d->slept = 1;
+			return NULL;
+		}
+		break;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	d->task = task;
+	d->kernel = kernel;
+	d->address = address;
+	d->ip = ip;
+	d->error_code = error_code;
+	d->in = (bound == in);
+	if (in_d) {
+		d->kernel = in_d->kernel;
+		d->address = in_d->address;
+		d->ip = in_d->ip;
+		d->error_code = in_d->error_code;
+		d->slept = in_d->slept;
+	}
+
+	return d;
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct page_fault *d = data;
+
+	return (d->task == task);
+}
+
+/* the access of a fault, e.g. "write,not-present" */
+const char *page_fault_type(unsigned long error_code)
+{
+	if (error_code & PF_INSTR)
+		return (error_code & PF_PROT) ? "exec,protection" :
+						"exec,not-present";
+	if (error_code & PF_WRITE)
+		return (error_code & PF_PROT) ? "write,protection" :
+						"write,not-present";
+
+	return (error_code & PF_PROT) ? "read,protection" : "read,not-present";
+}
+
+/* the faulting code address, resolved for faults in the kernel */
+void page_fault_ip(const struct page_fault *pf, char *buf, size_t size)
+{
+	if (!pf->kernel || kallsyms_resolve(pf->ip, buf, size) != 0)
+		snprintf(buf, size, "0x%llx", pf->ip);
+}
+
+static void sp_print(void *data)
+{
+	struct page_fault *d = data;
+	char ip[64];
+
+	if (!d->in) {
+		printf("page_fault:out task=%u%s", d->task,
+		       d->slept ? " slept" : "");
+		return;
+	}
+
+	page_fault_ip(d, ip, sizeof(ip));
+	printf("page_fault:in%stask=%u address=0x%llx ip=%s %s",
+	       d->kernel ? IN_KERNEL_STR : IN_USER_STR, d->task,
+	       d->address, ip, page_fault_type(d->error_code));
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static const struct subpattern_ops sp_ops = {
+	.enable = sp_enable,
+	.match = sp_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+};
+
+static const struct subpattern_definition sp_def = {
+	.name = "page_fault",
+	.ops = &sp_ops,
+};
+
+/* the fault of a page_fault instance, NULL for other sub-patterns */
+const struct page_fault *page_fault_of(struct subpattern_instance *sp_inst)
+{
+	if (sp_inst->def != &sp_def)
+		return NULL;
+
+	return sp_inst->data;
+}
+
+int register_page_fault(struct latcheck *lc)
+{
+	return register_subpattern(lc, &sp_def);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAGE_FAULT_H
+#define PAGE_FAULT_H
+
+#include <sys/types.h>
+#include "subpattern.h"
+
+/* x86 page fault error code bits */
+#define PF_PROT  0x01
+#define PF_WRITE 0x02
+#define PF_INSTR 0x10
+
+struct page_fault {
+	pid_t task;
+	int kernel;
+	unsigned long long address;
+	unsigned long long ip;
+	unsigned long error_code;
+
+	/* the task was scheduled out while handling the fault */
+	int slept;
+	int in;
+};
+
+extern const struct page_fault *
+page_fault_of(struct subpattern_instance *sp_inst);
+extern const char *page_fault_type(unsigned long error_code);
+extern void page_fault_ip(const struct page_fault *pf, char *buf,
+			  size_t size);
+
+#endif /* PAGE_FAULT_H */
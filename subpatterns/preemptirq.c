@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "kallsyms.h"
+#include "util.h"
+#include "trace_event.h"
+#include "latcheck.h"
+#include "subpattern.h"
+#include "subpatterns.h"
+
+/*
+ * Sections with preemption or interrupts disabled on a CPU, from the
+ * preemptirq events. A section is relevant to a focus task if the task
+ * was waiting to run on that CPU when the section began or ended, i.e.
+ * the section overlaps a sched_latency (or preempted) span of the task.
+ *
+ * These events are very frequent, so they are only enabled for the
+ * CPUs given in the preemptirq_cpus of the context config (-C).
+ */
+
+#define CALLER_STR " caller="
+
+struct section_kind {
+	const char *name;
+	const char *system;
+	const char *in_event;
+	const char *out_event;
+};
+
+struct sb_data {
+	const struct section_kind *kind;
+	int cpu;
+	char caller[64];
+	/* bit i is focus task i of the context */
+	unsigned long focus_mask;
+	struct latcheck *lc;
+	int in;
+};
+
+/* a focus task that is runnable but not running */
+struct focus_wait {
+	int pending;
+	int cpu;
+};
+
+/* the state of an analysis context, kept by sp_preempt_def */
+struct preemptirq_state {
+	struct focus_wait waits[MAX_FOCUS_TASKS];
+	/* the CPU of the trace line being matched */
+	int line_cpu;
+
+	/* the CPUs traced, none if not set */
+	cpu_set_t cpus;
+	int cpus_set;
+};
+
+static const struct subpattern_definition sp_preempt_def;
+
+static const struct section_kind preempt_kind = {
+	.name = "preempt_off",
+	.system = "events/preemptirq/preempt",
+	.in_event = " preempt_disable: ",
+	.out_event = " preempt_enable: ",
+};
+
+static const struct section_kind irq_kind = {
+	.name = "irq_off",
+	.system = "events/preemptirq/irq",
+	.in_event = " irq_disable: ",
+	.out_event = " irq_enable: ",
+};
+
+static int sp_enable_kind(struct latcheck *lc, const char *tracingpath,
+			  const struct section_kind *kind)
+{
+	struct preemptirq_state *st = subpattern_data(lc, &sp_preempt_def);
+	char filter[FILTER_MAX];
+	char path[128];
+	size_t len = 0;
+	int ret = 0;
+	int cpu;
+
+	/* far too many events to trace every CPU */
+	if (!st->cpus_set)
+		return 0;
+
+	filter[0] = 0;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &st->cpus))
+			continue;
+		ret = snprintf(filter + len, sizeof(filter) - len,
+			       "%sCPU == %d", len ? " || " : "", cpu);
+		if (ret < 0 || (size_t)ret >= sizeof(filter) - len)
+			return -1;
+		len += ret;
+	}
+	ret = 0;
+
+	snprintf(path, sizeof(path), "%s_disable/filter", kind->system);
+	ret |= set_tracing(tracingpath, path, filter);
+	snprintf(path, sizeof(path), "%s_enable/filter", kind->system);
+	ret |= set_tracing(tracingpath, path, filter);
+
+	snprintf(path, sizeof(path), "%s_disable/enable", kind->system);
+	ret |= set_tracing(tracingpath, path, "1\n");
+	snprintf(path, sizeof(path), "%s_enable/enable", kind->system);
+	ret |= set_tracing(tracingpath, path, "1\n");
+
+	return ret;
+}
+
+/* track where the focus tasks are waiting to run */
+static void sp_traceline(struct latcheck *lc, const char *traceline,
+			 const struct trace_event *ev,
+			 struct timespec *ts, int cpu, pid_t task)
+{
+	struct preemptirq_state *st = subpattern_data(lc, &sp_preempt_def);
+	struct focus_wait *waits = st->waits;
+	int fi;
+
+	(void)traceline;
+	(void)ts;
+	(void)task;
+
+	st->line_cpu = cpu;
+
+	switch (ev->type) {
+	case TEV_SCHED_WAKEUP:
+		fi = subpattern_focus_index(lc, ev->pid);
+		if (fi < 0)
+			break;
+		waits[fi].pending = 1;
+		waits[fi].cpu = ev->cpu >= 0 ? ev->cpu : cpu;
+		break;
+	case TEV_SCHED_MIGRATE:
+		fi = subpattern_focus_index(lc, ev->pid);
+		if (fi >= 0 && waits[fi].pending)
+			waits[fi].cpu = ev->cpu;
+		break;
+	case TEV_SCHED_SWITCH:
+		/* preempted, i.e. still runnable */
+		fi = subpattern_focus_index(lc, ev->pid);
+		if (fi >= 0 && ev->prev_state[0] == 'R') {
+			waits[fi].pending = 1;
+			waits[fi].cpu = cpu;
+		}
+		fi = subpattern_focus_index(lc, ev->next_pid);
+		if (fi >= 0)
+			waits[fi].pending = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+/* the focus tasks currently waiting to run on a CPU */
+static unsigned long waiting_mask(const struct preemptirq_state *st, int cpu)
+{
+	unsigned long mask = 0;
+	int fi;
+
+	for (fi = 0; fi < MAX_FOCUS_TASKS; fi++) {
+		if (st->waits[fi].pending && st->waits[fi].cpu == cpu)
+			mask |= 1UL << fi;
+	}
+
+	return mask;
+}
+
+static void parse_caller(const char *traceline, char *buf, size_t size)
+{
+	unsigned long long addr;
+	char *end;
+
+	if (trace_field_str(traceline, CALLER_STR, buf, size) != 0) {
+		snprintf(buf, size, "?");
+		return;
+	}
+
+	/* raw addresses are resolved, symbolic callers kept as is */
+	if (strncmp(buf, "0x", 2) != 0)
+		return;
+	addr = strtoull(buf, &end, 16);
+	if (*end)
+		return;
+	kallsyms_resolve(addr, buf, size);
+}
+
+static void *sp_match_kind(struct latcheck *lc,
+			   const struct section_kind *kind,
+			   const char *traceline,
+			   enum subpattern_boundary bound, void *inbound_data)
+{
+	struct preemptirq_state *st = subpattern_data(lc, &sp_preempt_def);
+	struct sb_data *in_d = inbound_data;
+	int line_cpu = st->line_cpu;
+	struct sb_data *d;
+
+	if (st->cpus_set && !CPU_ISSET(line_cpu, &st->cpus))
+		return NULL;
+
+	switch (bound) {
+	case in:
+		if (!strstr(traceline, kind->in_event))
+			return NULL;
+		break;
+	case out:
+		if (!strstr(traceline, kind->out_event))
+			return NULL;
+		if (in_d->cpu != line_cpu)
+			return NULL;
+		break;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	d->kind = kind;
+	d->cpu = line_cpu;
+	d->in = (bound == in);
+	parse_caller(traceline, d->caller, sizeof(d->caller));
+	d->focus_mask = waiting_mask(st, line_cpu);
+	d->lc = lc;
+
+	/* both ends carry the focus tasks waiting at either end */
+	if (in_d) {
+		d->focus_mask |= in_d->focus_mask;
+		in_d->focus_mask = d->focus_mask;
+	}
+
+	return d;
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct sb_data *d = data;
+	int fi;
+
+	fi = subpattern_focus_index(d->lc, task);
+	if (fi < 0)
+		return 0;
+
+	return !!(d->focus_mask & (1UL << fi));
+}
+
+static void sp_print(void *data)
+{
+	struct sb_data *d = data;
+
+	printf("%s:%s%scpu=%d caller=%s", d->kind->name,
+	       d->in ? "in" : "out",
+	       d->in ? d->kind->in_event : d->kind->out_event,
+	       d->cpu, d->caller);
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static int sp_preempt_enable(struct latcheck *lc, const char *tracingpath,
+			     const pid_t *tasks, int ntasks)
+{
+	(void)tasks;
+	(void)ntasks;
+
+	return sp_enable_kind(lc, tracingpath, &preempt_kind);
+}
+
+static void *sp_preempt_match(struct latcheck *lc, const char *traceline,
+			      const struct trace_event *ev, pid_t task,
+			      enum subpattern_boundary bound,
+			      void *inbound_data)
+{
+	(void)task;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	return sp_match_kind(lc, &preempt_kind, traceline, bound,
+			     inbound_data);
+}
+
+static int sp_irq_enable(struct latcheck *lc, const char *tracingpath,
+			 const pid_t *tasks, int ntasks)
+{
+	(void)tasks;
+	(void)ntasks;
+
+	return sp_enable_kind(lc, tracingpath, &irq_kind);
+}
+
+static void *sp_irq_match(struct latcheck *lc, const char *traceline,
+			  const struct trace_event *ev, pid_t task,
+			  enum subpattern_boundary bound,
+			  void *inbound_data)
+{
+	(void)task;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
+	return sp_match_kind(lc, &irq_kind, traceline, bound, inbound_data);
+}
+
+static void sp_unregister(struct latcheck *lc,
+			  const struct subpattern_definition *def)
+{
+	free(subpattern_data(lc, def));
+}
+
+/* only one of the two tracks the focus tasks */
+static const struct subpattern_ops sp_preempt_ops = {
+	.enable = sp_preempt_enable,
+	.traceline = sp_traceline,
+	.match = sp_preempt_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+	.unregister = sp_unregister,
+};
+
+static const struct subpattern_ops sp_irq_ops = {
+	.enable = sp_irq_enable,
+	.match = sp_irq_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+};
+
+static const struct subpattern_definition sp_preempt_def = {
+	.name = "preempt_off",
+	.ops = &sp_preempt_ops,
+	.has_sched_switch = 1,
+};
+
+static const struct subpattern_definition sp_irq_def = {
+	.name = "irq_off",
+	.ops = &sp_irq_ops,
+	.has_sched_switch = 1,
+};
+
+int register_preemptirq(struct latcheck *lc)
+{
+	const char *list = subpattern_config(lc)->preemptirq_cpus;
+	struct preemptirq_state *st;
+
+	if (register_subpattern(lc, &sp_preempt_def) != 0)
+		return -1;
+
+	st = calloc(1, sizeof(*st));
+	if (!st) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return -1;
+	}
+	subpattern_set_data(lc, &sp_preempt_def, st);
+
+	if (list) {
+		if (parse_cpus(list, &st->cpus) != 0) {
+			fprintf(stderr, "invalid CPU list: %s\n", list);
+			return -1;
+		}
+		st->cpus_set = 1;
+	}
+
+	return register_subpattern(lc, &sp_irq_def);
+}
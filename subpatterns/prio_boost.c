@@ -21,6 +21,7 @@
 #include <string.h>
 #include <errno.h>
 #include "util.h"
+#include "trace_event.h"
 #include "subpattern.h"
 
 struct sb_data {
@@ -36,23 +37,29 @@ struct sb_data {
 #define OLDPRIO_STR " oldprio="
 #define NEWPRIO_STR " newprio="
 
-static int sp_enable(const char *tracingpath, pid_t task)
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
 {
-	char filter[64];
+	char filter[FILTER_MAX];
 	int ret = 0;
 
+	(void)lc;
+
 	ret |= set_tracing(tracingpath,
 			   "events/sched/sched_pi_setprio/enable", "1\n");
 
-	snprintf(filter, sizeof(filter), "pid == %u\n", task);
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "pid", tasks, ntasks);
 	ret |= set_tracing(tracingpath, "events/sched/sched_pi_setprio/filter",
 			   filter);
 
 	return ret;
 }
 
-static void *sp_match(const char *traceline, pid_t task,
-		      enum subpattern_boundary bound, void *inbound_data)
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
 {
 	struct sb_data *in_d = inbound_data;
 	unsigned int newprio;
@@ -61,6 +68,11 @@ static void *sp_match(const char *traceline, pid_t task,
 	pid_t target_task;
 	char *pid_str;
 
+	(void)lc;
+
+	if (ev->type != TEV_OTHER)
+		return NULL;
+
 	if (!strstr(traceline, EVENT_STR))
 		return NULL;
 
@@ -146,7 +158,7 @@ static void sp_free_data(void *data)
 	free(data);
 }
 
-static struct subpattern_ops sp_ops = {
+static const struct subpattern_ops sp_ops = {
 	.enable = sp_enable,
 	.match = sp_match,
 	.is_relevant = sp_is_relevant,
@@ -154,13 +166,13 @@ static struct subpattern_ops sp_ops = {
 	.free_data = sp_free_data,
 };
 
-static struct subpattern_definition sp_def = {
-	.data = NULL,
+static const struct subpattern_definition sp_def = {
+	.name = "prio_boost",
 	.ops = &sp_ops,
 	.has_sched_switch = 1,
 };
 
-int register_prio_boost(void)
+int register_prio_boost(struct latcheck *lc)
 {
-	return register_subpattern(&sp_def);
+	return register_subpattern(lc, &sp_def);
 }
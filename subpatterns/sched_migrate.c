@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "trace_event.h"
+#include "subpattern.h"
+
+struct sb_data {
+	pid_t task;
+	const char *event;
+	unsigned long orig_cpu;
+	unsigned long dest_cpu;
+	int in;
+};
+
+#define IN_EVENT_STR " sched_migrate_task: "
+
+#define OUT_EVENT_STR " sched_switch: "
+
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
+{
+	char filter[FILTER_MAX];
+	int ret = 0;
+
+	(void)lc;
+
+	ret |= set_tracing(tracingpath,
+			   "events/sched/sched_migrate_task/enable", "1\n");
+
+	ret |= set_tracing(tracingpath,
+			   "events/sched/sched_switch/enable", "1\n");
+
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "pid", tasks, ntasks);
+	ret |= set_tracing(tracingpath,
+			   "events/sched/sched_migrate_task/filter", filter);
+
+	return ret;
+}
+
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
+{
+	struct sb_data *in_d = inbound_data;
+	unsigned long orig_cpu = 0;
+	unsigned long dest_cpu = 0;
+	const char *event = "";
+	struct sb_data *d;
+	pid_t target_task;
+
+	(void)lc;
+	(void)traceline;
+	(void)task;
+
+	switch (bound) {
+	case in:
+		if (ev->type != TEV_SCHED_MIGRATE)
+			return NULL;
+		event = IN_EVENT_STR;
+		orig_cpu = ev->orig_cpu;
+		dest_cpu = ev->cpu;
+		target_task = ev->pid;
+		break;
+	case out:
+		if (ev->type != TEV_SCHED_SWITCH)
+			return NULL;
+		event = OUT_EVENT_STR;
+		target_task = ev->next_pid;
+		break;
+	}
+
+	if (in_d && in_d->task != target_task)
+		return NULL;
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	d->task = target_task;
+	d->event = event;
+	d->orig_cpu = orig_cpu;
+	d->dest_cpu = dest_cpu;
+	d->in = (bound == in);
+
+	return d;
+}
+
+static int sp_is_relevant(pid_t task, void *data)
+{
+	struct sb_data *d = data;
+
+	return (d->task == task);
+}
+
+static void sp_print(void *data)
+{
+	struct sb_data *d = data;
+
+	printf("sched_migrate:%s%stask=%u", d->in ? "in" : "out",
+	       d->event, d->task);
+	if (d->in)
+		printf(" cpu=%lu->%lu", d->orig_cpu, d->dest_cpu);
+}
+
+static void sp_free_data(void *data)
+{
+	free(data);
+}
+
+static const struct subpattern_ops sp_ops = {
+	.enable = sp_enable,
+	.match = sp_match,
+	.is_relevant = sp_is_relevant,
+	.print = sp_print,
+	.free_data = sp_free_data,
+};
+
+static const struct subpattern_definition sp_def = {
+	.name = "sched_migrate",
+	.ops = &sp_ops,
+	.has_sched_switch = 1,
+};
+
+int register_sched_migrate(struct latcheck *lc)
+{
+	return register_subpattern(lc, &sp_def);
+}
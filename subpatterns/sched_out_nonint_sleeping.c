@@ -18,5 +18,7 @@
 
 #define SCHED_OUT_REG_FUNC register_sched_out_nonint_sleeping
 #define SCHED_OUT_NAME "nonint_sleeping"
-#define SCHED_OUT_STATE "D|K"
+#define SCHED_OUT_STATE "D"
+/* kernels before 4.14 also print TASK_WAKEKILL */
+#define SCHED_OUT_STATE_ALT "D|K"
 #include "sched_out_template.h"
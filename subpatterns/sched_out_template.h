@@ -24,6 +24,7 @@
 #include <string.h>
 #include <errno.h>
 #include "util.h"
+#include "trace_event.h"
 #include "subpattern.h"
 
 struct sb_data {
@@ -33,81 +34,84 @@ struct sb_data {
 };
 
 #define IN_EVENT_STR " sched_switch: "
-#define IN_STATE_STR " prev_state=" SCHED_OUT_STATE " "
-#define IN_PID_STR " prev_pid="
 
 #define OUT_EVENT_WAKE_STR " sched_wakeup: "
-#define OUT_PID_WAKE_STR " pid="
 
 #define OUT_EVENT_SWITCH_STR " sched_switch: "
-#define OUT_PID_SWITCH_STR " next_pid="
 
-static int sp_enable(const char *tracingpath, pid_t task)
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
 {
-	char filter[64];
+	char filter[FILTER_MAX];
 	int ret = 0;
 
+	(void)lc;
+
 	ret |= set_tracing(tracingpath,
 			   "events/sched/sched_wakeup/enable", "1\n");
 
 	ret |= set_tracing(tracingpath,
 			   "events/sched/sched_switch/enable", "1\n");
 
-	snprintf(filter, sizeof(filter), "pid == %u\n", task);
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "pid", tasks, ntasks);
 	ret |= set_tracing(tracingpath, "events/sched/sched_wakeup/filter",
 			   filter);
 
-	snprintf(filter, sizeof(filter),
-		 "next_pid == %u || prev_pid == %u\n", task, task);
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "next_pid",
+			       tasks, ntasks);
+	ret |= filter_add_pids(filter, sizeof(filter), "prev_pid",
+			       tasks, ntasks);
 	ret |= set_tracing(tracingpath, "events/sched/sched_switch/filter",
 			   filter);
 
 	return ret;
 }
 
-static void *sp_match(const char *traceline, pid_t task,
-		      enum subpattern_boundary bound, void *inbound_data)
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
 {
 	struct sb_data *in_d = inbound_data;
 	const char *event = "";
 	struct sb_data *d;
 	pid_t target_task;
-	char *pid_str;
 
+	(void)lc;
+	(void)traceline;
 	(void)task;
 
 	switch (bound) {
 	case in:
-		if (!strstr(traceline, IN_EVENT_STR))
+		if (ev->type != TEV_SCHED_SWITCH)
 			return NULL;
 		event = IN_EVENT_STR;
-		if (!strstr(traceline, IN_STATE_STR))
+#ifdef SCHED_OUT_STATE_ALT
+		if (strcmp(ev->prev_state, SCHED_OUT_STATE) != 0 &&
+		    strcmp(ev->prev_state, SCHED_OUT_STATE_ALT) != 0) {
+			return NULL;
+		}
+#else
+		if (strcmp(ev->prev_state, SCHED_OUT_STATE) != 0)
 			return NULL;
-		pid_str = strstr(traceline, IN_PID_STR);
-		if (pid_str)
-			pid_str += strlen(IN_PID_STR);
+#endif
+		target_task = ev->pid;
 		break;
 	case out:
-		if (strstr(traceline, OUT_EVENT_WAKE_STR)) {
+		if (ev->type == TEV_SCHED_WAKEUP) {
 			event = OUT_EVENT_WAKE_STR;
-			pid_str = strstr(traceline, OUT_PID_WAKE_STR);
-			if (pid_str)
-				pid_str += strlen(OUT_PID_WAKE_STR);
-		} else if (strstr(traceline, OUT_EVENT_SWITCH_STR)) {
+			target_task = ev->pid;
+		} else if (ev->type == TEV_SCHED_SWITCH) {
 			event = OUT_EVENT_SWITCH_STR;
-			pid_str = strstr(traceline, OUT_PID_SWITCH_STR);
-			if (pid_str)
-				pid_str += strlen(OUT_PID_SWITCH_STR);
+			target_task = ev->next_pid;
 		} else {
 			return NULL;
 		}
 		break;
 	}
 
-	if (!pid_str)
-		return NULL;
-	target_task = strtoul(pid_str, NULL, 10);
-
 	if (in_d && in_d->task != target_task)
 		return NULL;
 
@@ -174,7 +178,7 @@ static void sp_free_data(void *data)
 }
 
 
-static struct subpattern_ops sp_ops = {
+static const struct subpattern_ops sp_ops = {
 	.enable = sp_enable,
 	.match = sp_match,
 	.is_relevant = sp_is_relevant,
@@ -183,15 +187,15 @@ static struct subpattern_ops sp_ops = {
 	.free_data = sp_free_data,
 };
 
-static struct subpattern_definition sp_def = {
-	.data = NULL,
+static const struct subpattern_definition sp_def = {
+	.name = "sched_out_" SCHED_OUT_NAME,
 	.ops = &sp_ops,
 	.has_sched_switch = 1,
 };
 
-int SCHED_OUT_REG_FUNC(void)
+int SCHED_OUT_REG_FUNC(struct latcheck *lc)
 {
-	return register_subpattern(&sp_def);
+	return register_subpattern(lc, &sp_def);
 }
 
 #endif /* SCHED_OUT_TEMPLATE_H */
@@ -19,11 +19,19 @@
 #ifndef SUBPATTERNS_H
 #define SUBPATTERNS_H
 
-extern int register_sched_out_nonint_sleeping(void);
-extern int register_sched_out_sleeping(void);
-extern int register_sched_out_runnable(void);
-extern int register_sched_latency(void);
-extern int register_prio_boost(void);
-extern int register_syscall(void);
+struct latcheck;
+
+extern int register_sched_out_nonint_sleeping(struct latcheck *lc);
+extern int register_sched_out_sleeping(struct latcheck *lc);
+extern int register_sched_out_runnable(struct latcheck *lc);
+extern int register_sched_latency(struct latcheck *lc);
+extern int register_sched_migrate(struct latcheck *lc);
+extern int register_prio_boost(struct latcheck *lc);
+extern int register_syscall(struct latcheck *lc);
+extern int register_preemptirq(struct latcheck *lc);
+extern int register_page_fault(struct latcheck *lc);
+extern int register_hrtimer(struct latcheck *lc);
+extern int register_block_rq(struct latcheck *lc);
+extern int register_marker(struct latcheck *lc);
 
 #endif /* SUBPATTERNS_H */
@@ -20,12 +20,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "util.h"
+#include "trace_event.h"
+#include "futex.h"
 #include "subpattern.h"
+#include "subpatterns/syscall.h"
 
 struct sb_data {
 	pid_t task;
 	unsigned int nr;
+	unsigned long futex_uaddr;
 	unsigned int futex_cmd;
 	const char *event;
 	int in;
@@ -35,61 +40,52 @@ struct sb_data {
 
 #define OUT_EVENT_STR " sys_exit: "
 
-static int sp_enable(const char *tracingpath, pid_t task)
+static int sp_enable(struct latcheck *lc, const char *tracingpath,
+		     const pid_t *tasks, int ntasks)
 {
-	char filter[64];
+	char filter[FILTER_MAX];
 	int ret = 0;
 
+	(void)lc;
+
 	ret |= set_tracing(tracingpath,
 			   "events/raw_syscalls/sys_enter/enable", "1\n");
 
 	ret |= set_tracing(tracingpath,
 			   "events/raw_syscalls/sys_exit/enable", "1\n");
 
-	snprintf(filter, sizeof(filter), "common_pid == %u\n", task);
+	filter[0] = 0;
+	ret |= filter_add_pids(filter, sizeof(filter), "common_pid",
+			       tasks, ntasks);
 	ret |= set_tracing(tracingpath, "events/raw_syscalls/sys_enter/filter",
 			   filter);
 
-	snprintf(filter, sizeof(filter), "common_pid == %u\n", task);
 	ret |= set_tracing(tracingpath, "events/raw_syscalls/sys_exit/filter",
 			   filter);
 
 	return ret;
 }
 
-static const char *futex_cmd[] = {
-	"FUTEX_WAIT",
-	"FUTEX_WAKE",
-	"FUTEX_FD",
-	"FUTEX_REQUEUE",
-	"FUTEX_CMP_REQUEUE",
-	"FUTEX_WAKE_OP",
-	"FUTEX_LOCK_PI",
-	"FUTEX_UNLOCK_PI",
-	"FUTEX_TRYLOCK_PI",
-	"FUTEX_WAIT_BITSET",
-	"FUTEX_WAKE_BITSET",
-	"FUTEX_WAIT_REQUEUE_PI",
-	"FUTEX_CMP_REQUEUE_PI"
-};
-static unsigned int futex_cmd_max = 11;
-
-static void *sp_match(const char *traceline, pid_t task,
-		      enum subpattern_boundary bound, void *inbound_data)
+static void *sp_match(struct latcheck *lc, const char *traceline,
+		      const struct trace_event *ev, pid_t task,
+		      enum subpattern_boundary bound,
+		      void *inbound_data)
 {
 	struct sb_data *in_d = inbound_data;
 	const char *event = "";
 	struct sb_data *d;
-	char *pid_str;
+
+	(void)lc;
+	(void)traceline;
 
 	switch (bound) {
 	case in:
-		if (!strstr(traceline, IN_EVENT_STR))
+		if (ev->type != TEV_SYS_ENTER)
 			return NULL;
 		event = IN_EVENT_STR;
 		break;
 	case out:
-		if (!strstr(traceline, OUT_EVENT_STR))
+		if (ev->type != TEV_SYS_EXIT)
 			return NULL;
 		event = OUT_EVENT_STR;
 		break;
@@ -98,11 +94,6 @@ static void *sp_match(const char *traceline, pid_t task,
 	if (in_d && in_d->task != task)
 		return NULL;
 
-	pid_str = strstr(traceline, "NR ");
-	if (!pid_str)
-		return NULL;
-	pid_str += 3;
-
 	d = calloc(1, sizeof(*d));
 	if (!d) {
 		fprintf(stderr, "calloc failed: %s\n", strerror(errno));
@@ -110,19 +101,16 @@ static void *sp_match(const char *traceline, pid_t task,
 	}
 
 	d->task = task;
-	d->nr = strtoul(pid_str, NULL, 10);
-	d->futex_cmd = futex_cmd_max + 1;
+	d->nr = ev->nr;
+	d->futex_uaddr = ev->futex_uaddr;
+	d->futex_cmd = ev->futex_cmd;
 	d->event = event;
 	d->in = (bound == in);
 
-	if (d->nr == 240) {
-		pid_str = strstr(traceline, ", ");
-		if (pid_str) {
-			pid_str += 2;
-			d->futex_cmd = strtoul(pid_str, NULL, 10);
-		} else if (in_d) {
-			d->futex_cmd = in_d->futex_cmd;
-		}
+	/* the futex arguments of sys_exit are those of its sys_enter */
+	if (d->nr == NR_FUTEX && d->futex_cmd == (unsigned int)-1 && in_d) {
+		d->futex_uaddr = in_d->futex_uaddr;
+		d->futex_cmd = in_d->futex_cmd;
 	}
 
 	return d;
@@ -135,38 +123,97 @@ static int sp_is_relevant(pid_t task, void *data)
 	return (d->task == task);
 }
 
-static void print_syscall(unsigned int nr, unsigned int fcmd)
+/*
+ * The syscall names of syscalls.txt indexed by number, loaded once on
+ * first use. The lock makes sure the table is complete before several
+ * analysis contexts look names up.
+ */
+static char **names;
+static unsigned int nr_names;
+static int names_loaded;
+static int names_missing;
+static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void load_names(void)
 {
+	unsigned long nr;
 	char line[80];
-	char str[16];
-	size_t len;
-	char *p;
+	char *name;
+	char **p;
 	FILE *f;
 
-	snprintf(str, sizeof(str), "%u ", nr);
-	len = strlen(str);
+	names_loaded = 1;
 
 	f = fopen("syscalls.txt", "r");
 	if (!f) {
-		printf("?");
+		names_missing = 1;
 		return;
 	}
 
 	while (fgets(line, sizeof(line), f)) {
-		if (strncmp(str, line, len) == 0) {
-			p = strchr(line, '\n');
-			if (p)
-				*p = 0;
-			printf(line + len);
-			if (fcmd <= futex_cmd_max)
-				printf("/%s", futex_cmd[fcmd]);
-			break;
+		nr = strtoul(line, &name, 10);
+		if (name == line || *name != ' ')
+			continue;
+		name[strcspn(name, "\n")] = 0;
+
+		if (nr >= nr_names) {
+			p = realloc(names, (nr + 1) * sizeof(*names));
+			if (!p) {
+				fprintf(stderr, "realloc failed: %s\n",
+					strerror(errno));
+				break;
+			}
+			memset(&p[nr_names], 0,
+			       (nr + 1 - nr_names) * sizeof(*names));
+			names = p;
+			nr_names = nr + 1;
 		}
+
+		free(names[nr]);
+		names[nr] = strdup(name + 1);
 	}
 
 	fclose(f);
 }
 
+/*
+ * Look up the name of a syscall in syscalls.txt. The name is "?" if
+ * the table is missing and empty if the syscall is not listed.
+ */
+int syscall_name(unsigned int nr, char *buf, size_t size)
+{
+	pthread_mutex_lock(&names_lock);
+	if (!names_loaded)
+		load_names();
+	pthread_mutex_unlock(&names_lock);
+
+	if (names_missing) {
+		snprintf(buf, size, "?");
+		return -1;
+	}
+
+	if (nr >= nr_names || !names[nr]) {
+		buf[0] = 0;
+		return -1;
+	}
+
+	snprintf(buf, size, "%s", names[nr]);
+
+	return 0;
+}
+
+static void print_syscall(unsigned int nr, unsigned int fcmd)
+{
+	const char *fname = futex_cmd_name(fcmd);
+	char name[64];
+	int ret;
+
+	ret = syscall_name(nr, name, sizeof(name));
+	printf("%s", name);
+	if (ret == 0 && nr == NR_FUTEX && fname)
+		printf("/%s", fname);
+}
+
 static void sp_print(void *data)
 {
 	struct sb_data *d = data;
@@ -181,7 +228,7 @@ static void sp_free_data(void *data)
 	free(data);
 }
 
-static struct subpattern_ops sp_ops = {
+static const struct subpattern_ops sp_ops = {
 	.enable = sp_enable,
 	.match = sp_match,
 	.is_relevant = sp_is_relevant,
@@ -189,12 +236,23 @@ static struct subpattern_ops sp_ops = {
 	.free_data = sp_free_data,
 };
 
-static struct subpattern_definition sp_def = {
-	.data = NULL,
+static const struct subpattern_definition sp_def = {
+	.name = "syscall",
 	.ops = &sp_ops,
 };
 
-int register_syscall(void)
+/* the syscall number of a syscall sub-pattern, -1 for other sub-patterns */
+int syscall_nr_of(struct subpattern_instance *sp_inst)
+{
+	struct sb_data *d = sp_inst->data;
+
+	if (sp_inst->def != &sp_def)
+		return -1;
+
+	return d->nr;
+}
+
+int register_syscall(struct latcheck *lc)
 {
-	return register_subpattern(&sp_def);
+	return register_subpattern(lc, &sp_def);
 }
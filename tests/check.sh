@@ -0,0 +1,165 @@
+#!/bin/sh
+#
+# Replay the golden traces offline (as text and from an event store),
+# aggregate event stores as runs, run the capture path on a fake tracefs
+# and run the library tests, compare the output with the expected
+# output, then compare the matching and analysis throughput with the
+# baseline.
+#
+# CHECK_UPDATE=1       rewrite the expected output and the baseline
+# CHECK_TOLERANCE=<%>  allowed slowdown against the baseline (default 50)
+#
+
+dir=$(cd "$(dirname "$0")" && pwd)
+top=$(dirname "$dir")
+tolerance=${CHECK_TOLERANCE:-50}
+esc=$(printf '\033')
+out=$(mktemp)
+trace=$(mktemp)
+fake=$(mktemp -d)
+store=$(mktemp)
+stores=$(mktemp -d)
+trap 'rm -rf "$out" "$out.perf" "$trace" "$fake" "$store" "$stores"' EXIT
+failed=0
+
+compare() {
+	name=$1
+
+	if [ -n "$CHECK_UPDATE" ]; then
+		cp "$out" "$name.out"
+		echo "updated ${name#tests/}"
+	elif diff -u "$name.out" "$out"; then
+		echo "ok      ${name#tests/}"
+	else
+		echo "FAILED  ${name#tests/}"
+		failed=1
+	fi
+}
+
+# syscall names are looked up in syscalls.txt of the working directory
+cd "$top" || exit 1
+
+for args in tests/golden/*.args; do
+	name=${args%.args}
+
+	# the arguments may contain sub-pattern name globs
+	set -f
+	"$top/latcheck" $(cat "$args") 2>&1 |
+		sed "s/${esc}\[[0-9;]*[mK]//g" > "$out"
+	set +f
+
+	compare "$name"
+done
+
+# replaying the golden traces from an event store gives the same output
+for args in tests/golden/*.args; do
+	name=${args%.args}
+
+	[ -n "$CHECK_UPDATE" ] && break
+
+	# only the analysis of a single trace (-i) is replayed
+	grep -q -- "-i " "$args" || continue
+
+	set -f
+	"$top/latcheck" --store "$store" $(cat "$args") > /dev/null 2>&1
+	"$top/latcheck" $(sed "s#-i [^ ]*#-i $store#" "$args") 2>&1 |
+		sed "s/${esc}\[[0-9;]*[mK]//g" > "$out"
+	set +f
+
+	if diff -u "$name.out" "$out"; then
+		echo "ok      store/${name#tests/golden/}"
+	else
+		echo "FAILED  store/${name#tests/golden/}"
+		failed=1
+	fi
+done
+
+# the event stores of recorded runs are aggregated like --runs
+for name in diff_a diff_b; do
+	"$top/latcheck" --store "$stores/$name.lcs" \
+		-i "tests/golden/$name.trace" -p 500 > /dev/null 2>&1
+done
+"$top/latcheck" -p 500 -i "$stores/diff_a.lcs" -i "$stores/diff_b.lcs" \
+	-i "$stores/diff_b.lcs" 2>&1 | sed "s/${esc}\[[0-9;]*[mK]//g" > "$out"
+compare tests/runs
+
+# the fake tracefs serves its trace files and records all writes
+for args in tests/fake/*.args; do
+	name=${args%.args}
+
+	rm -rf "$fake"
+	cp -RL tests/fake/root "$fake"
+
+	# the pids of manifest commands vary from run to run
+	set -f
+	"$top/latcheck" -T "$fake" $(cat "$args") 2>&1 |
+		sed -e "s/${esc}\[[0-9;]*[mK]//g" \
+		    -e 's/^  [0-9][0-9]* \(.*\(exit\|signal\)=[0-9]*:\)/  PID \1/' \
+		> "$out"
+	set +f
+
+	# nothing is written if the arguments are rejected
+	echo "writes:" >> "$out"
+	[ -f "$fake/writes" ] && cat "$fake/writes" >> "$out"
+
+	# so do the pids of traced commands (the instance is named after
+	# the first one unless split per focus task) and the synthetic
+	# event named after the pid of latcheck, but not the stale event
+	# of tests/fake/root
+	pid=$(sed -n 's/.*latency_trace\.\([0-9]*\).*/\1/p' "$out" | head -n 1)
+	sed -i -e 's/latency_trace\.[0-9]*/latency_trace.PID/g' \
+	       -e '/_4194305/!s/\(latcheck_wakeup_latency_\)[0-9]*/\1PID/g' \
+	       "$out"
+	[ -n "$pid" ] && ! grep -qw -- "$pid" "$args" &&
+		sed -i "s/\(task:\{0,1\} \|tasks: \|== \)$pid\b/\1PID/g" "$out"
+
+	compare "$name"
+done
+
+# the library tests link liblatcheck.a and print the callback output
+"$top/tests/lib/contexts" tests/golden/send_recv.trace 3724 3721 \
+	> "$out" 2>&1
+compare tests/lib/contexts
+
+"$top/tests/lib/bounded" > "$out" 2>&1
+compare tests/lib/bounded
+
+# best (lowest) ns/line of a stage over several runs
+perf() {
+	for run in 1 2 3; do
+		"$top/bench/bench" -i "$trace" -p 1000 -p 1001 |
+			awk -v stage="$1" '$1 == stage { print $6 }'
+	done | sort -n | head -n 1
+}
+
+"$top/bench/tracegen" -S 1 -t 8 -c 2 -d 2 -n 100000 > "$trace" || exit 1
+
+for stage in match analysis; do
+	ns=$(perf $stage)
+	base=$(awk -v stage=$stage '$1 == stage { print $2 }' \
+		"$dir/perf.baseline" 2>/dev/null)
+
+	if [ -n "$CHECK_UPDATE" ]; then
+		echo "$stage $ns"
+		continue
+	fi
+
+	if [ -z "$base" ]; then
+		echo "skip    $stage: no baseline"
+	elif awk -v ns="$ns" -v base="$base" -v tol="$tolerance" \
+		'BEGIN { exit !(ns > base * (1 + tol / 100)) }'; then
+		echo "FAILED  $stage: $ns ns/line, baseline $base ns/line"
+	else
+		echo "ok      $stage: $ns ns/line, baseline $base ns/line"
+	fi
+done > "$out.perf"
+
+cat "$out.perf"
+if [ -n "$CHECK_UPDATE" ]; then
+	cp "$out.perf" "$dir/perf.baseline"
+elif grep -q FAILED "$out.perf"; then
+	failed=1
+fi
+rm -f "$out.perf"
+
+exit $failed
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Run a library context in windowed mode, as a monitoring daemon does,
+ * on a long generated trace in which every cycle brings a new task, a
+ * new futex address and a new faulting code address. The state the
+ * context retains must only cover the retained history, so the heap
+ * may not grow from the first to the second half of the trace.
+ *
+ *   bounded
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "latcheck.h"
+
+#define FOCUS_TASK 100
+#define CYCLES 20000
+/* 100 us per cycle */
+#define CYCLE_NS 100000ULL
+/* the heap may grow by this much from the first to the second half */
+#define MAX_GROWTH (256 * 1024)
+
+/* the heap in use, including the large (mmap()ed) blocks */
+static size_t heap_in_use(void)
+{
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+}
+
+static int push(struct latcheck *lc, const char *comm, pid_t pid,
+		unsigned long long ns, const char *event)
+{
+	char line[512];
+
+	snprintf(line, sizeof(line), "%16s-%-5u [000] ....  %llu.%06llu: %s\n",
+		 comm, pid, ns / 1000000000ULL, ns % 1000000000ULL / 1000,
+		 event);
+
+	return latcheck_push_line(lc, line);
+}
+
+static int push_cycle(struct latcheck *lc, unsigned long i)
+{
+	unsigned long long ns = (i + 1) * CYCLE_NS;
+	pid_t worker = 1000 + i;
+	char event[128];
+	int ret = 0;
+
+	/* a futex wait of a new task on a new address */
+	snprintf(event, sizeof(event),
+		 "sys_enter: NR 240 (%lx, 0, 0, 0, 0, 0)", 0x10000 + i * 4);
+	ret |= push(lc, "worker", worker, ns, event);
+	ret |= push(lc, "worker", worker, ns + 10000, "sys_exit: NR 240 = 0");
+
+	/* a page fault of the focus task at a new code address */
+	snprintf(event, sizeof(event), "page_fault_user: address=0x7f0000001000"
+		 " ip=0x%lx error_code=0x4", 0x400000 + i * 16);
+	ret |= push(lc, "rt", FOCUS_TASK, ns + 20000, event);
+	ret |= push(lc, "rt", FOCUS_TASK, ns + 30000,
+		    "sys_enter: NR 0 (3, 7f0000300000, 1000, 0, 0, 0)");
+	ret |= push(lc, "rt", FOCUS_TASK, ns + 40000, "sys_exit: NR 0 = 4096");
+
+	return ret;
+}
+
+int main(void)
+{
+	pid_t task = FOCUS_TASK;
+	struct latcheck_config cfg;
+	struct latcheck *lc;
+	size_t half = 0;
+	size_t end;
+	unsigned long i;
+	int ret = 0;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.tasks = &task;
+	cfg.ntasks = 1;
+	cfg.flags = LATCHECK_WINDOWED | LATCHECK_QUIET;
+	cfg.window_us = 1000;
+
+	lc = latcheck_new(&cfg);
+	if (!lc)
+		return 1;
+
+	for (i = 0; i < CYCLES; i++) {
+		if (push_cycle(lc, i) != 0) {
+			printf("failed to push cycle %lu\n", i);
+			ret = 1;
+			break;
+		}
+		if (i == CYCLES / 2)
+			half = heap_in_use();
+	}
+	end = heap_in_use();
+
+	latcheck_finish(lc);
+	latcheck_free(lc);
+
+	if (end > half + MAX_GROWTH) {
+		printf("retained state grew by %lu bytes in %d cycles\n",
+		       (unsigned long)(end - half), CYCLES / 2);
+		ret = 1;
+	} else {
+		printf("retained state bounded over %d cycles\n", CYCLES);
+	}
+
+	return ret;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Analyze a trace with two library contexts at once, each in a thread
+ * of its own and with its own focus task. The first context is pushed
+ * the trace lines, the second the parsed events. The output of the
+ * callbacks of both contexts is printed once both are done.
+ *
+ *   contexts <trace> <pid> <pid>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "latcheck.h"
+
+struct context {
+	pid_t task;
+	int parsed;
+	FILE *out;
+	int ret;
+};
+
+static char **lines;
+static int nr_lines;
+
+static void on_closed(const struct latcheck_instance *inst, void *arg)
+{
+	struct context *c = arg;
+
+	fprintf(c->out, "closed      %-26s %s-%u [%03d] %llu %llu\n",
+		inst->name, inst->taskname, inst->task, inst->cpu,
+		inst->begin_ns, inst->end_ns);
+}
+
+static void on_significant(const struct latcheck_instance *inst,
+			   pid_t focus_task, void *arg)
+{
+	struct context *c = arg;
+
+	fprintf(c->out, "significant %-26s %s-%u [%03d] %llu %llu for %u\n",
+		inst->name, inst->taskname, inst->task, inst->cpu,
+		inst->begin_ns, inst->end_ns, focus_task);
+}
+
+/* split "<comm>-<pid> [<cpu>] <flags> <sec>.<usec>: <name>: <fields>" */
+static int push_parsed(struct latcheck *lc, char *line)
+{
+	struct latcheck_event ev;
+	unsigned long usec;
+	unsigned long long sec;
+	char comm[16];
+	char *fields;
+	int pid;
+	int n;
+
+	if (sscanf(line, " %15[^-]-%d [%d] %*s %llu.%lu: %n", comm, &pid,
+		   &ev.cpu, &sec, &usec, &n) != 5) {
+		return -1;
+	}
+
+	fields = strstr(line + n, ": ");
+	if (fields)
+		*fields = 0;
+
+	ev.ts_ns = sec * 1000000000ULL + usec * 1000ULL;
+	ev.pid = pid;
+	ev.comm = comm;
+	ev.name = line + n;
+	ev.fields = fields ? fields + 2 : NULL;
+
+	n = latcheck_push_event(lc, &ev);
+	if (fields)
+		*fields = ':';
+
+	return n;
+}
+
+static void *analyze(void *arg)
+{
+	struct latcheck_config cfg;
+	struct context *c = arg;
+	struct latcheck *lc;
+	char line[512];
+	int i;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.tasks = &c->task;
+	cfg.ntasks = 1;
+	cfg.flags = LATCHECK_QUIET;
+	cfg.closed = on_closed;
+	cfg.significant = on_significant;
+	cfg.arg = c;
+
+	lc = latcheck_new(&cfg);
+	if (!lc) {
+		c->ret = -1;
+		return NULL;
+	}
+
+	for (i = 0; i < nr_lines; i++) {
+		if (lines[i][0] == '#')
+			continue;
+
+		if (!c->parsed) {
+			latcheck_push_line(lc, lines[i]);
+			continue;
+		}
+
+		/* the pushed event is parsed in place */
+		snprintf(line, sizeof(line), "%s", lines[i]);
+		if (push_parsed(lc, line) != 0) {
+			fprintf(c->out, "failed to push line %d\n", i + 1);
+			c->ret = -1;
+		}
+	}
+
+	latcheck_finish(lc);
+	latcheck_free(lc);
+
+	return NULL;
+}
+
+static int read_trace(const char *path)
+{
+	char line[512];
+	char **p;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "failed to open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = 0;
+
+		p = realloc(lines, (nr_lines + 1) * sizeof(*lines));
+		if (!p)
+			break;
+		lines = p;
+
+		lines[nr_lines] = strdup(line);
+		if (!lines[nr_lines])
+			break;
+		nr_lines++;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct context contexts[2];
+	pthread_t threads[2];
+	char buf[256];
+	int ret = 0;
+	int i;
+
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s <trace> <pid> <pid>\n", argv[0]);
+		return 1;
+	}
+
+	if (read_trace(argv[1]) != 0)
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		memset(&contexts[i], 0, sizeof(contexts[i]));
+		contexts[i].task = strtoul(argv[2 + i], NULL, 10);
+		contexts[i].parsed = i;
+		contexts[i].out = tmpfile();
+		if (!contexts[i].out) {
+			fprintf(stderr, "tmpfile failed: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		errno = pthread_create(&threads[i], NULL, analyze,
+				       &contexts[i]);
+		if (errno) {
+			fprintf(stderr, "pthread_create failed: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 2; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < 2; i++) {
+		printf("context %d: task %u, %s\n\n", i, contexts[i].task,
+		       contexts[i].parsed ? "parsed events" : "trace lines");
+
+		rewind(contexts[i].out);
+		while (fgets(buf, sizeof(buf), contexts[i].out))
+			fputs(buf, stdout);
+		fclose(contexts[i].out);
+		printf("\n");
+
+		if (contexts[i].ret)
+			ret = 1;
+	}
+
+	for (i = 0; i < nr_lines; i++)
+		free(lines[i]);
+	free(lines);
+
+	return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "futex.h"
+#include "util.h"
+#include "trace_event.h"
+
+#define SWITCH_STR "sched_switch: "
+#define WAKEUP_STR "sched_wakeup: "
+#define MIGRATE_STR "sched_migrate_task: "
+#define SYS_ENTER_STR "sys_enter: "
+#define SYS_EXIT_STR "sys_exit: "
+
+static int starts_with(const char *str, const char *prefix)
+{
+	return (strncmp(str, prefix, strlen(prefix)) == 0);
+}
+
+static int parse_sched_switch(const char *fields, struct trace_event *ev)
+{
+	unsigned long prev_pid;
+	unsigned long next_pid;
+
+	if (trace_field_ul(fields, " prev_pid=", &prev_pid) != 0 ||
+	    trace_field_ul(fields, " next_pid=", &next_pid) != 0 ||
+	    trace_field_str(fields, " prev_state=", ev->prev_state,
+			    sizeof(ev->prev_state)) != 0) {
+		return -1;
+	}
+
+	ev->pid = prev_pid;
+	ev->next_pid = next_pid;
+
+	return 0;
+}
+
+static int parse_sched_wakeup(const char *fields, struct trace_event *ev)
+{
+	unsigned long pid;
+	unsigned long cpu;
+
+	if (trace_field_ul(fields, " pid=", &pid) != 0)
+		return -1;
+	if (trace_field_ul(fields, " target_cpu=", &cpu) != 0)
+		cpu = -1;
+
+	ev->pid = pid;
+	ev->cpu = cpu;
+
+	return 0;
+}
+
+static int parse_sched_migrate(const char *fields, struct trace_event *ev)
+{
+	unsigned long orig_cpu;
+	unsigned long dest_cpu;
+	unsigned long pid;
+
+	if (trace_field_ul(fields, " pid=", &pid) != 0 ||
+	    trace_field_ul(fields, " orig_cpu=", &orig_cpu) != 0 ||
+	    trace_field_ul(fields, " dest_cpu=", &dest_cpu) != 0) {
+		return -1;
+	}
+
+	ev->pid = pid;
+	ev->orig_cpu = orig_cpu;
+	ev->cpu = dest_cpu;
+
+	return 0;
+}
+
+static int parse_syscall(const char *fields, struct trace_event *ev)
+{
+	const char *p;
+
+	p = strstr(fields, "NR ");
+	if (!p)
+		return -1;
+	ev->nr = strtoul(p + 3, NULL, 10);
+
+	ev->futex_cmd = (unsigned int)-1;
+	if (ev->type == TEV_SYS_ENTER && ev->nr == NR_FUTEX &&
+	    futex_parse_args(p, &ev->futex_uaddr, &ev->futex_cmd) != 0) {
+		ev->futex_cmd = (unsigned int)-1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse an event, given as "<name>: <fields>" (the part of a trace line
+ * after the timestamp). Events that are not typed, or that lack a field,
+ * are TEV_OTHER.
+ */
+void trace_event_parse(const char *event, struct trace_event *ev)
+{
+	const char *fields;
+	int ret = -1;
+
+	memset(ev, 0, sizeof(*ev));
+
+	/* the fields keep their leading space, as in the trace line */
+	fields = strstr(event, ": ");
+	if (!fields)
+		return;
+	fields++;
+
+	if (starts_with(event, SWITCH_STR)) {
+		ev->type = TEV_SCHED_SWITCH;
+		ret = parse_sched_switch(fields, ev);
+	} else if (starts_with(event, WAKEUP_STR)) {
+		ev->type = TEV_SCHED_WAKEUP;
+		ret = parse_sched_wakeup(fields, ev);
+	} else if (starts_with(event, MIGRATE_STR)) {
+		ev->type = TEV_SCHED_MIGRATE;
+		ret = parse_sched_migrate(fields, ev);
+	} else if (starts_with(event, SYS_ENTER_STR)) {
+		ev->type = TEV_SYS_ENTER;
+		ret = parse_syscall(fields, ev);
+	} else if (starts_with(event, SYS_EXIT_STR)) {
+		ev->type = TEV_SYS_EXIT;
+		ret = parse_syscall(fields, ev);
+	}
+
+	if (ret != 0)
+		ev->type = TEV_OTHER;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_EVENT_H
+#define TRACE_EVENT_H
+
+#include <sys/types.h>
+
+/*
+ * The fields of the events most sub-patterns match on, parsed once per
+ * trace line (or stored typed in an event store) rather than searched
+ * in the text by every sub-pattern. All other events are TEV_OTHER and
+ * are only matched as text.
+ */
+enum trace_event_type {
+	TEV_OTHER = 0,
+	TEV_SCHED_SWITCH,
+	TEV_SCHED_WAKEUP,
+	TEV_SCHED_MIGRATE,
+	TEV_SYS_ENTER,
+	TEV_SYS_EXIT,
+};
+
+struct trace_event {
+	enum trace_event_type type;
+	/* sched_switch: prev_pid, sched_wakeup/sched_migrate_task: pid */
+	pid_t pid;
+	/* sched_switch: next_pid */
+	pid_t next_pid;
+	/* sched_switch: prev_state, e.g. "S" or "R+" */
+	char prev_state[8];
+	/* sched_wakeup: target_cpu, sched_migrate_task: orig/dest_cpu */
+	int orig_cpu;
+	int cpu;
+	/* sys_enter/sys_exit: the syscall and the futex arguments */
+	unsigned int nr;
+	unsigned int futex_cmd;
+	unsigned long futex_uaddr;
+};
+
+extern void trace_event_parse(const char *event, struct trace_event *ev);
+
+#endif /* TRACE_EVENT_H */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "trace_index.h"
+#include "util.h"
+
+/*
+ * Seek a text trace to a timestamp. Without an index, the file offsets
+ * are bisected: every probe resyncs to the next event line and reads
+ * its timestamp, so only a few lines per step are read.
+ *
+ * With --index, a sparse timestamp index of the trace (the file offset
+ * and timestamp of every INDEX_INTERVAL-th event line) is kept in
+ * "<trace>.idx" for later runs, and used whenever it exists. A kept
+ * index is rebuilt when the trace no longer matches the size and
+ * modification time recorded in the header. If the index cannot be
+ * written, it is only used for this run.
+ */
+
+#define INDEX_MAGIC "LCIDX1"
+#define INDEX_INTERVAL 4096
+
+struct index_header {
+	char magic[8];
+	unsigned long long size;
+	unsigned long long mtime;
+	unsigned long long nr;
+};
+
+struct index_entry {
+	unsigned long long ts;
+	unsigned long long offset;
+};
+
+static struct index_entry *load_index(const char *idxpath,
+				      const struct stat *st,
+				      unsigned long long *nr)
+{
+	struct index_entry *entries;
+	struct index_header hdr;
+	FILE *f;
+
+	f = fopen(idxpath, "r");
+	if (!f)
+		return NULL;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    strcmp(hdr.magic, INDEX_MAGIC) != 0 ||
+	    hdr.size != (unsigned long long)st->st_size ||
+	    hdr.mtime != (unsigned long long)st->st_mtime || !hdr.nr) {
+		fclose(f);
+		return NULL;
+	}
+
+	entries = malloc(hdr.nr * sizeof(*entries));
+	if (!entries) {
+		fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+		fclose(f);
+		return NULL;
+	}
+
+	if (fread(entries, sizeof(*entries), hdr.nr, f) != hdr.nr) {
+		free(entries);
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+
+	*nr = hdr.nr;
+
+	return entries;
+}
+
+static void save_index(const char *idxpath, const struct stat *st,
+		       const struct index_entry *entries,
+		       unsigned long long nr)
+{
+	struct index_header hdr;
+	FILE *f;
+
+	f = fopen(idxpath, "w");
+	if (!f)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, INDEX_MAGIC);
+	hdr.size = st->st_size;
+	hdr.mtime = st->st_mtime;
+	hdr.nr = nr;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fwrite(entries, sizeof(*entries), nr, f) != nr) {
+		fclose(f);
+		remove(idxpath);
+		return;
+	}
+
+	if (fclose(f) != 0)
+		remove(idxpath);
+}
+
+/* whether a line is an event line, i.e. neither a comment nor a stack */
+static int is_event_line(const char *line)
+{
+	return line[0] != '#' && strncmp(line, " => ", 4) != 0;
+}
+
+static int build_index(const char *path, struct index_entry **index,
+		       unsigned long long *nr)
+{
+	struct index_entry *entries = NULL;
+	struct index_entry *e;
+	unsigned long events = 0;
+	unsigned long long ts;
+	char line[512];
+	long offset;
+	int n = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (offset = ftell(f); fgets(line, sizeof(line), f);
+	     offset = ftell(f)) {
+
+		/* only seek to event lines, not into <stack trace> blocks */
+		if (!is_event_line(line))
+			continue;
+
+		if (events++ % INDEX_INTERVAL || trace_ts(line, &ts) != 0)
+			continue;
+
+		e = array_grow(entries, n, sizeof(*e));
+		if (!e) {
+			free(entries);
+			fclose(f);
+			return -1;
+		}
+		entries = e;
+
+		entries[n].ts = ts;
+		entries[n].offset = offset;
+		n++;
+	}
+
+	fclose(f);
+
+	*index = entries;
+	*nr = n;
+
+	return 0;
+}
+
+/*
+ * Get the offset and timestamp of the first event line starting at or
+ * after "pos". Returns -1 if there is none.
+ */
+static int next_event(FILE *f, long pos, long *offset, unsigned long long *ts)
+{
+	char line[512];
+	int c;
+
+	/* resync to the start of a line */
+	if (pos > 0) {
+		if (fseek(f, pos - 1, SEEK_SET) != 0)
+			return -1;
+		while ((c = getc(f)) != EOF && c != '\n')
+			;
+		if (c == EOF)
+			return -1;
+	} else {
+		rewind(f);
+	}
+
+	for (*offset = ftell(f); fgets(line, sizeof(line), f);
+	     *offset = ftell(f)) {
+		if (is_event_line(line) && trace_ts(line, ts) == 0)
+			return 0;
+
+		/* skip the rest of overlong lines */
+		if (!strchr(line, '\n')) {
+			while ((c = getc(f)) != EOF && c != '\n')
+				;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Bisect the file offsets of the trace for the last event line with a
+ * timestamp before "ts", so that no line at "ts" is skipped.
+ */
+static int bisect_trace(const char *path, unsigned long long ts,
+			long size, long *offset)
+{
+	unsigned long long line_ts;
+	long line_offset;
+	long lo = 0;
+	long hi = size;
+	long mid;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "fopen failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	*offset = 0;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (next_event(f, mid, &line_offset, &line_ts) != 0 ||
+		    line_ts >= ts) {
+			hi = mid;
+			continue;
+		}
+		*offset = line_offset;
+		lo = line_offset + 1;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+/*
+ * Get an offset of the trace at "path" to read from for the events at
+ * or after "ts" (in ns): that of the last indexed event line with a
+ * timestamp not after "ts" if there is an index, building it first if
+ * "save" is set (and saving it in "<trace>.idx"), otherwise that of the
+ * last event line before "ts" found by bisecting the file. Before the
+ * first such line, the offset is 0.
+ */
+int trace_index_seek(const char *path, unsigned long long ts, int save,
+		     long *offset)
+{
+	struct index_entry *entries;
+	unsigned long long nr = 0;
+	unsigned long long lo;
+	unsigned long long hi;
+	unsigned long long mid;
+	char idxpath[512];
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "stat failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	snprintf(idxpath, sizeof(idxpath), "%s.idx", path);
+
+	entries = load_index(idxpath, &st, &nr);
+	if (!entries) {
+		if (!save)
+			return bisect_trace(path, ts, st.st_size, offset);
+		if (build_index(path, &entries, &nr) != 0)
+			return -1;
+		if (nr)
+			save_index(idxpath, &st, entries, nr);
+	}
+	/* find the first entry after ts */
+	lo = 0;
+	hi = nr;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (entries[mid].ts <= ts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*offset = lo ? (long)entries[lo - 1].offset : 0;
+
+	free(entries);
+
+	return 0;
+}
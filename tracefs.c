@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+#include "tracefs.h"
+
+/*
+ * The tracefs root is either a mounted tracefs or a plain directory
+ * standing in for it (the fake backend). A plain directory is only
+ * taken for a fake tracefs if it holds the marker file "latcheck_fake",
+ * so that a mistyped root is refused rather than written to. The fake
+ * backend appends all attribute writes to the file "writes" of the
+ * root, in the order they are done, and serves the files read by
+ * latcheck (trace, trace_pipe, snapshot, hist, synthetic_events) from
+ * the root rather than from the instance. Thus the capture path can
+ * run without root privileges on a pre-baked trace.
+ */
+
+#ifndef TRACEFS_MAGIC
+#define TRACEFS_MAGIC 0x74726163
+#endif
+#ifndef DEBUGFS_MAGIC
+#define DEBUGFS_MAGIC 0x64626720
+#endif
+
+#define FAKE_MARKER "latcheck_fake"
+#define FAKE_WRITES "writes"
+
+static char root[MAXPATHLEN];
+static int fake;
+
+static int is_tracefs(const char *path)
+{
+	struct statfs st;
+
+	if (statfs(path, &st) != 0)
+		return 0;
+
+	return (st.f_type == TRACEFS_MAGIC || st.f_type == DEBUGFS_MAGIC);
+}
+
+/*
+ * Select the tracefs root. Without an explicit root, prefer the tracefs
+ * mount point over the legacy debugfs location.
+ */
+const char *tracefs_init(const char *path)
+{
+	char marker[MAXPATHLEN];
+	struct stat st;
+
+	if (!path)
+		path = is_tracefs(TRACEFS_PATH) ? TRACEFS_PATH :
+						  DEBUGFS_TRACING_PATH;
+
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "no tracefs at %s\n", path);
+		return NULL;
+	}
+
+	snprintf(root, sizeof(root), "%s", path);
+	fake = !is_tracefs(root);
+
+	if (fake) {
+		snprintf(marker, sizeof(marker), "%s/" FAKE_MARKER, root);
+		if (stat(marker, &st) != 0) {
+			fprintf(stderr, "no tracefs at %s (a fake tracefs needs"
+				" the file " FAKE_MARKER ")\n", path);
+			return NULL;
+		}
+	}
+
+	return root;
+}
+
+int tracefs_is_fake(void)
+{
+	return fake;
+}
+
+/* the path relative to the root, "" for the root itself */
+static const char *relative(const char *path)
+{
+	size_t len = strlen(root);
+
+	if (strncmp(path, root, len) != 0)
+		return path;
+
+	path += len;
+	while (*path == '/')
+		path++;
+
+	return path;
+}
+
+int tracefs_record(const char *tracingpath, const char *attr_path,
+		   const char *attr_val)
+{
+	char path[MAXPATHLEN];
+	const char *rel;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/" FAKE_WRITES, root);
+	f = fopen(path, "a");
+	if (!f)
+		return -1;
+
+	rel = relative(tracingpath);
+	fprintf(f, "%s%s%s: %.*s\n", rel, *rel ? "/" : "", attr_path,
+		(int)strcspn(attr_val, "\n"), attr_val);
+
+	fclose(f);
+
+	return 0;
+}
+
+int tracefs_create_instance(char *path, size_t size, const char *name)
+{
+	int ret;
+
+	ret = snprintf(path, size, "%s/instances", root);
+	if (ret < 0 || (size_t)ret >= size)
+		return -1;
+
+	/* a fake root may not have the instances directory yet */
+	if (fake && mkdir(path, 0700) != 0 && errno != EEXIST) {
+		fprintf(stderr, "mkdir failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	ret = snprintf(path, size, "%s/instances/%s", root, name);
+	if (ret < 0 || (size_t)ret >= size)
+		return -1;
+
+	if (mkdir(path, 0700) != 0) {
+		fprintf(stderr, "mkdir failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+int tracefs_remove_instance(const char *path)
+{
+	if (rmdir(path) != 0) {
+		fprintf(stderr, "rmdir failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The path of a file to read from the instance. A fake tracefs serves
+ * all files from its root, e.g. "events/synthetic/<event>/hist" as
+ * "hist".
+ */
+int tracefs_file(char *path, size_t size, const char *tracingpath,
+		 const char *file)
+{
+	const char *base = strrchr(file, '/');
+	int ret;
+
+	if (fake)
+		ret = snprintf(path, size, "%s/%s", root,
+			       base ? base + 1 : file);
+	else
+		ret = snprintf(path, size, "%s/%s", tracingpath, file);
+	if (ret < 0 || (size_t)ret >= size)
+		return -1;
+
+	return 0;
+}
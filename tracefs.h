@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016-2017 Ericsson AB
+ * This file is part of latcheck.
+ *
+ * latcheck is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * latcheck is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with latcheck.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACEFS_H
+#define TRACEFS_H
+
+#include <stddef.h>
+
+#define TRACEFS_PATH "/sys/kernel/tracing"
+#define DEBUGFS_TRACING_PATH "/sys/kernel/debug/tracing"
+
+extern const char *tracefs_init(const char *root);
+extern int tracefs_is_fake(void);
+extern int tracefs_record(const char *tracingpath, const char *attr_path,
+			  const char *attr_val);
+extern int tracefs_create_instance(char *path, size_t size,
+				   const char *name);
+extern int tracefs_remove_instance(const char *path);
+extern int tracefs_file(char *path, size_t size, const char *tracingpath,
+			const char *file);
+
+#endif /* TRACEFS_H */
@@ -17,8 +17,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sched.h>
 #include <sys/param.h>
+#include <sys/types.h>
+#include "tracefs.h"
+#include "util.h"
 
 int set_tracing(const char *tracingpath, const char *attr_path,
 		const char *attr_val)
@@ -27,6 +33,9 @@ int set_tracing(const char *tracingpath, const char *attr_path,
 	FILE *f;
 	int ret;
 
+	if (tracefs_is_fake())
+		return tracefs_record(tracingpath, attr_path, attr_val);
+
 	ret = snprintf(path, sizeof(path), "%s/%s", tracingpath, attr_path);
 	if (ret < 0 || (unsigned int)ret >= sizeof(path))
 		return -1;
@@ -44,3 +53,161 @@ int set_tracing(const char *tracingpath, const char *attr_path,
 
 	return 0;
 }
+
+/*
+ * Append a "field == pid" term for each task to the filter, joining
+ * all terms (including any already in the filter) with "||".
+ */
+int filter_add_pids(char *filter, size_t size, const char *field,
+		    const pid_t *tasks, int ntasks)
+{
+	size_t len = strlen(filter);
+	int ret;
+	int i;
+
+	for (i = 0; i < ntasks; i++) {
+		ret = snprintf(filter + len, size - len, "%s%s == %u",
+			       len ? " || " : "", field, tasks[i]);
+		if (ret < 0 || (size_t)ret >= size - len)
+			return -1;
+		len += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse the numeric value of a trace line field. The field must be
+ * given with its separators, e.g. " prev_pid=".
+ */
+int trace_field_ul(const char *traceline, const char *field,
+		   unsigned long *val)
+{
+	char *p;
+
+	p = strstr(traceline, field);
+	if (!p)
+		return -1;
+	p += strlen(field);
+
+	*val = strtoul(p, NULL, 10);
+
+	return 0;
+}
+
+/* copy the (space separated) value of a trace line field */
+int trace_field_str(const char *traceline, const char *field,
+		    char *buf, size_t size)
+{
+	size_t len;
+	char *p;
+
+	p = strstr(traceline, field);
+	if (!p)
+		return -1;
+	p += strlen(field);
+
+	len = strcspn(p, " \n");
+	if (len >= size)
+		len = size - 1;
+	memcpy(buf, p, len);
+	buf[len] = 0;
+
+	return 0;
+}
+
+unsigned long long ts_to_ns(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* parse the timestamp of a trace event line (in ns) */
+int trace_ts(const char *traceline, unsigned long long *ns)
+{
+	unsigned long usec;
+	const char *p;
+
+	p = strstr(traceline, ": ");
+	if (!p)
+		return -1;
+	while (*p != '.') {
+		if (p == traceline)
+			return -1;
+		p--;
+	}
+	usec = strtoul(p + 1, NULL, 10);
+	while (*p != ' ') {
+		if (p == traceline)
+			return -1;
+		p--;
+	}
+	*ns = strtoul(p + 1, NULL, 10) * 1000000000ULL + usec * 1000ULL;
+
+	return 0;
+}
+
+/* convert a kernel priority to the (user space) RT priority */
+int rt_prio(int prio)
+{
+	if (prio < 99)
+		return 99 - prio;
+
+	return 0;
+}
+
+/*
+ * Make room for one more element in an array currently holding "nr"
+ * elements. The array is grown in chunks. On failure NULL is returned
+ * and the array is left untouched.
+ */
+void *array_grow(void *array, int nr, size_t size)
+{
+	void *p;
+
+	if (array && nr % ARRAY_CHUNK)
+		return array;
+
+	p = realloc(array, (nr + ARRAY_CHUNK) * size);
+	if (!p)
+		fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+
+	return p;
+}
+
+/* parse a CPU list such as "0,2-3" */
+int parse_cpus(const char *list, cpu_set_t *cpus)
+{
+	unsigned long first;
+	unsigned long last;
+	char *end;
+
+	CPU_ZERO(cpus);
+
+	while (*list) {
+		first = strtoul(list, &end, 10);
+		if (end == list)
+			goto bad;
+		last = first;
+		if (*end == '-') {
+			list = end + 1;
+			last = strtoul(list, &end, 10);
+			if (end == list || last < first)
+				goto bad;
+		}
+		if (last >= CPU_SETSIZE)
+			goto bad;
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			goto bad;
+		list = end;
+	}
+
+	return 0;
+bad:
+	fprintf(stderr, "invalid CPU list\n");
+	return -1;
+}
@@ -19,7 +19,26 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/types.h>
+
+#define FILTER_MAX 2048
+#define ARRAY_CHUNK 64
+
 extern int set_tracing(const char *tracingpath, const char *attr_path,
 		       const char *attr_val);
+extern int filter_add_pids(char *filter, size_t size, const char *field,
+			   const pid_t *tasks, int ntasks);
+extern int trace_field_ul(const char *traceline, const char *field,
+			  unsigned long *val);
+extern int trace_field_str(const char *traceline, const char *field,
+			   char *buf, size_t size);
+extern unsigned long long ts_to_ns(const struct timespec *ts);
+extern int trace_ts(const char *traceline, unsigned long long *ns);
+extern int rt_prio(int prio);
+extern void *array_grow(void *array, int nr, size_t size);
+extern int parse_cpus(const char *list, cpu_set_t *cpus);
 
 #endif /* UTIL_H */